@@ -19,6 +19,9 @@
 #include "config.h"
 #include "debug.h"
 #include "mptcp.h"
+#include "mptcp_sched.h"
+#include "mptcp_token.h"
+#include "mptcp_info.h"
 
 #define MAX(a, b) ((a)>(b)?(a):(b))
 #define MIN(a, b) ((a)<(b)?(a):(b))
@@ -253,6 +256,34 @@ mtcp_getsockopt(mctx_t mctx, int sockid, int level,
 				return GetSocketError(socket, optval, optlen);
 			}
 		}
+	} else if (level == SOL_MPTCP) {
+		if (optname == MTCP_MPTCP_SCHEDULER) {
+			if (*optlen < sizeof(int)) {
+				errno = EINVAL;
+				return -1;
+			}
+			*(int *)optval = socket->mptcp_sched;
+			*optlen = sizeof(int);
+			return 0;
+
+		} else if (optname == MTCP_MPTCP_INFO) {
+			if (!optval || *optlen < sizeof(struct mtcp_mptcp_info)) {
+				errno = EINVAL;
+				return -1;
+			}
+			if (MPTCPInfoGet(socket, (struct mtcp_mptcp_info *)optval) < 0)
+				return -1;
+			*optlen = sizeof(struct mtcp_mptcp_info);
+			return 0;
+
+		} else if (optname == MTCP_MPTCP_SUBFLOW_INFO) {
+			if (!optval) {
+				errno = EINVAL;
+				return -1;
+			}
+			return MPTCPSubflowInfoGet(socket, 
+					(struct mtcp_mptcp_subflow_info *)optval, optlen);
+		}
 	}
 
 	errno = ENOSYS;
@@ -291,6 +322,50 @@ mtcp_setsockopt(mctx_t mctx, int sockid, int level,
 		return -1;
 	}
 
+	if (level == SOL_MPTCP) {
+		/* only recorded here; the connection may go away under us, so */
+		/* the mTCP thread applies it with its next send (MPTCPSchedSync) */
+		if (optname == MTCP_MPTCP_SCHEDULER) {
+			int type;
+
+			if (!optval || optlen < sizeof(int)) {
+				errno = EINVAL;
+				return -1;
+			}
+			type = *(const int *)optval;
+			if (type < 0 || type >= MPTCP_SCHED_NUM) {
+				errno = EINVAL;
+				return -1;
+			}
+			socket->mptcp_sched_seq++;
+			SchedMemoryBarrier();
+			socket->mptcp_sched = type;
+			SchedMemoryBarrier();
+			socket->mptcp_sched_seq++;
+			return 0;
+
+		} else if (optname == MTCP_MPTCP_SCHED_WEIGHTS) {
+			if (!optval || optlen == 0 || optlen > MTCP_MPTCP_MAX_WEIGHTS) {
+				errno = EINVAL;
+				return -1;
+			}
+			if (socket->socktype != MTCP_SOCK_STREAM) {
+				errno = ENOTCONN;
+				return -1;
+			}
+			socket->mptcp_sched_seq++;
+			SchedMemoryBarrier();
+			memcpy(socket->mptcp_weight, optval, optlen);
+			socket->mptcp_weight_num = optlen;
+			SchedMemoryBarrier();
+			socket->mptcp_sched_seq++;
+			return 0;
+		}
+
+		errno = ENOPROTOOPT;
+		return -1;
+	}
+
 	return 0;
 }
 /*----------------------------------------------------------------------------*/
@@ -361,6 +436,9 @@ mtcp_socket_ioctl(mctx_t mctx, int sockid, int request, void *argp)
 			errno = EBADF;
 			return -1;
 		}
+		/* MPTCP data is reassembled in the meta receive buffer */
+		if (cur_stream->mptcp_cb && cur_stream->mptcp_cb->mpcb_stream)
+			cur_stream = cur_stream->mptcp_cb->mpcb_stream;
 		rbuf = cur_stream->rcvvar->rcvbuf;
 		if (rbuf) {
 		        *(int *)argp = rbuf->merged_len;
@@ -795,18 +873,24 @@ mtcp_connect(mctx_t mctx, int sockid,
 	cur_stream = CreateTCPStream(mtcp, socket, socket->socktype, 
 			socket->saddr.sin_addr.s_addr, socket->saddr.sin_port, dip, dport);
 	
-	if (mptcp_cb)
-	{
-		cur_stream->isMPJOINStream = 1;
-		cur_stream->mptcp_cb = mptcp_cb;
-	}
-	
 	if (!cur_stream) {
 		TRACE_ERROR("Socket %d: failed to create tcp_stream!\n", sockid);
 		errno = ENOMEM;
 		return -1;
 	}
 
+	if (mptcp_cb)
+	{
+		if (MPTCPAttachSubflow(cur_stream, mptcp_cb) < 0) {
+			SQ_LOCK(&mtcp->ctx->destroyq_lock);
+			StreamEnqueue(mtcp->destroyq, cur_stream);
+			SQ_UNLOCK(&mtcp->ctx->destroyq_lock);
+			errno = ENOMEM;
+			return -1;
+		}
+		cur_stream->isMPJOINStream = 1;
+	}
+
 	if (is_dyn_bound)
 		cur_stream->is_bound_addr = TRUE;
 	cur_stream->sndvar->cwnd = 1;
@@ -881,11 +965,11 @@ CloseStreamSocket(mctx_t mctx, int sockid)
 
 	if (cur_stream->mptcp_cb != NULL)
 	{
-		// printf("No of streams = %d\n", cur_stream->mptcp_cb->num_streams);
-		for (int i = cur_stream->mptcp_cb->num_streams - 1; i >= 0; i--)
+		mptcp_cb *mpcb = cur_stream->mptcp_cb;
+
+		for (int i = mpcb->num_subflows - 1; i >= 0; i--)
 		{
-			// printf("Going to close the stream %d\n", i);
-			cur_stream = cur_stream->mptcp_cb->tcp_streams[i];
+			cur_stream = mpcb->subflows[i].stream;
 
 			/*Below is similar what is done for the normal tcp_stream*/
 			if (cur_stream->closed) {
@@ -1215,6 +1299,12 @@ CopyToUser(mtcp_manager_t mtcp, tcp_stream *cur_stream, char *buf, int len, uint
 	}
 	rcvvar->rcv_wnd = rcvvar->rcvbuf->size - rcvvar->rcvbuf->merged_len;
 
+	/* MPTCP: the window update goes out on the master subflow */
+	if (is_mpcb_stream && cur_stream->mptcp_cb->master) {
+		cur_stream = cur_stream->mptcp_cb->master;
+		cur_stream->rcvvar->rcv_wnd = rcvvar->rcv_wnd;
+	}
+
 	/* Advertise newly freed receive buffer */
 	if (cur_stream->need_wnd_adv) {
 		if (rcvvar->rcv_wnd > cur_stream->sndvar->eff_mss) {
@@ -1558,7 +1648,6 @@ mtcp_write(mctx_t mctx, int sockid, const char *buf, size_t len)
 	tcp_stream *cur_stream;
 	struct tcp_send_vars *sndvar;
 	int ret;
-	struct tcp_stream *mpcb_stream = NULL;
 
 	mtcp = GetMTCPManager(mctx);
 	if (!mtcp) {
@@ -1590,22 +1679,11 @@ mtcp_write(mctx_t mctx, int sockid, const char *buf, size_t len)
 	
 	cur_stream = socket->stream;
 	
-	/***********************SCHEDULER*******************************/
-	static int i = 1;
-	int a = 1;
-	
-	if (cur_stream->mptcp_cb != NULL){
-		mpcb_stream = cur_stream->mptcp_cb->mpcb_stream;
-		if (cur_stream->mptcp_cb->num_streams == 1)
-		{
-			cur_stream = cur_stream->mptcp_cb->tcp_streams[0];
-		}
-		else{
-			a =(i++)%(cur_stream->mptcp_cb->num_streams + 1);
-			cur_stream = cur_stream->mptcp_cb->tcp_streams[a];
-		}		
+	/* for MPTCP connections the data only goes to the connection-level */
+	/* buffer; the scheduler maps it onto subflows when the meta is flushed */
+	if (cur_stream && cur_stream->mptcp_cb && cur_stream->mptcp_cb->mpcb_stream) {
+		cur_stream = cur_stream->mptcp_cb->mpcb_stream;
 	}
-	/************************************************************/
 	
 	if (!cur_stream || 
 			!(cur_stream->state == TCP_ST_ESTABLISHED || 
@@ -1623,36 +1701,6 @@ mtcp_write(mctx_t mctx, int sockid, const char *buf, size_t len)
 		}
 	}
 
-	// Copying to mpcb send buffer
-	if (mpcb_stream)
-	{
-		sndvar = mpcb_stream->sndvar;
-		SBUF_LOCK(&sndvar->write_lock);
-#if BLOCKING_SUPPORT
-		if (!(socket->opts & MTCP_NONBLOCK)) {
-			while (sndvar->snd_wnd <= 0) {
-				TRACE_SNDBUF("Waiting for available sending window...\n");
-				if (!mpcb_stream || mpcb_stream->state != TCP_ST_ESTABLISHED) {
-					SBUF_UNLOCK(&sndvar->write_lock);
-					errno = EINTR;
-					return -1;
-				}
-				pthread_cond_wait(&sndvar->write_cond, &sndvar->write_lock);
-				TRACE_SNDBUF("Sending buffer became ready! snd_wnd: %u\n", 
-						sndvar->snd_wnd);
-			}
-		}
-#endif
-
-		ret = CopyFromUser(mtcp, mpcb_stream, buf, len);
-
-		SBUF_UNLOCK(&sndvar->write_lock);
-
-		// In normal tcp_stream there are many other checks done after, but for now not needed
-
-	}
-	
-	// Copying to subflow send buffer
 	sndvar = cur_stream->sndvar;
 
 	SBUF_LOCK(&sndvar->write_lock);
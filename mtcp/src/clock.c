@@ -1,4 +1,73 @@
+#include <stdio.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
 #include "clock.h" 
+#include "debug.h"
+
+#define CLOCK_CALIBRATE_NS 20000000		/* 20 ms against CLOCK_MONOTONIC */
+/*----------------------------------------------------------------------------*/
+int clock_use_tsc = FALSE;
+uint64_t clock_tsc_base;
+uint64_t clock_tsc_mult;
+uint64_t clock_mono_base;
+/*----------------------------------------------------------------------------*/
+static inline uint64_t
+MonoNsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+/*----------------------------------------------------------------------------*/
+static int
+TSCInvariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return FALSE;
+	return (edx >> 8) & 1;
+#else
+	return FALSE;
+#endif
+}
+/*----------------------------------------------------------------------------*/
+void
+InitClock(void)
+{
+	uint64_t tsc0, tsc1, ns0, ns1;
+
+	clock_mono_base = MonoNsec();
+	if (!TSCInvariant()) {
+		TRACE_INFO("No invariant TSC, using CLOCK_MONOTONIC.\n");
+		return;
+	}
+
+	ns0 = MonoNsec();
+	tsc0 = ReadTSC();
+	do {
+		ns1 = MonoNsec();
+	} while (ns1 - ns0 < CLOCK_CALIBRATE_NS);
+	tsc1 = ReadTSC();
+
+	if (tsc1 <= tsc0) {
+		TRACE_INFO("TSC does not advance, using CLOCK_MONOTONIC.\n");
+		return;
+	}
+	clock_tsc_mult = ((ns1 - ns0) << 32) / (tsc1 - tsc0);
+	/* both bases describe the same instant, within the read skew */
+	clock_tsc_base = tsc1 - (uint64_t)(((unsigned __int128)(ns1 - clock_mono_base) << 32) / 
+			clock_tsc_mult);
+	clock_use_tsc = TRUE;
+
+	TRACE_INFO("TSC runs at %lu kHz.\n", 
+			(unsigned long)((tsc1 - tsc0) * 1000000 / (ns1 - ns0)));
+}
 /*----------------------------------------------------------------------------*/
 uint64_t init_time_ns = 0;
 uint32_t last_print = 0;
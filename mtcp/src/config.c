@@ -16,6 +16,8 @@
 #include "tcp_in.h"
 #include "arp.h"
 #include "debug.h"
+#include "mptcp_cc.h"
+#include "mptcp_pm.h"
 /* for setting up io modules */
 #include "io_module.h"
 /* for if_nametoindex */
@@ -38,6 +40,9 @@ struct mtcp_config CONFIG = {
 	.tcp_timewait	  =			TCP_TIMEWAIT,
 	.num_mem_ch	  =			0,
 	.gatewayCount = 0,
+	.mptcp_cc	  =			MPTCP_CC_LIA,
+	.mptcp_pm	  =			MPTCP_PM_FULLMESH,
+	.mptcp_ndiffports =			2,
 #if USE_CCP
 	.cc           	  =         		"reno\n",
 #endif
@@ -50,6 +55,7 @@ struct mtcp_config CONFIG = {
 addr_pool_t ap[ETH_NUM] = 			{NULL};
 static char port_list[MAX_OPTLINE_LEN] = 	"";
 static char port_stat_list[MAX_OPTLINE_LEN] = 	"";
+static char mptcp_backup_list[MAX_OPTLINE_LEN] = 	"";
 /* total cpus detected in the mTCP stack*/
 int num_cpus;
 /* this should be equal to num_cpus */
@@ -581,6 +587,25 @@ SaveInterfaceStatList(char *dev_name_list)
 	strcpy(port_stat_list, dev_name_list);
 }
 /*----------------------------------------------------------------------------*/
+static inline void
+SaveMPTCPBackupList(char *dev_name_list)
+{
+	strcpy(mptcp_backup_list, dev_name_list);
+}
+/*----------------------------------------------------------------------------*/
+/* marks the interfaces named by mptcp_backup once SetNetEnv has filled in */
+/* the eth table                                                            */
+static inline void
+SetMPTCPBackup(char *dev_name_list)
+{
+	int i;
+
+	for (i = 0; i < CONFIG.eths_num; i++) {
+		if (strstr(dev_name_list, CONFIG.eths[i].dev_name) != 0)
+			CONFIG.eths[i].mptcp_backup = TRUE;
+	}
+}
+/*----------------------------------------------------------------------------*/
 static int 
 ParseConfiguration(char *line)
 {
@@ -646,11 +671,19 @@ ParseConfiguration(char *line)
 		}
 	} else if (strcmp(p, "tcp_timeout") == 0) {
 		CONFIG.tcp_timeout = mystrtol(q, 10);
+		if (CONFIG.tcp_timeout > TS_MAX_SEC) {
+			TRACE_CONFIG("tcp_timeout is capped at %d seconds.\n", TS_MAX_SEC);
+			CONFIG.tcp_timeout = TS_MAX_SEC;
+		}
 		if (CONFIG.tcp_timeout > 0) {
 			CONFIG.tcp_timeout = SEC_TO_USEC(CONFIG.tcp_timeout) / TIME_TICK;
 		}
 	} else if (strcmp(p, "tcp_timewait") == 0) {
 		CONFIG.tcp_timewait = mystrtol(q, 10);
+		if (CONFIG.tcp_timewait > TS_MAX_SEC) {
+			TRACE_CONFIG("tcp_timewait is capped at %d seconds.\n", TS_MAX_SEC);
+			CONFIG.tcp_timewait = TS_MAX_SEC;
+		}
 		if (CONFIG.tcp_timewait > 0) {
 			CONFIG.tcp_timewait = SEC_TO_USEC(CONFIG.tcp_timewait) / TIME_TICK;
 		}
@@ -677,6 +710,30 @@ ParseConfiguration(char *line)
 	} else if (strcmp(p, "onvm_dest") == 0) {
 		CONFIG.onvm_dest = mystrtol(q, 10);
 #endif
+	} else if (strcmp(p, "mptcp_cc") == 0) {
+		CONFIG.mptcp_cc = MPTCPCCGetAlgo(q);
+		if (CONFIG.mptcp_cc < 0) {
+			TRACE_CONFIG("Unknown MPTCP congestion control: %s "
+					"(reno, lia, olia or balia)\n", q);
+			return -1;
+		}
+	} else if (strcmp(p, "mptcp_pm") == 0) {
+		CONFIG.mptcp_pm = MPTCPPMGetMode(q);
+		if (CONFIG.mptcp_pm < 0) {
+			TRACE_CONFIG("Unknown MPTCP path manager: %s "
+					"(none, fullmesh or ndiffports)\n", q);
+			return -1;
+		}
+	} else if (strcmp(p, "mptcp_ndiffports") == 0) {
+		CONFIG.mptcp_ndiffports = mystrtol(q, 10);
+		if (CONFIG.mptcp_ndiffports < 1 || 
+				CONFIG.mptcp_ndiffports > MPTCP_PM_MAX_PATHS + 1) {
+			TRACE_CONFIG("mptcp_ndiffports must be between 1 and %d\n", 
+					MPTCP_PM_MAX_PATHS + 1);
+			return -1;
+		}
+	} else if (strcmp(p, "mptcp_backup") == 0) {
+		SaveMPTCPBackupList(line + strlen(p) + 1);
 	} else if (strcmp(p, "multiprocess") == 0) {
 		SetMultiProcessSupport(line + strlen(p) + 1);
     } else if (strcmp(p, "cc") == 0) {
@@ -756,7 +813,9 @@ LoadConfiguration(const char *fname)
 	if (CONFIG.rcvbuf_size == -1 && CONFIG.sndbuf_size == -1)
 		CONFIG.sndbuf_size = CONFIG.rcvbuf_size = 8192;
 	
-	return SetNetEnv(port_list, port_stat_list);
+	if (SetNetEnv(port_list, port_stat_list) < 0)
+		return -1;
+	SetMPTCPBackup(mptcp_backup_list);
 	
 	return 0;
 }
@@ -791,6 +850,22 @@ PrintConfiguration()
 	}
 	TRACE_CONFIG("TCP timewait seconds: %d\n", 
 			USEC_TO_SEC(CONFIG.tcp_timewait * TIME_TICK));
+	TRACE_CONFIG("MPTCP congestion control: %s\n", 
+			MPTCPCCGetName(CONFIG.mptcp_cc));
+	if (CONFIG.mptcp_pm == MPTCP_PM_NDIFFPORTS) {
+		TRACE_CONFIG("MPTCP path manager: %s (%d subflows)\n", 
+				MPTCPPMGetName(CONFIG.mptcp_pm), CONFIG.mptcp_ndiffports);
+	} else {
+		TRACE_CONFIG("MPTCP path manager: %s\n", 
+				MPTCPPMGetName(CONFIG.mptcp_pm));
+	}
+	TRACE_CONFIG("MPTCP backup NICs:");
+	for (i = 0; i < CONFIG.eths_num; i++) {
+		if (CONFIG.eths[i].mptcp_backup) {
+			TRACE_CONFIG(" %s", CONFIG.eths[i].dev_name);
+		}
+	}
+	TRACE_CONFIG("\n");
 	TRACE_CONFIG("NICs to print statistics:");
 	for (i = 0; i < CONFIG.eths_num; i++) {
 		if (CONFIG.eths[i].stat_print) {
@@ -27,7 +27,11 @@
 #include "arp.h"
 #include "ip_out.h"
 #include "timer.h"
+#include "clock.h"
 #include "debug.h"
+#include "mptcp_map.h"
+#include "mptcp_token.h"
+#include "mptcp_handoff.h"
 #if USE_CCP
 #include "ccp.h"
 #include "libccp/ccp.h"
@@ -519,6 +523,8 @@ HandleApplicationCalls(mtcp_manager_t mtcp, uint32_t cur_ts)
 		
 		if (sndvar->sndbuf) {
 			sndvar->fss = sndvar->sndbuf->head_seq + sndvar->sndbuf->len;
+		} else if (sndvar->dss_maps) {
+			sndvar->fss = MPTCP_MAP_END(sndvar->dss_maps);
 		} else {
 			sndvar->fss = stream->snd_nxt;
 		}
@@ -704,17 +710,21 @@ WritePacketsToChunks(mtcp_manager_t mtcp, uint32_t cur_ts)
 static int
 DestroyRemainingFlows(mtcp_manager_t mtcp)
 {
-	struct hashtable *ht = mtcp->tcp_flow_table;
+	struct flow_table *ft = mtcp->tcp_flow_table;
 	tcp_stream *walk;
-	int cnt, i;
+	uint32_t i;
+	int cnt, j;
 
 	cnt = 0;
 #if 0
 	thread_printf(mtcp, mtcp->log_fp, 
 			"CPU %d: Flushing remaining flows.\n", mtcp->ctx->cpu);
 #endif
-	for (i = 0; i < NUM_BINS; i++) {
-		TAILQ_FOREACH(walk, &ht->ht_table[i], rcvvar->he_link) {
+	for (i = 0; i <= ft->mask; i++) {
+		for (j = 0; j < FLOW_BUCKET_ENTRIES; j++) {
+			if (!ft->buckets[i].tag[j])
+				continue;
+			walk = ft->buckets[i].stream[j];
 #ifdef DUMP_STREAM
 			thread_printf(mtcp, mtcp->log_fp, 
 					"CPU %d: Destroying stream %d\n", mtcp->ctx->cpu, walk->id);
@@ -724,6 +734,20 @@ DestroyRemainingFlows(mtcp_manager_t mtcp)
 			cnt++;
 		}
 	}
+	/* flows the cuckoo insert could not place; removing one moves the */
+	/* last stash entry into its slot, so walk from the end             */
+	for (j = ft->stash_cnt - 1; j >= 0; j--) {
+		if (j >= ft->stash_cnt)
+			continue;
+		walk = ft->stash[j];
+#ifdef DUMP_STREAM
+		thread_printf(mtcp, mtcp->log_fp,
+				"CPU %d: Destroying stream %d\n", mtcp->ctx->cpu, walk->id);
+		DumpStream(mtcp, walk);
+#endif
+		DestroyTCPStream(mtcp, walk);
+		cnt++;
+	}
 
 	return cnt;
 }
@@ -758,18 +782,40 @@ InterruptApplication(mtcp_manager_t mtcp)
 	}
 }
 /*----------------------------------------------------------------------------*/
+static inline void
+PrefetchFlow(mtcp_manager_t mtcp, const uint8_t *pkt, int len, uint32_t rxhash)
+{
+	const struct ethhdr *ethh = (const struct ethhdr *)pkt;
+	const struct iphdr *iph = (const struct iphdr *)(ethh + 1);
+	const struct tcphdr *tcph;
+	struct flow_key key;
+
+	if (len < (int)(sizeof(struct ethhdr) + sizeof(struct iphdr)) || 
+			ethh->h_proto != htons(ETH_P_IP) || iph->protocol != IPPROTO_TCP)
+		return;
+	tcph = (const struct tcphdr *)((const uint8_t *)iph + (iph->ihl << 2));
+	if ((const uint8_t *)tcph + 4 > pkt + len)
+		return;
+
+	/* the flow as tcp_stream sees it, local address first */
+	key.saddr = iph->daddr;
+	key.daddr = iph->saddr;
+	key.sport = tcph->dest;
+	key.dport = tcph->source;
+	FlowTablePrefetch(mtcp->tcp_flow_table, &key, rxhash);
+}
+/*----------------------------------------------------------------------------*/
 static void 
 RunMainLoop(struct mtcp_thread_context *ctx)
 {
 	mtcp_manager_t mtcp = ctx->mtcp_manager;
-	int i;
+	int i, j, n;
 	int recv_cnt;
 	int rx_inf, tx_inf;
-	struct timeval cur_ts = {0};
+	uint64_t now_ns;
 	uint32_t ts, ts_prev;
 	int thresh;
 
-	gettimeofday(&cur_ts, NULL);
 	TRACE_DBG("CPU %d: mtcp thread running.\n", ctx->cpu);
 
 	ts = ts_prev = 0;
@@ -778,27 +824,47 @@ RunMainLoop(struct mtcp_thread_context *ctx)
 		STAT_COUNT(mtcp->runstat.rounds);
 		recv_cnt = 0;
 			
-		gettimeofday(&cur_ts, NULL);
-		ts = TIMEVAL_TO_TS(&cur_ts);
+		now_ns = NowNsec();
+		ts = NSEC_TO_TS(now_ns);
 		mtcp->cur_ts = ts;
+		mtcp->cur_tsval = NSEC_TO_TSVAL(now_ns);
 
 		for (rx_inf = 0; rx_inf < CONFIG.eths_num; rx_inf++) {
 
-			static uint16_t len;
-			static uint8_t *pktbuf;
+			uint16_t len[FLOW_PREFETCH_BATCH];
+			uint8_t *pktbuf[FLOW_PREFETCH_BATCH];
+			uint32_t rxhash[FLOW_PREFETCH_BATCH];
 			recv_cnt = mtcp->iom->recv_pkts(ctx, rx_inf);
 			STAT_COUNT(mtcp->runstat.rounds_rx_try);
 
-			for (i = 0; i < recv_cnt; i++) {
-				pktbuf = mtcp->iom->get_rptr(mtcp->ctx, rx_inf, i, &len);
-				if (pktbuf != NULL)
-					ProcessPacket(mtcp, rx_inf, ts, pktbuf, len);
+			for (i = 0; i < recv_cnt; i += n) {
+				n = MIN(recv_cnt - i, FLOW_PREFETCH_BATCH);
+				/* load the flow table buckets of a batch before its */
+				/* first packet needs them                             */
+				for (j = 0; j < n; j++) {
+					pktbuf[j] = mtcp->iom->get_rptr(mtcp->ctx, rx_inf, 
+							i + j, &len[j], &rxhash[j]);
+					if (pktbuf[j] != NULL)
+						PrefetchFlow(mtcp, pktbuf[j], len[j], rxhash[j]);
+				}
+				for (j = 0; j < n; j++) {
+					if (pktbuf[j] != NULL)
+						ProcessPacket(mtcp, rx_inf, ts, pktbuf[j], len[j], 
+								rxhash[j]);
 #ifdef NETSTAT
-				else
-					mtcp->nstat.rx_errors[rx_inf]++;
+					else
+						mtcp->nstat.rx_errors[rx_inf]++;
 #endif
+				}
 			}
 		}
+		/* subflows other cores received for connections of this one */
+		MPTCPHandoffPoll(mtcp, ts);
+		if (mtcp->tcp_flow_table->need_grow) {
+			pthread_mutex_lock(&ctx->flow_pool_lock);
+			FlowTableGrow(mtcp->tcp_flow_table);
+			pthread_mutex_unlock(&ctx->flow_pool_lock);
+		}
 		STAT_COUNT(mtcp->runstat.rounds_rx);
 
 		/* interaction with application */
@@ -821,12 +887,8 @@ RunMainLoop(struct mtcp_thread_context *ctx)
 			if (thresh == -1)
 				thresh = CONFIG.max_concurrency;
 
-			CheckRtmTimeout(mtcp, ts, thresh);
-			CheckTimewaitExpire(mtcp, ts, CONFIG.max_concurrency);
-
-			if (CONFIG.tcp_timeout > 0 && ts != ts_prev) {
-				CheckConnectionTimeout(mtcp, ts, thresh);
-			}
+			/* RTO, TIME_WAIT and connection timeout */
+			CheckTimers(mtcp, ts, thresh);
 		}
 
 		/* if epoll is in use, flush all the queued events */
@@ -847,7 +909,7 @@ RunMainLoop(struct mtcp_thread_context *ctx)
 			mtcp->iom->send_pkts(ctx, tx_inf);
 		}
 
-		if (ts != ts_prev) {
+		if (ts - ts_prev >= MSEC_TO_TS(1)) {
 			ts_prev = ts;
 			if (ctx->cpu == mtcp_master) {
 				ARPTimer(mtcp, ts);
@@ -909,6 +971,7 @@ static mtcp_manager_t
 InitializeMTCPManager(struct mtcp_thread_context* ctx)
 {
 	mtcp_manager_t mtcp;
+	struct mptcp_handoff *handoff;
 	char log_name[MAX_FILE_NAME];
 	int i;
 
@@ -920,7 +983,7 @@ InitializeMTCPManager(struct mtcp_thread_context* ctx)
 	}
 	g_mtcp[ctx->cpu] = mtcp;
 
-	mtcp->tcp_flow_table = CreateHashtable(HashFlow, EqualFlow, NUM_BINS_FLOWS);
+	mtcp->tcp_flow_table = CreateFlowTable();
 	if (!mtcp->tcp_flow_table) {
 		CTRACE_ERROR("Falied to allocate tcp flow table.\n");
 		return NULL;
@@ -940,49 +1003,40 @@ InitializeMTCPManager(struct mtcp_thread_context* ctx)
 		return NULL;
 	}
 
+	mtcp->mptcp_tokens = MPTCPTokenTableCreate(CONFIG.max_concurrency);
+	if (!mtcp->mptcp_tokens) {
+		CTRACE_ERROR("Failed to allocate MPTCP token table.\n");
+		return NULL;
+	}
+
+	/* the other cores find it through g_mtcp once it is complete */
+	handoff = MPTCPHandoffCreate(ctx->cpu);
+	if (!handoff && CONFIG.num_cores > 1) {
+		CTRACE_ERROR("Failed to allocate MPTCP handoff rings.\n");
+		return NULL;
+	}
+	__asm__ volatile("" : : : "memory");
+	mtcp->mptcp_handoff = handoff;
+
 	mtcp->ctx = ctx;
 #if !defined(DISABLE_DPDK) && !ENABLE_ONVM
 	char pool_name[RTE_MEMPOOL_NAMESIZE];
 	sprintf(pool_name, "flow_pool_%d", ctx->cpu);
-	mtcp->flow_pool = MPCreate(pool_name, sizeof(tcp_stream),
-				   sizeof(tcp_stream) * CONFIG.max_concurrency);
+	/* a stream comes with its send and receive variables in one chunk */
+	mtcp->flow_pool = MPCreate(pool_name, sizeof(struct tcp_stream_chunk),
+			sizeof(struct tcp_stream_chunk) * CONFIG.max_concurrency);
 	if (!mtcp->flow_pool) {
 		CTRACE_ERROR("Failed to allocate tcp flow pool.\n");
 		return NULL;
 	}
-	sprintf(pool_name, "rv_pool_%d", ctx->cpu);	
-	mtcp->rv_pool = MPCreate(pool_name, sizeof(struct tcp_recv_vars), 
-			sizeof(struct tcp_recv_vars) * CONFIG.max_concurrency);
-	if (!mtcp->rv_pool) {
-		CTRACE_ERROR("Failed to allocate tcp recv variable pool.\n");
-		return NULL;
-	}
-	sprintf(pool_name, "sv_pool_%d", ctx->cpu);
-	mtcp->sv_pool = MPCreate(pool_name, sizeof(struct tcp_send_vars), 
-			sizeof(struct tcp_send_vars) * CONFIG.max_concurrency);
-	if (!mtcp->sv_pool) {
-		CTRACE_ERROR("Failed to allocate tcp send variable pool.\n");
-		return NULL;
-	}
 #else
-	mtcp->flow_pool = MPCreate(sizeof(tcp_stream),
-				   sizeof(tcp_stream) * CONFIG.max_concurrency);
+	/* a stream comes with its send and receive variables in one chunk */
+	mtcp->flow_pool = MPCreate(sizeof(struct tcp_stream_chunk),
+			sizeof(struct tcp_stream_chunk) * CONFIG.max_concurrency);
 	if (!mtcp->flow_pool) {
 		CTRACE_ERROR("Failed to allocate tcp flow pool.\n");
 		return NULL;
 	}
-	mtcp->rv_pool = MPCreate(sizeof(struct tcp_recv_vars), 
-			sizeof(struct tcp_recv_vars) * CONFIG.max_concurrency);
-	if (!mtcp->rv_pool) {
-		CTRACE_ERROR("Failed to allocate tcp recv variable pool.\n");
-		return NULL;
-	}
-	mtcp->sv_pool = MPCreate(sizeof(struct tcp_send_vars), 
-			sizeof(struct tcp_send_vars) * CONFIG.max_concurrency);
-	if (!mtcp->sv_pool) {
-		CTRACE_ERROR("Failed to allocate tcp send variable pool.\n");
-		return NULL;
-	}	
 #endif
 	mtcp->rbm_snd = SBManagerCreate(mtcp, CONFIG.sndbuf_size, CONFIG.max_num_buffers);
 	if (!mtcp->rbm_snd) {
@@ -1085,9 +1139,11 @@ InitializeMTCPManager(struct mtcp_thread_context* ctx)
 		}
 	}
 		
-	mtcp->rto_store = InitRTOHashstore();
-	TAILQ_INIT(&mtcp->timewait_list);
-	TAILQ_INIT(&mtcp->timeout_list);
+	mtcp->timer_wheel = CreateTimerWheel();
+	if (!mtcp->timer_wheel) {
+		CTRACE_ERROR("Failed to allocate timer wheel.\n");
+		return NULL;
+	}
 
 #if BLOCKING_SUPPORT
 	TAILQ_INIT(&mtcp->rcv_br_list);
@@ -1164,6 +1220,7 @@ MTCPRunThread(void *arg)
 	int working;
 	struct mtcp_manager *mtcp;
 	struct mtcp_thread_context *ctx;
+	struct mptcp_handoff *handoff;
 
 	/* affinitize the thread to this core first */
 #ifndef DISABLE_DPDK
@@ -1254,11 +1311,16 @@ MTCPRunThread(void *arg)
 	m.cpu = cpu;
 	mtcp_free_context(&m);
 	/* destroy hash tables */
-	DestroyHashtable(g_mtcp[cpu]->tcp_flow_table);
+	DestroyFlowTable(g_mtcp[cpu]->tcp_flow_table);
 #if USE_CCP
 	DestroyHashtable(g_mtcp[cpu]->tcp_sid_table);
 #endif
 	DestroyHashtable(g_mtcp[cpu]->listeners);
+	MPTCPTokenTableDestroy(g_mtcp[cpu]->mptcp_tokens);
+	DestroyTimerWheel(g_mtcp[cpu]->timer_wheel);
+	handoff = g_mtcp[cpu]->mptcp_handoff;
+	g_mtcp[cpu]->mptcp_handoff = NULL;
+	MPTCPHandoffDestroy(handoff);
 	
 	TRACE_DBG("MTCP thread %d finished.\n", ctx->cpu);
 	
@@ -1476,8 +1538,6 @@ mtcp_free_context(mctx_t mctx)
 		DestroyMTCPSender(mtcp->n_sender[i]);
 	}
 
-	MPDestroy(mtcp->rv_pool);
-	MPDestroy(mtcp->sv_pool);
 	MPDestroy(mtcp->flow_pool);
 	
 	if (mtcp->ap) {
@@ -1610,6 +1670,8 @@ mtcp_init(const char *config_file)
 	}
 	PrintConfiguration();
 
+	InitClock();
+
 	for (i = 0; i < CONFIG.eths_num; i++) {
 		ap[i] = CreateAddressPool(CONFIG.eths[i].ip_addr, 1);
 		if (!ap[i]) {
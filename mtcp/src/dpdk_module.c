@@ -9,6 +9,8 @@
 #include "debug.h"
 /* for num_devices_* */
 #include "config.h"
+/* for SEC_TO_TS */
+#include "tcp_in.h"
 /* for rte_max_eth_ports */
 #include <rte_common.h>
 /* for rte_eth_rxconf */
@@ -344,7 +346,7 @@ dpdk_send_pkts(struct mtcp_thread_context *ctxt, int ifidx)
 		mtcp->nstat.tx_packets[ifidx] += cnt;
 #ifdef ENABLE_STATS_IOCTL
 		/* only pass stats after >= 1 sec interval */
-		if (abs(mtcp->cur_ts - dpc->cur_ts) >= 1000 &&
+		if (abs(mtcp->cur_ts - dpc->cur_ts) >= SEC_TO_TS(1) &&
 		    likely(dpc->fd >= 0)) {
 			/* rte_get_stats is global func, use only for 1 core */
 			if (ctxt->cpu == 0) {
@@ -515,7 +517,8 @@ ip_reassemble(struct dpdk_private_context *dpc, struct rte_mbuf *m)
 #endif
 /*----------------------------------------------------------------------------*/
 uint8_t *
-dpdk_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len)
+dpdk_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len, 
+	      uint32_t *rxhash)
 {
 	struct dpdk_private_context *dpc;
 	struct rte_mbuf *m;
@@ -524,7 +527,13 @@ dpdk_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *
 	dpc = (struct dpdk_private_context *) ctxt->io_private_context;
 
 	m = dpc->pkts_burst[index];
+	*rxhash = (m->ol_flags & PKT_RX_RSS_HASH) ? m->hash.rss : 0;
 #ifdef IP_DEFRAG
+	/* fragments are hashed over the addresses alone */
+	if (RTE_ETH_IS_IPV4_HDR(m->packet_type) && 
+	    rte_ipv4_frag_pkt_is_fragmented((struct ipv4_hdr *)
+			(rte_pktmbuf_mtod(m, struct ether_hdr *) + 1)))
+		*rxhash = 0;
 	m = ip_reassemble(dpc, m);
 #endif
 	*len = m->pkt_len;
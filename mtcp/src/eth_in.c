@@ -7,7 +7,7 @@
 /*----------------------------------------------------------------------------*/
 int
 ProcessPacket(mtcp_manager_t mtcp, const int ifidx, 
-		uint32_t cur_ts, unsigned char *pkt_data, int len)
+		uint32_t cur_ts, unsigned char *pkt_data, int len, uint32_t rxhash)
 {
 	struct ethhdr *ethh = (struct ethhdr *)pkt_data;
 	u_short ip_proto = ntohs(ethh->h_proto);
@@ -34,7 +34,7 @@ ProcessPacket(mtcp_manager_t mtcp, const int ifidx,
 
 	if (ip_proto == ETH_P_IP) {
 		/* process ipv4 packet */
-		ret = ProcessIPv4Packet(mtcp, cur_ts, ifidx, pkt_data, len);
+		ret = ProcessIPv4Packet(mtcp, cur_ts, ifidx, pkt_data, len, rxhash);
 
 	} else if (ip_proto == ETH_P_ARP) {
 		ProcessARPPacket(mtcp, cur_ts, ifidx, pkt_data, len);
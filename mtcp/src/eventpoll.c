@@ -241,6 +241,8 @@ RaisePendingStreamEvents(mtcp_manager_t mtcp,
 	/* generate read event */
 	if (socket->epoll & MTCP_EPOLLIN) {
 		struct tcp_recv_vars *rcvvar = stream->rcvvar;
+		if (stream->mptcp_cb && stream->mptcp_cb->mpcb_stream)
+			rcvvar = stream->mptcp_cb->mpcb_stream->rcvvar;
 		if (rcvvar->rcvbuf && rcvvar->rcvbuf->merged_len > 0) {
 			TRACE_EPOLL("Socket %d: Has existing payloads\n", socket->id);
 			AddEpollEvent(ep, USR_SHADOW_EVENT_QUEUE, socket, MTCP_EPOLLIN);
@@ -9,6 +9,7 @@
 
 #include "debug.h"
 #include "fhash.h"
+#include "rss.h"
 
 #define IS_FLOW_TABLE(x)	(x == HashFlow)
 #define IS_LISTEN_TABLE(x)	(x == HashListener)
@@ -125,6 +126,428 @@ StreamHTSearch(struct hashtable *ht, const void *it)
 	return NULL;
 }
 /*----------------------------------------------------------------------------*/
+#define FLOW_CUCKOO_DEPTH	32	/* displacements tried before the stash */
+#define FLOW_TABLE_LOAD(ft)	(((ft)->mask + 1) * FLOW_BUCKET_ENTRIES / 8 * 7)
+
+#define FlowBarrier()		__asm__ volatile("" : : : "memory")
+/*----------------------------------------------------------------------------*/
+/* spreads the 32-bit RSS hash over the bucket index, the alternate bucket */
+/* and the tag; its low bits alone also pick the RX queue, so all flows of */
+/* a core share them                                                       */
+static inline uint64_t
+FlowHashMix(uint32_t rss)
+{
+	uint64_t h = rss;
+
+	h *= 0x9E3779B97F4A7C15ULL;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+/*----------------------------------------------------------------------------*/
+static inline uint64_t
+FlowHash(const struct flow_key *key)
+{
+	return FlowHashMix(GetRSSHashFast(key->saddr, key->daddr, 
+				key->sport, key->dport));
+}
+/*----------------------------------------------------------------------------*/
+/* takes the NIC's hash of a received packet once it agreed with ours on    */
+/* the first packets; a NIC set up with another key or fields never does   */
+static inline uint64_t
+FlowRxHash(struct flow_table *ft, const struct flow_key *key, uint32_t rxhash)
+{
+	uint32_t rss;
+
+	if (!rxhash || ft->rxhash_bad)
+		return FlowHash(key);
+	if (ft->rxhash_checked < FLOW_RXHASH_CHECKS) {
+		rss = GetRSSHashFast(key->saddr, key->daddr, key->sport, key->dport);
+		if (rss != rxhash) {
+			TRACE_INFO("NIC flow hash %08x differs from %08x, "
+					"hashing flows in software.\n", rxhash, rss);
+			ft->rxhash_bad = TRUE;
+			return FlowHashMix(rss);
+		}
+		ft->rxhash_checked++;
+	}
+
+	return FlowHashMix(rxhash);
+}
+/*----------------------------------------------------------------------------*/
+static inline uint8_t
+FlowTag(uint64_t h)
+{
+	uint8_t tag = h >> 56;
+
+	return tag ? tag : 1;
+}
+/*----------------------------------------------------------------------------*/
+/* the two buckets a flow may live in; never the same one */
+static inline void
+FlowBuckets(uint32_t mask, uint64_t h, uint32_t *b1, uint32_t *b2)
+{
+	*b1 = h & mask;
+	*b2 = (*b1 ^ (uint32_t)(h >> 32)) & mask;
+	if (*b2 == *b1)
+		*b2 = *b1 ^ 1;
+}
+/*----------------------------------------------------------------------------*/
+static inline int
+FlowKeyEqual(const struct flow_key *k1, const struct flow_key *k2)
+{
+	return (k1->saddr == k2->saddr && k1->daddr == k2->daddr && 
+			k1->sport == k2->sport && k1->dport == k2->dport);
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+FlowKeyOf(const tcp_stream *stream, struct flow_key *key)
+{
+	key->saddr = stream->saddr;
+	key->daddr = stream->daddr;
+	key->sport = stream->sport;
+	key->dport = stream->dport;
+}
+/*----------------------------------------------------------------------------*/
+static inline int
+FlowBucketFind(const struct flow_bucket *b, uint8_t tag, 
+		const struct flow_key *key)
+{
+	int i;
+
+	for (i = 0; i < FLOW_BUCKET_ENTRIES; i++) {
+		if (b->tag[i] == tag && FlowKeyEqual(&b->key[i], key))
+			return i;
+	}
+
+	return -1;
+}
+/*----------------------------------------------------------------------------*/
+static inline int
+FlowBucketFree(const struct flow_bucket *b)
+{
+	int i;
+
+	for (i = 0; i < FLOW_BUCKET_ENTRIES; i++) {
+		if (!b->tag[i])
+			return i;
+	}
+
+	return -1;
+}
+/*----------------------------------------------------------------------------*/
+/* the key and stream go in before the tag that makes the slot visible */
+static inline void
+FlowSlotSet(struct flow_bucket *b, int i, uint8_t tag, 
+		const struct flow_key *key, tcp_stream *stream)
+{
+	b->tag[i] = 0;
+	FlowBarrier();
+	b->key[i] = *key;
+	b->stream[i] = stream;
+	FlowBarrier();
+	b->tag[i] = tag;
+}
+/*----------------------------------------------------------------------------*/
+static struct flow_bucket *
+FlowBucketsAlloc(uint32_t n)
+{
+	void *p;
+
+	if (posix_memalign(&p, sizeof(struct flow_bucket), 
+			n * sizeof(struct flow_bucket)))
+		return NULL;
+	memset(p, 0, n * sizeof(struct flow_bucket));
+
+	return (struct flow_bucket *)p;
+}
+/*----------------------------------------------------------------------------*/
+struct flow_table *
+CreateFlowTable(void)
+{
+	struct flow_table *ft = calloc(1, sizeof(struct flow_table));
+	if (!ft) {
+		TRACE_ERROR("calloc: CreateFlowTable");
+		return NULL;
+	}
+
+	ft->buckets = FlowBucketsAlloc(FLOW_TABLE_INIT_BUCKETS);
+	if (!ft->buckets) {
+		TRACE_ERROR("calloc: CreateFlowTable buckets!\n");
+		free(ft);
+		return NULL;
+	}
+	ft->mask = FLOW_TABLE_INIT_BUCKETS - 1;
+
+	return ft;
+}
+/*----------------------------------------------------------------------------*/
+void
+DestroyFlowTable(struct flow_table *ft)
+{
+	free(ft->buckets);
+	free(ft);
+}
+/*----------------------------------------------------------------------------*/
+/* makes room in bucket b1 or b2 by moving flows to their other bucket and  */
+/* returns the bucket and slot freed, or -1. The moves are planned first    */
+/* and done from the far end, each copying a flow before its old slot is    */
+/* reused, so a concurrent lookup always finds every flow somewhere         */
+/*----------------------------------------------------------------------------*/
+static int
+FlowCuckoo(struct flow_table *ft, uint32_t b1, uint32_t b2, int *slot)
+{
+	struct flow_bucket *buckets = ft->buckets;
+	uint32_t path_b[FLOW_CUCKOO_DEPTH + 1];
+	int path_s[FLOW_CUCKOO_DEPTH + 1];
+	uint32_t cur, alt, a1, a2;
+	struct flow_bucket *from, *to;
+	int d, i, v, free_slot;
+
+	cur = (ft->kick & 1) ? b2 : b1;
+	for (d = 0; d < FLOW_CUCKOO_DEPTH; d++) {
+		v = ft->kick++ % FLOW_BUCKET_ENTRIES;
+		for (i = 0; i < d; i++) {
+			/* a cycle: the moves would overwrite each other */
+			if (path_b[i] == cur && path_s[i] == v)
+				return -1;
+		}
+		path_b[d] = cur;
+		path_s[d] = v;
+
+		FlowBuckets(ft->mask, FlowHash(&buckets[cur].key[v]), &a1, &a2);
+		alt = (a1 == cur) ? a2 : a1;
+		free_slot = FlowBucketFree(&buckets[alt]);
+		if (free_slot < 0) {
+			cur = alt;
+			continue;
+		}
+
+		/* found a hole at the end of the path, move everything along */
+		path_b[d + 1] = alt;
+		path_s[d + 1] = free_slot;
+		for (i = d; i >= 0; i--) {
+			from = &buckets[path_b[i]];
+			to = &buckets[path_b[i + 1]];
+			FlowSlotSet(to, path_s[i + 1], from->tag[path_s[i]], 
+					&from->key[path_s[i]], from->stream[path_s[i]]);
+		}
+		*slot = path_s[0];
+		return path_b[0];
+	}
+
+	return -1;
+}
+/*----------------------------------------------------------------------------*/
+static int
+FlowTableAdd(struct flow_table *ft, const struct flow_key *key, 
+		tcp_stream *stream)
+{
+	uint64_t h = FlowHash(key);
+	uint8_t tag = FlowTag(h);
+	uint32_t b1, b2;
+	int b, i;
+
+	FlowBuckets(ft->mask, h, &b1, &b2);
+
+	if ((i = FlowBucketFree(&ft->buckets[b1])) >= 0) {
+		b = b1;
+	} else if ((i = FlowBucketFree(&ft->buckets[b2])) >= 0) {
+		b = b2;
+	} else if ((b = FlowCuckoo(ft, b1, b2, &i)) < 0) {
+		return -1;
+	}
+
+	FlowSlotSet(&ft->buckets[b], i, tag, key, stream);
+	ft->cnt++;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int
+FlowTableInsert(struct flow_table *ft, tcp_stream *stream)
+{
+	struct flow_key key;
+
+	FlowKeyOf(stream, &key);
+
+	if (FlowTableAdd(ft, &key, stream) < 0) {
+		/* no cuckoo path, keep it aside until the table has grown */
+		ft->need_grow = TRUE;
+		if (ft->stash_cnt == FLOW_STASH_SIZE)
+			return -1;
+		ft->stash_key[ft->stash_cnt] = key;
+		ft->stash[ft->stash_cnt] = stream;
+		FlowBarrier();
+		ft->stash_cnt++;
+		ft->cnt++;
+	}
+	if (ft->cnt > FLOW_TABLE_LOAD(ft))
+		ft->need_grow = TRUE;
+
+	stream->ht_idx = TCP_AR_CNT;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+void
+FlowTableRemove(struct flow_table *ft, tcp_stream *stream)
+{
+	struct flow_key key;
+	uint64_t h;
+	uint8_t tag;
+	uint32_t b1, b2;
+	int i;
+
+	FlowKeyOf(stream, &key);
+	h = FlowHash(&key);
+	tag = FlowTag(h);
+	FlowBuckets(ft->mask, h, &b1, &b2);
+
+	if ((i = FlowBucketFind(&ft->buckets[b1], tag, &key)) >= 0 && 
+			ft->buckets[b1].stream[i] == stream) {
+		ft->buckets[b1].tag[i] = 0;
+	} else if ((i = FlowBucketFind(&ft->buckets[b2], tag, &key)) >= 0 && 
+			ft->buckets[b2].stream[i] == stream) {
+		ft->buckets[b2].tag[i] = 0;
+	} else {
+		for (i = 0; i < ft->stash_cnt; i++) {
+			if (ft->stash[i] == stream)
+				break;
+		}
+		if (i == ft->stash_cnt) {
+			TRACE_ERROR("Stream %d: not in the flow table.\n", stream->id);
+			return;
+		}
+		ft->stash_key[i] = ft->stash_key[ft->stash_cnt - 1];
+		ft->stash[i] = ft->stash[ft->stash_cnt - 1];
+		ft->stash_cnt--;
+	}
+	ft->cnt--;
+}
+/*----------------------------------------------------------------------------*/
+static inline tcp_stream *
+FlowTableFind(struct flow_table *ft, const struct flow_key *key, uint64_t h)
+{
+	uint8_t tag = FlowTag(h);
+	uint32_t b1, b2;
+	int i;
+
+	FlowBuckets(ft->mask, h, &b1, &b2);
+
+	if ((i = FlowBucketFind(&ft->buckets[b1], tag, key)) >= 0)
+		return ft->buckets[b1].stream[i];
+	if ((i = FlowBucketFind(&ft->buckets[b2], tag, key)) >= 0)
+		return ft->buckets[b2].stream[i];
+
+	for (i = 0; i < ft->stash_cnt; i++) {
+		if (FlowKeyEqual(&ft->stash_key[i], key))
+			return ft->stash[i];
+	}
+
+	return NULL;
+}
+/*----------------------------------------------------------------------------*/
+tcp_stream *
+FlowTableSearch(struct flow_table *ft, const struct flow_key *key, 
+		uint32_t rxhash)
+{
+	return FlowTableFind(ft, key, FlowRxHash(ft, key, rxhash));
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+FlowTablePrefetchHash(struct flow_table *ft, uint64_t h)
+{
+	uint32_t b1, b2;
+
+	FlowBuckets(ft->mask, h, &b1, &b2);
+	__builtin_prefetch(&ft->buckets[b1]);
+	__builtin_prefetch(&ft->buckets[b2]);
+}
+/*----------------------------------------------------------------------------*/
+void
+FlowTablePrefetch(struct flow_table *ft, const struct flow_key *key, 
+		uint32_t rxhash)
+{
+	FlowTablePrefetchHash(ft, FlowRxHash(ft, key, rxhash));
+}
+/*----------------------------------------------------------------------------*/
+void
+FlowTableSearchBurst(struct flow_table *ft, const struct flow_key *keys, 
+		const uint32_t *rxhashes, int n, tcp_stream **streams)
+{
+	uint64_t h[FLOW_PREFETCH_BATCH];
+	int i, j, cnt;
+
+	for (i = 0; i < n; i += FLOW_PREFETCH_BATCH) {
+		cnt = (n - i < FLOW_PREFETCH_BATCH) ? n - i : FLOW_PREFETCH_BATCH;
+		for (j = 0; j < cnt; j++) {
+			h[j] = FlowRxHash(ft, &keys[i + j], 
+					rxhashes ? rxhashes[i + j] : 0);
+			FlowTablePrefetchHash(ft, h[j]);
+		}
+		for (j = 0; j < cnt; j++)
+			streams[i + j] = FlowTableFind(ft, &keys[i + j], h[j]);
+	}
+}
+/*----------------------------------------------------------------------------*/
+int
+FlowTableGrow(struct flow_table *ft)
+{
+	struct flow_table nt;
+	struct flow_bucket *b;
+	uint32_t n, i;
+	int j;
+
+	if (!ft->need_grow)
+		return 0;
+
+	n = ft->mask + 1;
+	do {
+		n <<= 1;
+		memset(&nt, 0, sizeof(nt));
+		nt.buckets = FlowBucketsAlloc(n);
+		if (!nt.buckets) {
+			TRACE_ERROR("Failed to grow the flow table to %u buckets.\n", n);
+			return -1;
+		}
+		nt.mask = n - 1;
+		nt.kick = ft->kick;
+
+		for (i = 0; i <= ft->mask; i++) {
+			b = &ft->buckets[i];
+			for (j = 0; j < FLOW_BUCKET_ENTRIES; j++) {
+				if (b->tag[j] && FlowTableAdd(&nt, &b->key[j], b->stream[j]) < 0)
+					break;
+			}
+			if (j < FLOW_BUCKET_ENTRIES)
+				break;
+		}
+		for (j = 0; i > ft->mask && j < ft->stash_cnt; j++) {
+			if (FlowTableAdd(&nt, &ft->stash_key[j], ft->stash[j]) < 0)
+				break;
+		}
+		if (i > ft->mask && j == ft->stash_cnt)
+			break;
+		/* some flow found no place, try twice the size */
+		free(nt.buckets);
+	} while (1);
+
+	TRACE_INFO("Flow table grown to %u buckets for %u flows.\n", n, ft->cnt);
+	free(ft->buckets);
+	ft->buckets = nt.buckets;
+	ft->mask = nt.mask;
+	ft->kick = nt.kick;
+	ft->stash_cnt = 0;
+	ft->need_grow = FALSE;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
 unsigned int
 HashListener(const void *l)
 {
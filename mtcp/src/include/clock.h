@@ -5,6 +5,46 @@
 #include <stdint.h>
 #include "tcp_stream.h"
 
+/*----------------------------------------------------------------------------*/
+/* mTCP's time base: nanoseconds since InitClock(), from the TSC when it is  */
+/* invariant (constant rate across P- and C-states), from CLOCK_MONOTONIC    */
+/* otherwise. The TSC rate is calibrated against CLOCK_MONOTONIC once.       */
+/*----------------------------------------------------------------------------*/
+extern int clock_use_tsc;
+extern uint64_t clock_tsc_base;
+extern uint64_t clock_tsc_mult;		/* nanoseconds per TSC cycle << 32 */
+extern uint64_t clock_mono_base;
+
+/* before the mTCP threads start */
+void InitClock(void);
+
+static inline uint64_t
+ReadTSC(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+
+	__asm__ volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+	return 0;
+#endif
+}
+
+static inline uint64_t
+NowNsec(void)
+{
+	struct timespec now;
+
+	if (clock_use_tsc)
+		return (uint64_t)(((unsigned __int128)(ReadTSC() - clock_tsc_base) * 
+					clock_tsc_mult) >> 32);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - clock_mono_base;
+}
+/*----------------------------------------------------------------------------*/
+
 uint64_t now_usecs();
 uint64_t time_since_usecs();
 uint64_t time_after_usecs();
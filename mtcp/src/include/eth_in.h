@@ -5,6 +5,6 @@
 
 int
 ProcessPacket(mtcp_manager_t mtcp, const int ifidx, 
-		uint32_t cur_ts, unsigned char *pkt_data, int len);
+		uint32_t cur_ts, unsigned char *pkt_data, int len, uint32_t rxhash);
 
 #endif /* ETH_IN_H */
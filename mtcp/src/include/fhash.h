@@ -40,6 +40,66 @@ struct hashtable *CreateHashtable(unsigned int (*hashfn) (const void *),
 void DestroyHashtable(struct hashtable *ht);
 
 
+/*----------------------------------------------------------------------------*/
+/* the per-core TCP flow table: bucketized cuckoo hashing with two candidate */
+/* buckets per flow. A bucket is one cache line holding the 4-tuples and    */
+/* 8-bit hash tags inline, so a lookup touches at most two lines and no     */
+/* stream. Writers (CreateTCPStream, DestroyTCPStream) hold flow_pool_lock  */
+/* and may run on the application thread; the table only grows on the     */
+/* mTCP thread, the one reader, in FlowTableGrow().                          */
+/* Flows are placed by the Toeplitz hash the NIC computes for RSS. Received */
+/* packets bring it along (rxhash); 0 makes the table compute it itself.    */
+#define FLOW_BUCKET_ENTRIES	3
+#define FLOW_TABLE_INIT_BUCKETS	(4096)	/* 12 K flows before the first growth */
+#define FLOW_STASH_SIZE		(16)	/* flows no cuckoo path was found for */
+#define FLOW_PREFETCH_BATCH	(16)	/* packets prefetched ahead in RX */
+#define FLOW_RXHASH_CHECKS	(64)	/* NIC hashes compared to our own */
+
+struct flow_key {
+	uint32_t saddr;		/* as in tcp_stream: local, network order */
+	uint32_t daddr;
+	uint16_t sport;
+	uint16_t dport;
+};
+
+struct flow_bucket {
+	uint8_t tag[FLOW_BUCKET_ENTRIES];	/* 0: slot is free */
+	uint8_t pad;
+	struct flow_key key[FLOW_BUCKET_ENTRIES];
+	tcp_stream *stream[FLOW_BUCKET_ENTRIES];
+} __attribute__((aligned(64)));
+
+struct flow_table {
+	struct flow_bucket *buckets;
+	uint32_t mask;			/* number of buckets - 1 */
+	uint32_t cnt;
+	uint32_t kick;			/* picks the next cuckoo victim */
+	uint8_t need_grow;
+	uint8_t rxhash_bad;		/* the NIC hashes differently, ignore it */
+	uint32_t rxhash_checked;
+
+	int stash_cnt;
+	struct flow_key stash_key[FLOW_STASH_SIZE];
+	tcp_stream *stash[FLOW_STASH_SIZE];
+};
+
+struct flow_table *CreateFlowTable(void);
+void DestroyFlowTable(struct flow_table *ft);
+int FlowTableInsert(struct flow_table *ft, tcp_stream *stream);
+void FlowTableRemove(struct flow_table *ft, tcp_stream *stream);
+tcp_stream *FlowTableSearch(struct flow_table *ft, const struct flow_key *key, 
+			    uint32_t rxhash);
+/* resolves n flows at once, fetching all their buckets before the first */
+/* compare; streams[i] is NULL for a miss. rxhashes may be NULL          */
+void FlowTableSearchBurst(struct flow_table *ft, const struct flow_key *keys, 
+			  const uint32_t *rxhashes, int n, tcp_stream **streams);
+/* starts loading the buckets of a flow that is looked up soon */
+void FlowTablePrefetch(struct flow_table *ft, const struct flow_key *key, 
+		       uint32_t rxhash);
+/* doubles the table once it got too full; mTCP thread, with flow_pool_lock */
+int FlowTableGrow(struct flow_table *ft);
+/*----------------------------------------------------------------------------*/
+
 int StreamHTInsert(struct hashtable *ht, void *);
 void* StreamHTRemove(struct hashtable *ht, void *);
 void *StreamHTSearch(struct hashtable *ht, const void *);
@@ -40,7 +40,9 @@ struct mtcp_thread_context;
  *				      Returns 0 on success; -1 on failure
  *
  *		   get_rptr()	    : retrieve next pkt for application for
- *				      packet read.
+ *				      packet read. Also hands up the NIC's
+ *				      RSS hash of the pkt in rxhash, or 0
+ *				      if the driver has none.
  *				      Returns ptr to pkt buffer.
  *			       
  *		   recv_pkts()	    : recieve batch of packets from the interface, 
@@ -64,7 +66,7 @@ typedef struct io_module_func {
 	void      (*release_pkt)(struct mtcp_thread_context *ctx, int ifidx, unsigned char *pkt_data, int len);
 	uint8_t * (*get_wptr)(struct mtcp_thread_context *ctx, int ifidx, uint16_t len);
 	int32_t   (*send_pkts)(struct mtcp_thread_context *ctx, int nif);
-	uint8_t * (*get_rptr)(struct mtcp_thread_context *ctx, int ifidx, int index, uint16_t *len);
+	uint8_t * (*get_rptr)(struct mtcp_thread_context *ctx, int ifidx, int index, uint16_t *len, uint32_t *rxhash);
 	int32_t   (*recv_pkts)(struct mtcp_thread_context *ctx, int ifidx);
 	int32_t	  (*select)(struct mtcp_thread_context *ctx);
 	void	  (*destroy_handle)(struct mtcp_thread_context *ctx);
@@ -5,6 +5,7 @@
 
 int
 ProcessIPv4Packet(mtcp_manager_t mtcp, uint32_t cur_ts, 
-				  const int ifidx, unsigned char* pkt_data, int len);
+				  const int ifidx, unsigned char* pkt_data, int len, 
+				  uint32_t rxhash);
 
 #endif /* IP_IN_H */
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "tcp_stream.h"
+#include "mptcp_crypto.h"
 
 
 #define TCP_OPT_MPTCP 30 // You can choose an appropriate value not conflicting with existing TCP options
@@ -11,27 +12,281 @@
 #define TCP_MPTCP_SUBTYPE_CAPABLE 0
 #define TCP_MPTCP_SUBTYPE_JOIN 1
 #define TCP_MPTCP_SUBTYPE_DSS 2
+#define TCP_MPTCP_SUBTYPE_ADD_ADDR 3
+#define TCP_MPTCP_SUBTYPE_REMOVE_ADDR 4
+#define TCP_MPTCP_SUBTYPE_PRIO 5
+#define TCP_MPTCP_SUBTYPE_NONE 0x10 /* segment without an MPTCP option; past
+                                       the 4 bit subtypes of the wire */
+
+/* B flag in the subtype byte of MP_JOIN and MP_PRIO */
+#define MPTCP_FLAG_BACKUP       0x01
+/* E flag in the subtype byte of ADD_ADDR */
+#define MPTCP_FLAG_ECHO         0x01
+
+/* DSS flags */
+#define MPTCP_DSS_DATA_ACK      0x01
+#define MPTCP_DSS_DATA_ACK_8    0x02
+#define MPTCP_DSS_MAP           0x04
+#define MPTCP_DSS_DSN_8         0x08
+#define MPTCP_DSS_DATA_FIN      0x10
+
+/* MP_JOIN option lengths tell the three handshake segments apart */
+#define MPTCP_OPT_JOIN_SYN_LEN 12
+#define MPTCP_OPT_JOIN_ACK_LEN 24
 
 #define MPTCP_OPT_CAPABLE_SYN_LEN 12
 #define MPTCP_OPT_CAPABLE_SYNACK_LEN 12
 #define MPTCP_OPT_CAPABLE_ACK_LEN 20
 #define MPTCP_OPT_JOIN_SYNACK_LEN 16
 
+/* DSS with an 8 byte DATA_ACK, and with an 8 byte DSN mapping besides;
+   the mapping is padded with two NOPs, no checksum is sent */
+#define MPTCP_OPT_DSS_ACK_LEN 12
+#define MPTCP_OPT_DSS_MAP_LEN 26
+
+/* MP_PRIO without an address id, it applies to the subflow it is sent on;
+   padded with a NOP */
+#define MPTCP_OPT_PRIO_LEN 3
+
+/* IPv4 ADD_ADDR without a port: version 0 (RFC 6824) carries the IP
+   version in the low nibble and no HMAC and has no echo, version 1
+   (RFC 8684) adds the truncated HMAC and the E flag; REMOVE_ADDR of a
+   single address id */
+#if TCP_MPTCP_VERSION == 0
+#define MPTCP_OPT_ADD_ADDR_LEN 8
+#define MPTCP_ADD_ADDR_IPVER 4
+#else
+#define MPTCP_OPT_ADD_ADDR_LEN 16
+#endif
+#define MPTCP_OPT_ADD_ADDR_ECHO_LEN 8
+#define MPTCP_OPT_REMOVE_ADDR_LEN 4
+
+#define MPTCP_MAX_SUBFLOWS 32
+#define MPTCP_SUBFLOWS_INIT 4         /* set slots allocated with the first subflow */
+
+#define MPTCP_MAP_QUEUE_INIT 64       /* initial mapping slots per subflow */
+#define MPTCP_MAP_QUEUE_MAX 65536     /* slots a subflow queue may grow to */
+#define MPTCP_MAP_MAX_SEGS 8          /* segments one sent mapping may cover */
+
+/* who asked for a subflow to be a backup: our mptcp_backup interfaces, or
+   the peer with the B flag of MP_JOIN or MP_PRIO */
+#define MPTCP_BACKUP_LOCAL 0x01
+#define MPTCP_BACKUP_PEER 0x02
+
 typedef struct mptcp_cb mptcp_cb;
 
+/* subflow sequence ranges received out of order; subflow payload goes to
+   the meta receive buffer right away, so only the ranges are kept */
+#define MPTCP_MAX_OOO_RANGES 16
+struct mptcp_ooo_ranges
+{
+    uint32_t seq[MPTCP_MAX_OOO_RANGES];
+    uint32_t end[MPTCP_MAX_OOO_RANGES];
+    int cnt;
+};
+
+/* DSS mappings received on a subflow that still cover data at or past its
+   rcv_nxt; only the first segment of a mapping carries it */
+#define MPTCP_MAX_RCV_MAPS 16
+struct mptcp_rcv_maps
+{
+    uint32_t ssn[MPTCP_MAX_RCV_MAPS];
+    uint32_t dsn[MPTCP_MAX_RCV_MAPS];
+    uint16_t len[MPTCP_MAX_RCV_MAPS];
+    int cnt;
+};
+
+/* data sequence ranges to send again on another subflow, in DSN order;
+   filled when a subflow times out or dies, or holds back a full window */
+#define MPTCP_MAX_REINJECT_RANGES 8
+struct mptcp_reinject_queue
+{
+    uint32_t seq[MPTCP_MAX_REINJECT_RANGES];
+    uint32_t end[MPTCP_MAX_REINJECT_RANGES];
+    uint8_t from[MPTCP_MAX_REINJECT_RANGES];    /* id of the subflow it was stuck on */
+    int cnt;
+};
+
+/* DSS mapping of subflow bytes onto the data sequence space; the payload
+   itself stays in the meta send buffer until it is DATA_ACKed */
+struct mptcp_dss_map
+{
+    uint32_t ssn;       /* subflow sequence number of the first byte */
+    uint32_t dsn;       /* data sequence number of the first byte */
+    uint32_t len;
+};
+
+/* outstanding mappings of a subflow, a ring kept in ssn order so that
+   lookups are a binary search; used instead of a per-subflow send buffer */
+struct mptcp_map_queue
+{
+    struct mptcp_dss_map *maps;
+    uint32_t size;      /* ring slots, a power of two */
+    uint32_t head;      /* index of the oldest mapping */
+    uint32_t cnt;
+    uint32_t head_seq;  /* first unacknowledged subflow sequence number */
+    uint32_t len;       /* mapped bytes not yet acknowledged on the subflow */
+};
+
+/* packet scheduler, picked per socket with MTCP_MPTCP_SCHEDULER */
+struct mptcp_sched_ops
+{
+    const char *name;
+    /* fills subflows[] with the subflow(s) that should carry the next
+       mapping and returns how many were picked, 0 if none has room */
+    int (*get_subflows)(mptcp_cb *mpcb, struct tcp_stream **subflows, int max);
+};
+
+/* coupled congestion control, picked with "mptcp_cc" in the mtcp config */
+enum mptcp_cc_algo
+{
+    MPTCP_CC_RENO,      /* uncoupled, every subflow on its own */
+    MPTCP_CC_LIA,       /* RFC 6356 linked increases (default) */
+    MPTCP_CC_OLIA,      /* opportunistic linked increases */
+    MPTCP_CC_BALIA,     /* balanced linked adaptation */
+    MPTCP_CC_NUM
+};
+
+/* path manager, picked with "mptcp_pm" in the mtcp config */
+enum mptcp_pm_mode
+{
+    MPTCP_PM_NONE,          /* only the initial subflow */
+    MPTCP_PM_FULLMESH,      /* one subflow from every local interface (default) */
+    MPTCP_PM_NDIFFPORTS,    /* mptcp_ndiffports subflows over the initial path */
+    MPTCP_PM_NUM
+};
+
+#define MPTCP_PM_MAX_PATHS 8          /* extra paths besides the initial one */
+#define MPTCP_PM_MAX_ADDRS 8          /* addresses known per end of a connection */
+
+/* a path the path manager keeps a subflow open on; the initial subflow's
+   path is not tracked, the connection lives and dies with it */
+struct mptcp_path
+{
+    uint32_t saddr;                 /* local address, network order */
+    uint32_t daddr;                 /* peer address, network order */
+    uint16_t dport;                 /* network order */
+    uint8_t rem_id;                 /* address id of daddr */
+    struct tcp_stream *stream;      /* current subflow, NULL while down */
+    uint8_t retries;                /* failed opens since it was last up */
+    uint32_t retry_ts;              /* when to open it again */
+};
+
+/* an address of one end of the connection by its address id; id 0 is the
+   address of the initial subflow. local ids of the other interfaces are
+   their index in CONFIG.eths plus one */
+struct mptcp_addr
+{
+    uint32_t addr;          /* network order */
+    uint16_t port;          /* network order */
+    uint8_t id;
+    uint8_t flags;          /* MPTCP_ADDR_* */
+    uint8_t tries;          /* ADD_ADDRs sent without an echo */
+    uint32_t ts;            /* when the last one went out */
+};
+
+#define MPTCP_ADDR_ANNOUNCE 0x01    /* local: ADD_ADDR not echoed yet */
+#define MPTCP_ADDR_REMOVE   0x02    /* local: REMOVE_ADDR still to be sent */
+#define MPTCP_ADDR_ECHO     0x04    /* remote: echo of its ADD_ADDR to be sent */
+
+struct mptcp_pm_vars
+{
+    struct mptcp_path paths[MPTCP_PM_MAX_PATHS];
+    uint8_t num_paths;
+    uint8_t active;         /* we opened the connection, so we open the joins */
+    uint8_t pending;        /* some path is down and waits for retry_ts */
+
+    struct mptcp_addr local[MPTCP_PM_MAX_ADDRS];
+    struct mptcp_addr remote[MPTCP_PM_MAX_ADDRS];
+    uint8_t num_local;
+    uint8_t num_remote;
+    uint8_t signal;         /* some address still has an option to send */
+};
+
+/* one member of a connection's subflow set. the set is a dense array so
+   the scheduler and the coupled congestion control walk contiguous memory;
+   removal moves the last member into the hole */
+struct mptcp_subflow
+{
+    struct tcp_stream *stream;
+    uint32_t srtt;      /* rcvvar->srtt when last refreshed */
+    uint32_t inflight;  /* unacknowledged subflow bytes when last refreshed */
+    uint8_t id;         /* join order, index into rr_weight[] */
+    uint8_t backup;     /* MPTCP_BACKUP_*: only scheduled while no regular
+                           subflow is up */
+    uint8_t stalled;    /* hit an RTO, nothing acked since */
+    uint8_t send_prio;  /* our MP_PRIO is still to be sent */
+    uint32_t penalized_ts;  /* cwnd last halved for holding back the window */
+
+    /* coupled congestion control terms, cached so an ACK only moves the
+       connection sums by its own change */
+    uint32_t l_cur;     /* OLIA: bytes acked since the last loss */
+    uint32_t l_prev;    /* OLIA: bytes acked between the last two */
+    double cwnd;        /* bytes */
+    double rate;        /* cwnd / srtt */
+    double lia;         /* cwnd / srtt^2 */
+    double best;        /* OLIA: l^2 / srtt */
+
+    /* statistics for MTCP_MPTCP_SUBFLOW_INFO */
+    uint64_t bytes_sched;       /* mapped onto this subflow */
+    uint64_t bytes_reinjected;  /* of those, reinjected from another one */
+};
+
+/* per-connection coupled congestion control sums; the leader of a term is
+   searched for again only when it shrinks or leaves */
+struct mptcp_cc_vars
+{
+    double tot_rate;                    /* sum of the members' rate */
+    uint8_t max_cwnd;                   /* member with the largest term */
+    uint8_t max_rate;
+    uint8_t max_lia;
+    uint8_t max_best;
+};
+
 struct mptcp_cb{
 
-    uint32_t my_idsn;
-    uint32_t peer_idsn;
+    uint64_t my_idsn;
+    uint64_t peer_idsn;
+    /* the meta stream runs on the low 32 bits of the data sequence space;
+       these are the full DSNs at its snd_una and rcv_nxt, the references
+       MPTCPExpandDSN() widens 32-bit values against */
+    uint64_t snd_una_dsn;
+    uint64_t rcv_nxt_dsn;
     uint64_t peerKey;
     uint64_t myKey;
+    uint32_t token;     /* ours, key of the per-core token table */
+    uint32_t peer_token;                /* sent in our MP_JOIN SYNs */
+    struct mptcp_hmac_key join_hmac;    /* keyed with myKey, peerKey */
+    struct mptcp_hmac_key peer_join_hmac;   /* peerKey, myKey: checks the
+                                               peer's MP_JOIN MACs */
     uint32_t ack_to_send;
     uint32_t seq_no_to_send;
     struct tcp_stream *mpcb_stream;
-    uint8_t isSentMPJoinSYN; /*This should ideally be an array for each of the additional tcp_streams, here only for 2nd tcp_stream*/
     uint8_t isDataFINReceived; //Haathim_TODO: initialize this to 0
-    struct tcp_stream *tcp_streams[10];
-    int num_streams;
+    struct tcp_stream *master;          /* subflow the app socket sits on */
+    struct mptcp_subflow *subflows;     /* the subflow set */
+    uint8_t num_subflows;
+    uint8_t max_subflows;               /* allocated slots */
+    uint8_t next_id;                    /* id of the next subflow to join */
+
+    /* scheduler state */
+    const struct mptcp_sched_ops *sched;
+    uint8_t rr_idx;                     /* round-robin position in the set */
+    uint8_t rr_quota;                   /* mappings left for rr_idx this round */
+    uint8_t rr_weight[MPTCP_MAX_SUBFLOWS];  /* by subflow id */
+    uint32_t sched_seq;                 /* socket's mptcp_sched_seq applied */
+
+    struct mptcp_cc_vars cc;
+    struct mptcp_pm_vars pm;
+    struct mptcp_reinject_queue reinject;
+
+    /* statistics for MTCP_MPTCP_INFO, kept over subflows that left */
+    uint64_t bytes_sched;
+    uint64_t bytes_reinjected;
+    uint32_t reinjections;
+    uint32_t info_ts;                   /* snapshot last published */
 };
 
+#define IS_MPCB_STREAM(s) ((s)->mptcp_cb && (s)->mptcp_cb->mpcb_stream == (s))
+
 #endif /* MPTCP_H */
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef MPTCP_CC_H
+#define MPTCP_CC_H
+
+#include "mtcp.h"
+#include "tcp_stream.h"
+#include "mptcp.h"
+
+/* subflows whose window is driven by the coupled algorithm */
+#define MPTCP_CC_COUPLED(s) \
+	((s)->mptcp_cb && !IS_MPCB_STREAM(s) && CONFIG.mptcp_cc != MPTCP_CC_RENO)
+
+/*----------------------------------------------------------------------------*/
+/* maps a config file name (reno, lia, olia, balia) to enum mptcp_cc_algo,   */
+/* -1 if unknown                                                             */
+int
+MPTCPCCGetAlgo(const char *name);
+/*----------------------------------------------------------------------------*/
+const char *
+MPTCPCCGetName(int algo);
+/*----------------------------------------------------------------------------*/
+/* refreshes the subflow's terms in the connection sums; called for every    */
+/* ACK of new data with the number of bytes it acknowledged                  */
+void
+MPTCPCCOnAck(tcp_stream *sf, uint32_t acked);
+/*----------------------------------------------------------------------------*/
+/* congestion avoidance: returns the subflow's new cwnd for packets acked    */
+uint32_t
+MPTCPCCCongAvoid(tcp_stream *sf, uint16_t packets);
+/*----------------------------------------------------------------------------*/
+/* loss on the subflow (fast retransmit or timeout): returns the ssthresh    */
+uint32_t
+MPTCPCCSsthresh(tcp_stream *sf);
+/*----------------------------------------------------------------------------*/
+/* drops set member idx out of the connection sums before the last member */
+/* is moved into its place                                                   */
+void
+MPTCPCCRemoveSubflow(mptcp_cb *mpcb, int idx);
+/*----------------------------------------------------------------------------*/
+
+#endif /* MPTCP_CC_H */
@@ -0,0 +1,64 @@
+#ifndef MPTCP_CRYPTO_H
+#define MPTCP_CRYPTO_H
+
+#include <stdint.h>
+
+#define MPTCP_SHA1_LEN		20
+#define MPTCP_SHA256_LEN	32
+#define MPTCP_HASH_BLOCK	64
+
+/*----------------------------------------------------------------------------*/
+/* running SHA-1 or SHA-256 state; lives on the stack or in mptcp_cb, the    */
+/* hashes never allocate                                                     */
+struct mptcp_hash_ctx
+{
+	uint32_t h[8];			/* SHA-1 uses the first five words */
+	uint64_t len;			/* bytes hashed so far */
+	uint8_t buf[MPTCP_HASH_BLOCK];
+	uint8_t sha256;
+};
+/*----------------------------------------------------------------------------*/
+/* HMAC key with the padded key blocks already run through the hash, so a   */
+/* MAC over a short message costs two compressions instead of four          */
+struct mptcp_hmac_key
+{
+	struct mptcp_hash_ctx inner;
+	struct mptcp_hash_ctx outer;
+};
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSha1(const void *msg, int len, uint8_t *digest);
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSha256(const void *msg, int len, uint8_t *digest);
+/*----------------------------------------------------------------------------*/
+/* sha256 selects HMAC-SHA256 (RFC 8684) instead of HMAC-SHA1 (RFC 6824)    */
+void
+MPTCPHmacInit(struct mptcp_hmac_key *hk, int sha256,
+		const void *key, int key_len);
+/*----------------------------------------------------------------------------*/
+/* digest takes MPTCP_SHA1_LEN or MPTCP_SHA256_LEN bytes                     */
+void
+MPTCPHmac(const struct mptcp_hmac_key *hk, const void *msg, int len,
+		uint8_t *digest);
+/*----------------------------------------------------------------------------*/
+/* token and IDSN of a 64-bit key from a single hash of the key in network  */
+/* order: the token is the most significant 32 bits, the IDSN the least     */
+/* significant 64                                                            */
+void
+MPTCPKeyHash(uint64_t key, uint32_t *token, uint64_t *idsn);
+/*----------------------------------------------------------------------------*/
+/* HMAC key of the MP_JOIN MACs we send, our key followed by the peer's;    */
+/* with the keys swapped it checks the MACs the peer sends                  */
+void
+MPTCPJoinHmacInit(struct mptcp_hmac_key *hk, uint64_t my_key, uint64_t peer_key);
+/*----------------------------------------------------------------------------*/
+/* truncated HMAC of an ADD_ADDR (RFC 8684): the rightmost 64 bits of the  */
+/* MAC over id, address and port, keyed with the sender's key first; addr  */
+/* and port in network order                                                 */
+uint64_t
+MPTCPAddAddrHmac(const struct mptcp_hmac_key *hk, uint8_t id, 
+		uint32_t addr, uint16_t port);
+/*----------------------------------------------------------------------------*/
+
+#endif /* MPTCP_CRYPTO_H */
@@ -0,0 +1,79 @@
+#ifndef MPTCP_HANDOFF_H
+#define MPTCP_HANDOFF_H
+
+#include <stdint.h>
+#include <linux/tcp.h>
+#include <netinet/ip.h>
+
+#include "mtcp.h"
+#include "tcp_util.h"
+#include "config.h"
+
+/* an MPTCP connection lives on the core its token maps to, so a core that */
+/* gets an MP_JOIN from RSS knows where to send it without asking anyone   */
+#define MPTCPTokenCore(token)	((token) % CONFIG.num_cores)
+
+#define MPTCP_HANDOFF_SLOTS 64		/* packets in flight from one core to another */
+#define MPTCP_HANDOFF_PKT_LEN 1536	/* IP packets handed over, at most */
+#define MPTCP_REDIRECT_BINS 256
+#define MPTCP_REDIRECT_WAYS 4		/* foreign subflows per bin */
+#define MPTCP_REDIRECT_IDLE SEC_TO_TS(60)	/* an unused entry may be taken */
+
+/*----------------------------------------------------------------------------*/
+struct mptcp_handoff_pkt
+{
+	uint16_t len;
+	uint8_t data[MPTCP_HANDOFF_PKT_LEN];
+};
+/*----------------------------------------------------------------------------*/
+/* single producer, single consumer ring of packets from one core to        */
+/* another, lock-free the way stream_queue is                                */
+struct mptcp_handoff_ring
+{
+	volatile uint32_t head;		/* next slot the consumer reads */
+	volatile uint32_t tail;		/* next slot the producer fills */
+	struct mptcp_handoff_pkt pkts[MPTCP_HANDOFF_SLOTS];
+};
+/*----------------------------------------------------------------------------*/
+/* a subflow that RSS brings to this core but whose connection lives on     */
+/* another core; addresses are as in the packets it arrives with           */
+struct mptcp_redirect
+{
+	uint32_t saddr;
+	uint32_t daddr;
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t used;
+	uint8_t core;
+	uint32_t ts;			/* last packet forwarded */
+};
+/*----------------------------------------------------------------------------*/
+struct mptcp_handoff
+{
+	/* rings[src] carries packets from core src to this one */
+	struct mptcp_handoff_ring *rings[MAX_CPUS];
+	struct mptcp_redirect redirect[MPTCP_REDIRECT_BINS][MPTCP_REDIRECT_WAYS];
+	int num_redirect;
+};
+/*----------------------------------------------------------------------------*/
+/* NULL on a single core, where there is nothing to hand over               */
+struct mptcp_handoff *
+MPTCPHandoffCreate(int cpu);
+/*----------------------------------------------------------------------------*/
+void
+MPTCPHandoffDestroy(struct mptcp_handoff *ho);
+/*----------------------------------------------------------------------------*/
+/* called for segments that match no local flow: an MP_JOIN SYN for a       */
+/* connection of another core, and the later segments of that subflow, go   */
+/* to that core. TRUE if the segment was taken                              */
+int
+MPTCPHandoffCheck(mtcp_manager_t mtcp, uint32_t cur_ts,
+		const struct iphdr *iph, int ip_len, const struct tcphdr *tcph,
+		const struct tcp_options *opts);
+/*----------------------------------------------------------------------------*/
+/* runs the segments other cores handed to this one through ProcessTCPPacket */
+void
+MPTCPHandoffPoll(mtcp_manager_t mtcp, uint32_t cur_ts);
+/*----------------------------------------------------------------------------*/
+
+#endif /* MPTCP_HANDOFF_H */
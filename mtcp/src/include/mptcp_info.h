@@ -0,0 +1,37 @@
+#ifndef MPTCP_INFO_H
+#define MPTCP_INFO_H
+
+#include <stdint.h>
+
+#include "mtcp.h"
+#include "mtcp_api.h"
+#include "mptcp.h"
+#include "socket.h"
+
+/*----------------------------------------------------------------------------*/
+/* what MTCP_MPTCP_INFO and MTCP_MPTCP_SUBFLOW_INFO return. The mTCP core   */
+/* writes it, the application reads it; seq is odd while a write is under   */
+/* way and the reader copies again until it sees the same even value twice */
+struct mptcp_info_snap
+{
+	volatile uint32_t seq;
+	struct mtcp_mptcp_info info;
+	struct mtcp_mptcp_subflow_info sf[MPTCP_MAX_SUBFLOWS];
+};
+/*----------------------------------------------------------------------------*/
+/* refreshes the snapshot of the socket the connection sits on, at most once */
+/* a tick unless force is set                                                */
+void
+MPTCPInfoPublish(mtcp_manager_t mtcp, mptcp_cb *mpcb, int force);
+/*----------------------------------------------------------------------------*/
+/* application side of mtcp_getsockopt(): copies the last snapshot; -1 with */
+/* errno set if there is none                                                */
+int
+MPTCPInfoGet(socket_map_t socket, struct mtcp_mptcp_info *info);
+/*----------------------------------------------------------------------------*/
+int
+MPTCPSubflowInfoGet(socket_map_t socket, 
+		struct mtcp_mptcp_subflow_info *sf, socklen_t *optlen);
+/*----------------------------------------------------------------------------*/
+
+#endif /* MPTCP_INFO_H */
@@ -0,0 +1,115 @@
+#ifndef MPTCP_MAP_H
+#define MPTCP_MAP_H
+
+#include "mtcp.h"
+#include "tcp_stream.h"
+#include "mptcp.h"
+#include "tcp_util.h"
+#include "tcp_ring_buffer.h"
+
+/*----------------------------------------------------------------------------*/
+struct mptcp_map_queue *
+MPTCPMapQueueCreate(uint32_t init_seq);
+/*----------------------------------------------------------------------------*/
+void
+MPTCPMapQueueDestroy(struct mptcp_map_queue *mq);
+/*----------------------------------------------------------------------------*/
+/* records that len bytes at subflow sequence ssn carry data from dsn; ssn  */
+/* must be the end of the queue. Every call makes a mapping of its own, sent */
+/* once in a DSS with the first segment. returns -1 if the queue can not grow */
+int
+MPTCPMapAdd(struct mptcp_map_queue *mq, uint32_t ssn, uint32_t dsn, uint32_t len);
+/*----------------------------------------------------------------------------*/
+/* finds the mapping covering ssn; fills the matching dsn and the number of   */
+/* mapped bytes left from ssn. returns -1 if ssn is not mapped                */
+int
+MPTCPMapLookup(struct mptcp_map_queue *mq, uint32_t ssn,
+		uint32_t *dsn, uint32_t *len);
+/*----------------------------------------------------------------------------*/
+/* drops len acknowledged bytes from the head of the queue                    */
+uint32_t
+MPTCPMapRemove(struct mptcp_map_queue *mq, uint32_t len);
+/*----------------------------------------------------------------------------*/
+/* the DSS of the segment at the subflow's snd_nxt: 1 if a mapping starts   */
+/* there, with its dsn and len filled, 0 if it is inside one, -1 if unmapped */
+int
+MPTCPMapGetDSS(tcp_stream *sf, uint32_t *dsn, uint32_t *len);
+/*----------------------------------------------------------------------------*/
+/* widens a 32-bit DSN to the 64-bit one closest to ref (RFC 8684, 3.3.1)    */
+static inline uint64_t
+MPTCPExpandDSN(uint64_t ref, uint32_t dsn)
+{
+	return ref + (int64_t)(int32_t)(dsn - (uint32_t)ref);
+}
+/*----------------------------------------------------------------------------*/
+/* processes the DATA_ACK carried by a segment received on a subflow; the    */
+/* segment's window is the peer's connection-level window from that DATA_ACK */
+void
+MPTCPProcessDataAck(mtcp_manager_t mtcp, tcp_stream *sf,
+		const struct tcp_options *opts, uint16_t window);
+/*----------------------------------------------------------------------------*/
+/* frees meta send buffer space that is DATA_ACKed and no longer referenced   */
+/* by any subflow mapping                                                     */
+void
+MPTCPReleaseMetaBuffer(mtcp_manager_t mtcp, mptcp_cb *mpcb);
+/*----------------------------------------------------------------------------*/
+/* free space of the connection-level receive buffer past the DATA_ACK; all  */
+/* subflows advertise it, so none can outrun data blocked on another's hole  */
+static inline uint32_t
+MPTCPRcvWindow(mptcp_cb *mpcb)
+{
+	struct tcp_recv_vars *rcvvar = mpcb->mpcb_stream->rcvvar;
+
+	if (!rcvvar->rcvbuf)
+		return rcvvar->rcv_wnd;
+
+	return rcvvar->rcvbuf->size - rcvvar->rcvbuf->merged_len;
+}
+/*----------------------------------------------------------------------------*/
+/* advances a subflow's rcv_nxt for len bytes received at seq and returns the */
+/* new value; out-of-order ranges are remembered until the hole is filled     */
+uint32_t
+MPTCPSubflowRcvAdvance(struct tcp_recv_vars *rcvvar, uint32_t rcv_nxt, 
+		uint32_t seq, uint32_t len);
+/*----------------------------------------------------------------------------*/
+/* remembers a mapping received on a subflow, ssn and dsn cut to 32 bits;    */
+/* returns -1 if it can not be kept                                           */
+int
+MPTCPRcvMapAdd(struct tcp_recv_vars *rcvvar, uint32_t rcv_nxt, 
+		uint32_t ssn, uint32_t dsn, uint16_t len);
+/*----------------------------------------------------------------------------*/
+/* finds the received mapping covering subflow sequence seq; fills its dsn   */
+/* and the mapped bytes left from seq. returns -1 if seq is not mapped        */
+int
+MPTCPRcvMapLookup(struct tcp_recv_vars *rcvvar, uint32_t seq, 
+		uint32_t *dsn, uint32_t *len);
+/*----------------------------------------------------------------------------*/
+/* queues [seq, end) of the data sequence space to be sent again on some    */
+/* subflow other than from; overlapping ranges are merged                     */
+void
+MPTCPReinjectAdd(mptcp_cb *mpcb, uint32_t seq, uint32_t end, uint8_t from);
+/*----------------------------------------------------------------------------*/
+/* oldest range still to reinject, trimmed to the DATA_ACK; -1 if none        */
+int
+MPTCPReinjectPeek(mptcp_cb *mpcb, uint32_t *dsn, uint32_t *len, uint8_t *from);
+/*----------------------------------------------------------------------------*/
+/* len bytes from the front of the oldest range went out again                */
+void
+MPTCPReinjectConsume(mptcp_cb *mpcb, uint32_t len);
+/*----------------------------------------------------------------------------*/
+/* queues everything the subflow has in flight for the other subflows, on an  */
+/* RTO or when it goes away, and wakes up the meta stream to send it          */
+void
+MPTCPReinjectSubflow(mtcp_manager_t mtcp, tcp_stream *sf);
+/*----------------------------------------------------------------------------*/
+/* called with the connection-level window full: the subflow holding its     */
+/* head gets its cwnd halved and the head is queued for another subflow.     */
+/* TRUE if something was queued                                               */
+int
+MPTCPOpportunisticReinject(mptcp_cb *mpcb, uint32_t cur_ts);
+/*----------------------------------------------------------------------------*/
+
+#define MPTCP_MAP_FULL(mq)	((mq)->cnt >= MPTCP_MAP_QUEUE_MAX)
+#define MPTCP_MAP_END(mq)	((mq)->head_seq + (mq)->len)
+
+#endif /* MPTCP_MAP_H */
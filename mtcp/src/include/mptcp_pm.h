@@ -0,0 +1,84 @@
+#ifndef MPTCP_PM_H
+#define MPTCP_PM_H
+
+#include "mtcp.h"
+#include "tcp_stream.h"
+#include "mptcp.h"
+#include "tcp_util.h"
+
+/*----------------------------------------------------------------------------*/
+/* maps a config file name (none, fullmesh, ndiffports) to enum             */
+/* mptcp_pm_mode, -1 if unknown                                              */
+int
+MPTCPPMGetMode(const char *name);
+/*----------------------------------------------------------------------------*/
+const char *
+MPTCPPMGetName(int mode);
+/*----------------------------------------------------------------------------*/
+/* TRUE if saddr (network order) is on an interface named by mptcp_backup   */
+int
+MPTCPPMIsBackupAddr(uint32_t saddr);
+/*----------------------------------------------------------------------------*/
+/* sets up the address tables once the initial subflow is up, and on the  */
+/* active side the paths, which the next MPTCPPMCheck opens; a passive     */
+/* fullmesh side announces its other addresses instead                     */
+void
+MPTCPPMInit(mptcp_cb *mpcb, tcp_stream *master, int active, uint32_t cur_ts);
+/*----------------------------------------------------------------------------*/
+/* address id of our address saddr: 0 for the initial subflow's, else its  */
+/* index in CONFIG.eths plus one                                             */
+uint8_t
+MPTCPPMLocalAddrId(mptcp_cb *mpcb, uint32_t saddr);
+/*----------------------------------------------------------------------------*/
+/* opens a subflow on every path that is down and due                        */
+void
+MPTCPPMOpenPaths(mtcp_manager_t mtcp, mptcp_cb *mpcb, uint32_t cur_ts);
+/*----------------------------------------------------------------------------*/
+/* the subflow is going away; its path is opened again after a backoff      */
+void
+MPTCPPMSubflowClosed(mtcp_manager_t mtcp, mptcp_cb *mpcb, tcp_stream *sf);
+/*----------------------------------------------------------------------------*/
+/* address options that ride along with DSS segments, see MPTCPPMGetSignal */
+enum mptcp_pm_signal
+{
+	MPTCP_SIG_NONE,
+	MPTCP_SIG_ADD_ADDR,
+	MPTCP_SIG_ADD_ADDR_ECHO,
+	MPTCP_SIG_REMOVE_ADDR,
+};
+/*----------------------------------------------------------------------------*/
+/* the next address option to send, copying its address into out; the     */
+/* tables count it as sent                                                   */
+int
+MPTCPPMGetSignal(mptcp_cb *mpcb, uint32_t cur_ts, struct mptcp_addr *out);
+/*----------------------------------------------------------------------------*/
+/* a received ADD_ADDR: an echo of ours, or a peer address to echo that     */
+/* the active side opens paths to once its HMAC checks out                  */
+void
+MPTCPPMAddAddr(mtcp_manager_t mtcp, mptcp_cb *mpcb, 
+		const struct tcp_options *opts, uint32_t cur_ts);
+/*----------------------------------------------------------------------------*/
+/* the peer removed address id: its paths are dropped and the subflows to  */
+/* it other than the initial one reset                                      */
+void
+MPTCPPMRemoveAddr(mtcp_manager_t mtcp, mptcp_cb *mpcb, uint8_t id);
+/*----------------------------------------------------------------------------*/
+/* our address saddr stopped working; a REMOVE_ADDR tells the peer          */
+void
+MPTCPPMWithdrawAddr(mptcp_cb *mpcb, uint32_t saddr);
+/*----------------------------------------------------------------------------*/
+/* the peer joined from daddr, which it calls address id                    */
+void
+MPTCPPMJoinAddr(mptcp_cb *mpcb, uint8_t id, uint32_t daddr);
+/*----------------------------------------------------------------------------*/
+/* called for incoming ACKs, so paths come back while the connection is in  */
+/* use; a flag test unless a path is waiting                                 */
+static inline void
+MPTCPPMCheck(mtcp_manager_t mtcp, mptcp_cb *mpcb, uint32_t cur_ts)
+{
+	if (mpcb->pm.pending)
+		MPTCPPMOpenPaths(mtcp, mpcb, cur_ts);
+}
+/*----------------------------------------------------------------------------*/
+
+#endif /* MPTCP_PM_H */
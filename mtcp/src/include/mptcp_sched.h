@@ -0,0 +1,71 @@
+#ifndef MPTCP_SCHED_H
+#define MPTCP_SCHED_H
+
+#include "mtcp.h"
+#include "tcp_stream.h"
+#include "mptcp.h"
+
+/* bytes the subflow can take from the meta buffer right now (0 if none) */
+uint32_t
+MPTCPSubflowSendSpace(tcp_stream *sf);
+
+/* lowest-RTT subflow with room that is not the one with subflow id from;  */
+/* reinjected data goes there regardless of the scheduler, backups only    */
+/* while the schedulers would use them too                                  */
+tcp_stream *
+MPTCPReinjectGetSubflow(mptcp_cb *mpcb, uint8_t from);
+
+/* the subflow hit an RTO: it gets no new data until an ACK moves its      */
+/* snd_una, and if it was the last regular subflow up the backups take     */
+/* over. TRUE if it was not stalled already                                 */
+int
+MPTCPSubflowStall(tcp_stream *sf);
+
+/* who (MPTCP_BACKUP_LOCAL or _PEER) marks the subflow a backup or takes   */
+/* that back                                                                */
+void
+MPTCPSubflowSetBackup(tcp_stream *sf, uint8_t who, int backup);
+
+int
+MPTCPSetScheduler(mptcp_cb *mpcb, int type);
+
+int
+MPTCPSetSchedWeights(mptcp_cb *mpcb, const uint8_t *weights, int num);
+
+/* keeps the compiler from moving the socket's scheduler fields past the  */
+/* updates of mptcp_sched_seq around them                                   */
+static inline void
+SchedMemoryBarrier(void)
+{
+	__asm__ volatile("" : : : "memory");
+}
+
+/* mTCP thread: takes over what mtcp_setsockopt() recorded in the socket   */
+/* since the last call                                                      */
+void
+MPTCPSchedSync(mptcp_cb *mpcb, socket_map_t socket);
+
+/* copies the subflow's RTT and bytes in flight into its set member, where */
+/* the scheduler reads them                                                 */
+static inline void
+MPTCPSubflowRefresh(tcp_stream *sf)
+{
+	struct mptcp_subflow *e;
+
+	if (!sf->mptcp_cb || sf->sndvar->mptcp_sf_idx == 0)
+		return;
+
+	e = &sf->mptcp_cb->subflows[sf->sndvar->mptcp_sf_idx - 1];
+	e->srtt = sf->rcvvar->srtt;
+	e->inflight = sf->snd_nxt - sf->sndvar->snd_una;
+}
+
+/* new data got acked on a stalled subflow: the path works again */
+static inline void
+MPTCPSubflowResume(tcp_stream *sf)
+{
+	if (sf->mptcp_cb && sf->sndvar->mptcp_sf_idx)
+		sf->mptcp_cb->subflows[sf->sndvar->mptcp_sf_idx - 1].stalled = FALSE;
+}
+
+#endif /* MPTCP_SCHED_H */
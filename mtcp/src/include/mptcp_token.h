@@ -0,0 +1,68 @@
+#ifndef MPTCP_TOKEN_H
+#define MPTCP_TOKEN_H
+
+#include "mtcp.h"
+#include "tcp_stream.h"
+#include "mptcp.h"
+
+/* tries before giving up on finding a key whose token is not in use */
+#define MPTCP_KEY_GEN_TRIES 16
+
+/*----------------------------------------------------------------------------*/
+struct mptcp_token_entry
+{
+	uint32_t token;
+	mptcp_cb *mpcb;			/* NULL if the slot is free */
+};
+/*----------------------------------------------------------------------------*/
+/* per-core open addressing table of local tokens, linear probing; slots are */
+/* refilled on removal so lookups never walk over tombstones                */
+struct mptcp_token_table
+{
+	struct mptcp_token_entry *ents;
+	uint32_t mask;			/* slots - 1, slots is a power of two */
+	uint32_t cnt;
+};
+/*----------------------------------------------------------------------------*/
+struct mptcp_token_table *
+MPTCPTokenTableCreate(int max_conns);
+/*----------------------------------------------------------------------------*/
+void
+MPTCPTokenTableDestroy(struct mptcp_token_table *tt);
+/*----------------------------------------------------------------------------*/
+mptcp_cb *
+MPTCPTokenLookup(struct mptcp_token_table *tt, uint32_t token);
+/*----------------------------------------------------------------------------*/
+/* registers mpcb under mpcb->token; -1 if the token is taken or no room    */
+int
+MPTCPTokenInsert(struct mptcp_token_table *tt, mptcp_cb *mpcb);
+/*----------------------------------------------------------------------------*/
+void
+MPTCPTokenRemove(struct mptcp_token_table *tt, mptcp_cb *mpcb);
+/*----------------------------------------------------------------------------*/
+/* allocates a control block with a fresh key whose token is unique on this */
+/* core, registered in the token table; NULL on failure                      */
+mptcp_cb *
+MPTCPCreateCB(mtcp_manager_t mtcp, int sched);
+/*----------------------------------------------------------------------------*/
+/* unregisters the token and frees the block along with its meta stream     */
+void
+MPTCPDestroyCB(mtcp_manager_t mtcp, mptcp_cb *mpcb);
+/*----------------------------------------------------------------------------*/
+/* records the peer's key along with its token, its IDSN and the MP_JOIN    */
+/* HMAC key, so the handshakes that follow do not hash again                 */
+void
+MPTCPSetPeerKey(mptcp_cb *mpcb, uint64_t key);
+/*----------------------------------------------------------------------------*/
+/* adds the subflow to mpcb's subflow set; the first one becomes the master */
+/* that carries the application socket. -1 if the set can not take it      */
+int
+MPTCPAttachSubflow(tcp_stream *sf, mptcp_cb *mpcb);
+/*----------------------------------------------------------------------------*/
+/* takes the subflow out of the set; the control block, its token and the  */
+/* meta stream go away with the last subflow                                */
+void
+MPTCPDetachSubflow(mtcp_manager_t mtcp, tcp_stream *sf);
+/*----------------------------------------------------------------------------*/
+
+#endif /* MPTCP_TOKEN_H */
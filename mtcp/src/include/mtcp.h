@@ -50,7 +50,7 @@
 #define ETH_NUM                         MAX_DEVICES
 
 #define TCP_OPT_TIMESTAMP_ENABLED       TRUE   // enabled for rtt measure
-#define TCP_OPT_SACK_ENABLED            TRUE   // only recv-side implemented
+#define TCP_OPT_SACK_ENABLED            TRUE   // RFC 2018 blocks, RFC 6675 recovery
 
 /* Only use rate limiting if using CCP */
 #if USE_CCP
@@ -112,17 +112,12 @@
 	     (var) = (tvar))
 #endif
 /*----------------------------------------------------------------------------*/
-struct mptcp_connections {
-    uint32_t token[10];
-    struct mptcp_cb* mptcp_cbs[10];
-    int num_connections;
-};
-/*----------------------------------------------------------------------------*/
 struct eth_table
 {
 	char dev_name[128];
 	int ifindex;
 	int stat_print;
+	int mptcp_backup;	/* subflows from this address are MPTCP backups */
 	unsigned char haddr[ETH_ALEN];
 	uint32_t netmask;
 //	unsigned char dst_haddr[ETH_ALEN];
@@ -185,6 +180,10 @@ struct mtcp_config
 	int tcp_timewait;
 	int tcp_timeout;
 
+	int mptcp_cc;			/* enum mptcp_cc_algo for MPTCP subflows */
+	int mptcp_pm;			/* enum mptcp_pm_mode */
+	int mptcp_ndiffports;		/* subflows per connection in ndiffports mode */
+
 	/* adding multi-process support */
 	uint8_t multi_process;
 	uint8_t multi_process_is_master;
@@ -222,9 +221,7 @@ struct mtcp_sender
 /*----------------------------------------------------------------------------*/
 struct mtcp_manager
 {
-	mem_pool_t flow_pool;		/* memory pool for tcp_stream */
-	mem_pool_t rv_pool;			/* memory pool for recv variables */
-	mem_pool_t sv_pool;			/* memory pool for send variables */
+	mem_pool_t flow_pool;		/* memory pool for tcp_stream_chunk */
 	mem_pool_t mv_pool;			/* memory pool for monitor variables */
 
 	//mem_pool_t socket_pool;
@@ -234,7 +231,7 @@ struct mtcp_manager
 	
 	rb_manager_t mptcp_rbm_rcv; /*rcvbuf manager for mptcp-level rcvbufs*/
 
-	struct hashtable *tcp_flow_table;
+	struct flow_table *tcp_flow_table;
 #if USE_CCP
 	struct hashtable *tcp_sid_table;
 #endif
@@ -261,7 +258,8 @@ struct mtcp_manager
 	uint32_t ts_last_event;
 
 	struct hashtable *listeners;
-	struct mptcp_connections mptcp_conns;
+	struct mptcp_token_table *mptcp_tokens;	/* local MPTCP tokens */
+	struct mptcp_handoff *mptcp_handoff;	/* subflows from other cores */
 
 	stream_queue_t connectq;				/* streams need to connect */
 	stream_queue_t sendq;				/* streams need to send data */
@@ -277,10 +275,8 @@ struct mtcp_manager
 	struct mtcp_sender *g_sender;
 	struct mtcp_sender *n_sender[ETH_NUM];
 
-	/* lists related to timeout */
-	struct rto_hashstore* rto_store;
-	TAILQ_HEAD (timewait_head, tcp_stream) timewait_list;
-	TAILQ_HEAD (timeout_head, tcp_stream) timeout_list;
+	/* timers: RTO, TIME_WAIT, connection timeout */
+	struct timer_wheel *timer_wheel;
 
 	int rto_list_cnt;
 	int timewait_list_cnt;
@@ -294,6 +290,7 @@ struct mtcp_manager
 #endif
 
 	uint32_t cur_ts;
+	uint32_t cur_tsval;			/* clock of the TCP timestamp option */
 
 	int wakeup_flag;
 	int is_sleeping;
@@ -40,6 +40,66 @@ struct mtcp_conf
 	int tcp_timeout;
 };
 
+/* MPTCP-level socket options for mtcp_setsockopt()/mtcp_getsockopt() */
+#ifndef SOL_MPTCP
+#define SOL_MPTCP		284
+#endif
+#define MTCP_MPTCP_SCHEDULER	1	/* int, one of enum mptcp_scheduler */
+#define MTCP_MPTCP_SCHED_WEIGHTS	2	/* uint8_t[], round-robin weight per subflow, in join order */
+#define MTCP_MPTCP_MAX_WEIGHTS	32	/* subflows of a connection */
+#define MTCP_MPTCP_INFO		3	/* struct mtcp_mptcp_info, get only */
+#define MTCP_MPTCP_SUBFLOW_INFO	4	/* struct mtcp_mptcp_subflow_info[], get only;
+					   *optlen gives the room and returns the bytes filled */
+
+/* MPTCP_INFO and the subflow table are snapshots the mTCP core refreshes at */
+/* most once a millisecond, so reading them never stalls the data path      */
+struct mtcp_mptcp_info
+{
+	uint32_t token;			/* ours, as in MP_JOIN */
+	uint8_t num_subflows;
+	uint8_t pad[3];
+	uint64_t snd_una;		/* data sequence numbers */
+	uint64_t rcv_nxt;
+	uint32_t sndbuf_len;		/* meta send buffer: bytes not yet DATA_ACKed */
+	uint32_t sndbuf_size;
+	uint32_t rcvbuf_len;		/* meta receive buffer: bytes not yet read */
+	uint32_t rcvbuf_size;
+	uint32_t reinject_queued;	/* bytes waiting to go out on another subflow */
+	uint32_t reinjections;		/* ranges sent again on another subflow */
+	uint64_t bytes_sched;		/* handed to subflows, reinjections included */
+	uint64_t bytes_reinjected;
+};
+
+struct mtcp_mptcp_subflow_info
+{
+	uint32_t saddr;			/* network byte order */
+	uint32_t daddr;
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t id;			/* join order */
+	uint8_t state;			/* TCP state, as in TCPStateToString() */
+	uint8_t backup;			/* MP_PRIO: 1 local, 2 peer, 3 both */
+	uint8_t stalled;		/* hit an RTO, nothing acked since */
+	uint32_t srtt_us;
+	uint32_t rttvar_us;
+	uint32_t rto_us;
+	uint32_t cwnd;			/* bytes */
+	uint32_t ssthresh;
+	uint32_t mss;
+	uint32_t inflight;		/* bytes sent, not yet acked on the subflow */
+	uint32_t retransmits;		/* RTOs in a row */
+	uint64_t bytes_sched;
+	uint64_t bytes_reinjected;
+};
+
+enum mptcp_scheduler
+{
+	MPTCP_SCHED_MINRTT,		/* lowest smoothed RTT with room in cwnd (default) */
+	MPTCP_SCHED_ROUNDROBIN,	/* weighted round-robin over available subflows */
+	MPTCP_SCHED_REDUNDANT,	/* every segment on every available subflow */
+	MPTCP_SCHED_NUM
+};
+
 typedef struct mtcp_context *mctx_t;
 
 int 
@@ -1,6 +1,7 @@
 #ifndef RSS_H
 #define RSS_H
 
+#include <stdint.h>
 #include <netinet/in.h>
 
 /* sip, dip, sp, dp: in network byte order */
@@ -8,4 +9,9 @@ int GetRSSCPUCore(in_addr_t sip, in_addr_t dip,
 		  in_port_t sp, in_port_t dp, int num_queues,
 		  uint8_t endian_check);
 
+/* the Toeplitz hash the NIC puts in the mbuf, with mTCP's symmetric */
+/* key: the same for both directions of a flow. In network order too */
+uint32_t GetRSSHashFast(in_addr_t sip, in_addr_t dip, 
+			in_port_t sp, in_port_t dp);
+
 #endif /* RSS_H */
@@ -16,6 +16,16 @@ struct socket_map
 	int id;
 	int socktype;
 	uint32_t opts;
+	uint8_t mptcp_sched;	/* scheduler for MPTCP connections on this socket */
+	uint8_t mptcp_weight_num;
+	uint8_t mptcp_weight[MTCP_MPTCP_MAX_WEIGHTS];	/* round-robin weights */
+	volatile uint32_t mptcp_sched_seq;	/* mtcp_setsockopt() bumps it, odd
+						   while it writes the two above;
+						   the mTCP thread applies them
+						   (MPTCPSchedSync()) */
+	struct mptcp_info_snap *mptcp_info;	/* allocated with the first MPTCP
+						   connection, kept for reuse and
+						   emptied by AllocateSocket() */
 
 	struct sockaddr_in saddr;
 
@@ -26,11 +26,24 @@
 #define TCP_OPT_FLAG_SACK_PERMIT	0x08	// 0000 1000
 #define TCP_OPT_FLAG_SACK			0x10	// 0001 0000
 #define TCP_OPT_FLAG_TIMESTAMP		0x20	// 0010 0000	
+#define TCP_OPT_FLAG_MP_CAPABLE		0x0040
+#define TCP_OPT_FLAG_MP_JOIN		0x0080
+#define TCP_OPT_FLAG_DATA_ACK		0x0100
+#define TCP_OPT_FLAG_DSS_MAP		0x0200
+#define TCP_OPT_FLAG_DATA_FIN		0x0400
+#define TCP_OPT_FLAG_ADD_ADDR		0x0800
+#define TCP_OPT_FLAG_DATA_ACK_8		0x1000
+#define TCP_OPT_FLAG_DSN_8			0x2000
+#define TCP_OPT_FLAG_MP_PRIO		0x4000
+#define TCP_OPT_FLAG_REMOVE_ADDR	0x8000
 
 #define TCP_OPT_MSS_LEN			4
 #define TCP_OPT_WSCALE_LEN		3
 #define TCP_OPT_SACK_PERMIT_LEN	2
 #define TCP_OPT_SACK_LEN		10
+#define TCP_OPT_SACK_BLOCK_LEN	8
+#define TCP_MAX_SACK_BLOCKS		4
+#define TCP_MAX_OPT_LEN			40
 #define TCP_OPT_TIMESTAMP_LEN	10
 
 #define TCP_DEFAULT_MSS			1460
@@ -43,11 +56,14 @@
 #define TCP_SEQ_GEQ(a,b)		((int32_t)((a)-(b)) >= 0)
 #define TCP_SEQ_BETWEEN(a,b,c)	(TCP_SEQ_GEQ(a,b) && TCP_SEQ_LEQ(a,c))
 
-/* convert timeval to timestamp (precision: 1 ms) */
-#define HZ						1000
+/* convert timeval to timestamp (precision: 1 us) */
+#define HZ						1000000
 #define TIME_TICK				(1000000/HZ)		// in us
 #define TIMEVAL_TO_TS(t)		(uint32_t)((t)->tv_sec * HZ + \
 								((t)->tv_usec / TIME_TICK))
+#define NSEC_TO_TS(t)			((uint32_t)((t) / (1000000000 / HZ)))
+/* TSval on the wire keeps a 1 ms clock, as RFC 7323 asks of it */
+#define NSEC_TO_TSVAL(t)		((uint32_t)((t) / 1000000))
 
 #define TS_TO_USEC(t)			((t) * TIME_TICK)
 #define TS_TO_MSEC(t)			(TS_TO_USEC(t) / 1000)
@@ -57,6 +73,8 @@
 #define SEC_TO_TS(t)			(t * HZ)
 
 #define SEC_TO_USEC(t)			((t) * 1000000)
+/* longest timeout the 32-bit TS clock compares safely (wraps in ~71 min) */
+#define TS_MAX_SEC				1800
 #define SEC_TO_MSEC(t)			((t) * 1000)
 #define MSEC_TO_USEC(t)			((t) * 1000)
 #define USEC_TO_SEC(t)			((t) / 1000000)
@@ -69,6 +87,7 @@
 #define TCP_MAX_RTX				16
 #define TCP_MAX_SYN_RETRY		7
 #define TCP_MAX_BACKOFF			7
+#define TCP_DUPTHRESH			3
 
 #define TCP_INIT_CWND                   2
 
@@ -111,18 +130,15 @@ enum tcp_close_reason
 	TCP_TIMEDOUT		= 8
 };
 
-void 
-ParseTCPOptions(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len);
-
 extern inline int 
 ProcessTCPUplink(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream, 
 		const struct tcphdr *tcph, uint32_t seq, uint32_t ack_seq, 
 		uint8_t *payload, int payloadlen, uint32_t window);
 
+/* rxhash: the NIC's RSS hash of the packet, 0 if there is none */
 int
 ProcessTCPPacket(struct mtcp_manager *mtcp, uint32_t cur_ts, const int ifidx,
-					const struct iphdr* iph, int ip_len);
+					const struct iphdr* iph, int ip_len, uint32_t rxhash);
 uint16_t 
 TCPCalcChecksum(uint16_t *buf, uint16_t len, uint32_t saddr, uint32_t daddr);
 
@@ -3,6 +3,7 @@
 
 #include "mtcp.h"
 #include "tcp_stream.h"
+#include "tcp_in.h"
 
 enum ack_opt
 {
@@ -53,6 +54,19 @@ extern inline void
 EnqueueACK(mtcp_manager_t mtcp, 
 		tcp_stream *cur_stream, uint32_t cur_ts, uint8_t opt);
 
+/* Karn's rule: call before snd_nxt goes back for a retransmission. The   */
+/* timed segment may be sent again, and nothing sent before the old snd_nxt */
+/* is timed                                                                   */
+static inline void
+CancelRTTSample(tcp_stream *cur_stream)
+{
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+
+	sndvar->rtt_timing = FALSE;
+	if (TCP_SEQ_GT(cur_stream->snd_nxt, sndvar->rtt_end))
+		sndvar->rtt_end = cur_stream->snd_nxt;
+}
+
 extern inline void 
 DumpControlList(mtcp_manager_t mtcp, struct mtcp_sender *sender);
 
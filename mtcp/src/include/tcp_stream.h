@@ -33,28 +33,30 @@ struct sack_entry
 {
 	uint32_t left_edge;
 	uint32_t right_edge;
-	uint32_t expire;
 };
 #endif /* TCP_OPT_SACK_ENABLED */
 
+/* 
+ * A stream and its send and receive variables share one flow_pool chunk
+ * (struct tcp_stream_chunk). What ProcessACK(), FlushTCPSendingBuffer()
+ * and SendTCPPacket() touch is packed into the last cache line of
+ * tcp_stream and the first two of tcp_send_vars, which follow each other,
+ * and into the first line of tcp_recv_vars. The layout checks at the top
+ * of tcp_stream.c fail the build when a field leaves its line.
+ */
 struct tcp_recv_vars
 {
-	/* receiver variables */
+	/* hot: RTT, window and duplicate ACK tracking (first cache line) */
 	uint32_t rcv_wnd;		/* receive window (unscaled) */
 	//uint32_t rcv_up;		/* receive urgent pointer */
-	uint32_t irs;			/* initial receiving sequence */
 	uint32_t snd_wl1;		/* segment seq number for last window update */
 	uint32_t snd_wl2;		/* segment ack number for last window update */
-
-	/* variables for fast retransmission */
-	uint8_t dup_acks;		/* number of duplicated acks */
 	uint32_t last_ack_seq;	/* highest ackd seq */
-	
+
 	/* timestamps */
 	uint32_t ts_recent;			/* recent peer timestamp */
 	uint32_t ts_lastack_rcvd;	/* last ack rcvd time */
 	uint32_t ts_last_ts_upd;	/* last peer ts update time */
-	uint32_t ts_tw_expire;	// timestamp for timewait expire
 
 	/* RTT estimation variables */
 	uint32_t srtt;			/* smoothed round trip time << 3 (scaled) */
@@ -63,14 +65,28 @@ struct tcp_recv_vars
 	uint32_t rttvar;		/* smoothed mdev_max */
 	uint32_t rtt_seq;		/* sequence number to update rttvar */
 
-#if TCP_OPT_SACK_ENABLED		/* currently not used */
-#define MAX_SACK_ENTRY 8
+	struct tcp_ring_buffer *rcvbuf;
+
+	/* variables for fast retransmission */
+	uint8_t dup_acks;		/* number of duplicated acks */
+
+	/* cold */
+	uint32_t irs;			/* initial receiving sequence */
+	uint32_t ts_tw_expire;	// timestamp for timewait expire
+
+#if TCP_OPT_SACK_ENABLED
+	/* SACK scoreboard of what we sent: the blocks the peer reported above */
+	/* snd_una, merged and sorted by sequence (see tcp_util.c)              */
+#define MAX_SACK_ENTRY 16
 	uint32_t sacked_pkts;
+	uint32_t sacked_bytes;		/* bytes covered by sack_table */
 	struct sack_entry sack_table[MAX_SACK_ENTRY];
-	uint8_t sacks:3;
+	uint8_t sacks;				/* entries in sack_table */
+	uint32_t sack_recent;		/* last out-of-order segment we received */
 #endif /* TCP_OPT_SACK_ENABLED */
 
-	struct tcp_ring_buffer *rcvbuf;
+	struct mptcp_ooo_ranges *mptcp_ooo;	/* MPTCP subflows: out-of-order seq ranges */
+	struct mptcp_rcv_maps *mptcp_maps;	/* MPTCP subflows: received DSS mappings */
 #if USE_SPIN_LOCK
 	pthread_spinlock_t read_lock;
 #else
@@ -85,20 +101,27 @@ struct tcp_recv_vars
 #endif
 };
 
-struct tcp_send_vars
+/* an entry of the per-core timing wheel (timer.h) */
+enum tcp_timer_type
 {
-	/* IP-level information */
-	uint16_t ip_id;
-
-	uint16_t mss;			/* maximum segment size */
-	uint16_t eff_mss;		/* effective segment size (excluding tcp option) */
+	TCP_TIMER_RTO, 			/* retransmission */
+	TCP_TIMER_TIMEWAIT, 	/* 2MSL, shares the RTO timer */
+	TCP_TIMER_IDLE, 		/* connection timeout, CONFIG.tcp_timeout */
+};
 
-	uint8_t wscale_mine;	/* my window scale (adertising window) */
-	uint8_t wscale_peer;	/* peer's window scale (advertised window) */
-	int8_t nif_out;			/* cached output network interface */
-	unsigned char *d_haddr;	/* cached destination MAC address */
+struct tcp_timer
+{
+	TAILQ_ENTRY(tcp_timer) link;
+	struct tcp_stream *stream;
+	uint32_t expire;		/* in TS ticks */
+	uint16_t idx;			/* level * TW_SLOTS + slot while armed */
+	uint8_t armed;
+	uint8_t type;			/* enum tcp_timer_type */
+};
 
-	/* send sequence variables */
+struct tcp_send_vars
+{
+	/* hot: sequence space, windows and segment sizing (first cache line) */
 	uint32_t snd_una;		/* send unacknoledged */
 	uint32_t snd_wnd;		/* send window (unscaled) */
 	uint32_t peer_wnd;		/* client window size */
@@ -106,22 +129,33 @@ struct tcp_send_vars
 	uint32_t iss;			/* initial sending sequence */
 	uint32_t fss;			/* final sending sequence */
 
-	/* retransmission timeout variables */
-	uint8_t nrtx;			/* number of retransmission */
-	uint8_t max_nrtx;		/* max number of retransmission */
-	uint32_t rto;			/* retransmission timeout */
-	uint32_t ts_rto;		/* timestamp for retransmission timeout */
-
 	/* congestion control variables */
 	uint32_t cwnd;				/* congestion window */
 	uint32_t ssthresh;			/* slow start threshold */
-#if USE_CCP
-	uint32_t missing_seq;
-#endif
+
+	/* retransmission timeout variables */
+	uint32_t rto;			/* retransmission timeout */
+	uint32_t ts_rto;		/* timestamp for retransmission timeout */
 
 	/* timestamp */
 	uint32_t ts_lastack_sent;	/* last ack sent time */
 
+	struct tcp_send_buffer *sndbuf;
+	struct mptcp_map_queue *dss_maps;	/* MPTCP subflows: maps into meta sndbuf */
+
+	uint16_t mss;			/* maximum segment size */
+	uint16_t eff_mss;		/* effective segment size (excluding tcp option) */
+	/* IP-level information */
+	uint16_t ip_id;
+	uint8_t wscale_mine;	/* my window scale (adertising window) */
+	uint8_t wscale_peer;	/* peer's window scale (advertised window) */
+
+	/* hot: queueing state, the RTO timer and the lock (second cache line) */
+	int8_t nif_out;			/* cached output network interface */
+	uint8_t nrtx;			/* number of retransmission */
+	uint8_t max_nrtx;		/* max number of retransmission */
+	uint8_t mptcp_sf_idx;			/* position in the MPTCP subflow set + 1 */
+
 	uint8_t is_wack:1, 			/* is ack for window adertisement? */
 			ack_cnt:6;			/* number of acks to send. max 64 */
 
@@ -136,21 +170,34 @@ struct tcp_send_vars
 	uint8_t on_closeq_int:1, 
 			on_resetq_int:1, 
 			is_fin_sent:1, 
-			is_fin_ackd:1;
-
-	TAILQ_ENTRY(tcp_stream) control_link;
-	TAILQ_ENTRY(tcp_stream) send_link;
-	TAILQ_ENTRY(tcp_stream) ack_link;
-
-	TAILQ_ENTRY(tcp_stream) timer_link;		/* timer link (rto list, tw list) */
-	TAILQ_ENTRY(tcp_stream) timeout_link;	/* connection timeout link */
+			is_fin_ackd:1, 
+			rtt_timing:1,		/* a segment is being timed for RTT */
+			sack_recovery:1,	/* in RFC 6675 loss recovery */
+			sack_rxt_una:1;		/* its first retransmission is due */
+	uint32_t rtt_ts;		/* when the timed segment was sent */
+#if USE_CCP
+	uint32_t missing_seq;
+#endif
 
-	struct tcp_send_buffer *sndbuf;
+	struct tcp_timer timer;			/* RTO, or 2MSL in TIME_WAIT */
+	uint32_t rtt_end;		/* the ACK of this gives the RTT sample */
 #if USE_SPIN_LOCK
 	pthread_spinlock_t write_lock;
 #else
-	pthread_mutex_t write_lock;
+	pthread_mutex_t write_lock;		/* does not fit, spills into the cold part */
+#endif
+
+	/* cold */
+	unsigned char *d_haddr;	/* cached destination MAC address */
+#if TCP_OPT_SACK_ENABLED
+	uint32_t recovery_point;	/* snd_nxt when SACK recovery started */
+	uint32_t high_rxt;			/* end of the last hole resent in it */
 #endif
+	struct tcp_timer idle_timer;	/* connection timeout */
+
+	TAILQ_ENTRY(tcp_stream) control_link;
+	TAILQ_ENTRY(tcp_stream) send_link;
+	TAILQ_ENTRY(tcp_stream) ack_link;
 
 #if RTM_STAT
 	struct rtm_stat rstat;			/* retransmission statistics */
@@ -164,67 +211,74 @@ struct tcp_send_vars
 
 typedef struct tcp_stream
 {
-	socket_map_t socket;
-
+	/* cold: identity, table bookkeeping and MPTCP handshake state */
 	uint32_t id:24, 
 			 stream_type:8;
 
-	uint32_t saddr;			/* in network order */
-	uint32_t daddr;			/* in network order */
-	uint16_t sport;			/* in network order */
-	uint16_t dport;			/* in network order */
-	
-	uint8_t state;			/* tcp state */
-	uint8_t close_reason;	/* close reason */
 	uint8_t on_hash_table;
 	uint8_t on_timewait_list;
 	uint8_t ht_idx;
-	uint8_t closed;
 	uint8_t is_bound_addr;
-	uint8_t need_wnd_adv;
-	int16_t on_rto_idx;
 
-	mptcp_cb *mptcp_cb;
-	uint8_t isReceivedMPCapableSYN;
-	uint8_t isReceivedMPJoinSYN;
 	uint64_t peerKey;
 	uint32_t myRandomNumber;
 	uint32_t peerRandomNumber;
 
-	uint16_t on_timeout_list:1, 
-			on_rcv_br_list:1, 
-			on_snd_br_list:1, 
-			saw_timestamp:1,	/* whether peer sends timestamp */
-			sack_permit:1,		/* whether peer permits SACK */
-			control_list_waiting:1, 
-			have_reset:1,
-			is_external:1,		/* the peer node is locate outside of lan */
-			wait_for_acks:1;	/* if true, the sender should wait for acks to catch up before sending again */
-	
-	uint32_t snd_nxt;		/* send next */
-	uint32_t rcv_nxt;		/* receive next */
 #if USE_CCP
 	uint32_t seq_at_last_loss;	/* the sequence number we left off at before we stopped at wait_for_acks (due to loss) */
+	struct ccp_connection *ccp_conn;
 #endif
-
-	struct tcp_recv_vars *rcvvar;
-	struct tcp_send_vars *sndvar;
 #if RATE_LIMIT_ENABLED
 	struct token_bucket  *bucket;
 #endif
 #if PACING_ENABLED
-        struct packet_pacer  *pacer;
-#endif
-#if USE_CCP
-    struct ccp_connection *ccp_conn;
+	struct packet_pacer  *pacer;
 #endif
-	
+
+	/* hot: read for every segment of the flow. The last cache line, */
+	/* right before the send variables it leads to                    */
+	struct tcp_send_vars *sndvar __attribute__((aligned(64)));
+	struct tcp_recv_vars *rcvvar;
+	mptcp_cb *mptcp_cb;
+	socket_map_t socket;
+
+	uint32_t saddr;			/* in network order */
+	uint32_t daddr;			/* in network order */
+	uint16_t sport;			/* in network order */
+	uint16_t dport;			/* in network order */
+
+	uint32_t snd_nxt;		/* send next */
+	uint32_t rcv_nxt;		/* receive next */
 	uint32_t last_active_ts;		/* ts_last_ack_sent or ts_last_ts_upd */
+	int16_t on_rto_idx;		/* >= 0 while the RTO timer is armed */
 
-	uint8_t isMPJOINStream;
+	uint16_t on_timeout_list:1, 
+			on_rcv_br_list:1, 
+			on_snd_br_list:1, 
+			saw_timestamp:1,	/* whether peer sends timestamp */
+			sack_permit:1,		/* whether peer permits SACK */
+			control_list_waiting:1, 
+			have_reset:1,
+			is_external:1,		/* the peer node is locate outside of lan */
+			wait_for_acks:1,	/* if true, the sender should wait for acks to catch up before sending again */
+			isMPJOINStream:1,
+			isReceivedMPCapableSYN:1,
+			isReceivedMPJoinSYN:1;
 
+	uint8_t state;			/* tcp state */
+	uint8_t close_reason;	/* close reason */
+	uint8_t closed;
+	uint8_t need_wnd_adv;
 } tcp_stream;
 
+/* what a flow_pool chunk holds */
+struct tcp_stream_chunk
+{
+	tcp_stream stream;
+	struct tcp_send_vars sndvar __attribute__((aligned(64)));
+	struct tcp_recv_vars rcvvar __attribute__((aligned(64)));
+};
+
 extern inline char *
 TCPStateToString(const tcp_stream *cur_stream);
 
@@ -268,6 +322,9 @@ tcp_stream *
 CreateMpcbTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type, 
 		uint32_t saddr, uint16_t sport, uint32_t daddr, uint16_t dport);
 
+void
+DestroyMpcbTCPStream(mtcp_manager_t mtcp, tcp_stream *stream);
+
 void
 DestroyTCPStream(mtcp_manager_t mtcp, tcp_stream *stream);
 
@@ -22,70 +22,80 @@ struct tcp_timestamp
 	uint32_t ts_ref;
 };
 
-void ParseTCPOptions(tcp_stream *cur_stream,
-		        uint32_t cur_ts, uint8_t *tcpopt, int len);
+/* the options of one received segment, decoded by ParseTCPOptions in a 
+   single walk; a field is only valid if its TCP_OPT_FLAG_* is set */
+struct tcp_options
+{
+	uint16_t flags;
+	uint16_t mss;
+	uint8_t wscale;
+	struct tcp_timestamp ts;
+	uint8_t *sack;			/* SACK blocks as on the wire */
+	uint8_t sack_len;
+
+	/* MPTCP */
+	uint8_t mptcp_subtype;		/* of the handshake option, or _NONE */
+	uint8_t join_len;		/* tells the MP_JOIN SYN, SYN/ACK and ACK apart */
+	uint8_t join_backup;
+	uint8_t prio_backup;		/* MP_PRIO: the B flag */
+	uint8_t join_addr_id;
+	uint64_t snd_key;		/* MP_CAPABLE: the sender's key */
+	uint64_t rcv_key;		/* MP_CAPABLE ACK: the receiver's key */
+	uint32_t token;			/* MP_JOIN SYN */
+	uint32_t nonce;			/* MP_JOIN SYN and SYN/ACK */
+	uint64_t join_hmac;		/* MP_JOIN SYN/ACK: truncated HMAC */
+	uint8_t *join_mac;		/* MP_JOIN ACK: 160 bits of HMAC as on the wire */
+	uint64_t data_ack;		/* 4 byte ones unless TCP_OPT_FLAG_DATA_ACK_8 */
+	uint64_t dsn;			/* 4 byte ones unless TCP_OPT_FLAG_DSN_8 */
+	uint32_t dss_ssn;
+	uint16_t dss_len;
+	uint8_t add_addr_id;
+	uint8_t add_addr_echo;
+	uint32_t add_addr;		/* network order */
+	uint16_t add_port;		/* network order, 0 if not given */
+	uint64_t add_addr_hmac;		/* truncated HMAC, not in an echo */
+	uint8_t *rm_addr_ids;		/* REMOVE_ADDR ids as on the wire */
+	uint8_t rm_addr_cnt;
+};
 
-uint8_t 
-ParseMPTCPOptions(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len);
+void 
+ParseTCPOptions(struct tcp_options *opts, uint8_t *tcpopt, int len);
 
-extern inline int
-ParseTCPTimestamp(tcp_stream *cur_stream,
-		        struct tcp_timestamp *ts, uint8_t *tcpopt, int len);
+void 
+SetTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts, 
+		const struct tcp_options *opts);
 
 #if TCP_OPT_SACK_ENABLED
 int
 SeqIsSacked(tcp_stream *cur_stream, uint32_t seq);
 
-void
-ParseSACKOption(tcp_stream *cur_stream,
-		        uint32_t ack_seq, uint8_t *tcpopt, int len);
-#endif
-
-uint16_t
-TCPCalcChecksum(uint16_t *buf, uint16_t len, uint32_t saddr, uint32_t daddr);
-
-void
-PrintTCPOptions(uint8_t *tcpopt, int len);
-
-uint64_t 
-GetPeerKey(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len);
-
-uint64_t 
-GetMyKeyFromMPCapbleACK(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len);
-
-uint32_t 
-GetTokenFromMPJoinSYN(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len);
-
-uint32_t 
-GetPeerRandomNumberFromMPJoinSYN(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len);
+int
+SACKIsLost(tcp_stream *cur_stream, uint32_t seq);
 
 uint32_t
-GetToken(uint64_t key);
+SACKPipe(tcp_stream *cur_stream);
 
-uint32_t
-GetPeerIdsnFromKey(uint64_t key);
+int
+SACKNextSeg(tcp_stream *cur_stream, uint32_t *seq, uint32_t *len);
 
-uint32_t
-GetDataAck(tcp_stream *cur_stream, uint8_t *tcpopt, int len);
+void
+SACKReset(tcp_stream *cur_stream);
 
 uint32_t
-GetDataSeq(tcp_stream *cur_stream, uint8_t *tcpopt, int len);
+ParseSACKOption(tcp_stream *cur_stream,
+		        uint32_t ack_seq, const struct tcp_options *opts);
 
 uint16_t
-GetDataLevelLength(tcp_stream *cur_stream, uint8_t *tcpopt, int len);
-
-void hmac_sha1(const unsigned char *key, int key_len, const unsigned char *message, int message_len, unsigned char *digest);
+SACKOptionLength(tcp_stream *cur_stream, int room);
 
-void mp_join_hmac_generator(uint64_t key1, uint64_t key2, uint32_t num1, uint32_t num2, unsigned char* hash);
+int
+GenerateSACKOption(tcp_stream *cur_stream, uint8_t *tcpopt, uint16_t optlen);
+#endif
 
-uint64_t checkMP_JOIN_SYN_ACK(tcp_stream *cur_stream, uint32_t cur_ts, uint8_t *tcpopt, int len);
+uint16_t
+TCPCalcChecksum(uint16_t *buf, uint16_t len, uint32_t saddr, uint32_t daddr);
 
-uint32_t
-isDataFINPresent(tcp_stream *cur_stream, uint8_t *tcpopt, int len);
+void
+PrintTCPOptions(uint8_t *tcpopt, int len);
 
 #endif /* TCP_UTIL_H */	
@@ -4,18 +4,33 @@
 #include "mtcp.h"
 #include "tcp_stream.h"
 
-#define RTO_HASH 3000
-
-struct rto_hashstore 
+/* hierarchical timing wheel, one per core, ticking with the TS clock (HZ). */
+/* Level l has TW_SLOTS slots of TW_SLOTS^l ticks each; a timer is filed on */
+/* the lowest level whose span covers it and moves down a level each time  */
+/* the wheel below completes a turn. Arm and cancel are O(1); expiry jumps  */
+/* over empty slots with the occupancy bitmap of level 0.                   */
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 5
+#define TW_MAX_DELTA ((1U << (TW_BITS * TW_LEVELS)) - 1)	/* ~17.9 minutes */
+#define TW_EXPIRING (TW_LEVELS * TW_SLOTS)	/* idx of a timer being fired */
+
+struct timer_wheel 
 {
-	uint32_t rto_now_idx; // pointing the hs_table_s index
-	uint32_t rto_now_ts; // 
-	
-	TAILQ_HEAD(rto_head , tcp_stream) rto_list[RTO_HASH+1];
+	uint32_t now;			/* next tick to expire */
+	uint64_t occupied;		/* level-0 slots with timers */
+	int cnt;
+
+	TAILQ_HEAD(tw_head, tcp_timer) slots[TW_LEVELS][TW_SLOTS];
+	struct tw_head expiring;	/* due, handlers not run yet */
 };
 
-struct rto_hashstore* 
-InitRTOHashstore();
+struct timer_wheel * 
+CreateTimerWheel();
+
+void
+DestroyTimerWheel(struct timer_wheel *tw);
 
 extern inline void 
 AddtoRTOList(mtcp_manager_t mtcp, tcp_stream *cur_stream);
@@ -35,20 +50,12 @@ AddtoTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream);
 extern inline void 
 RemoveFromTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream);
 
-extern inline void 
-UpdateTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream);
-
 extern inline void
 UpdateRetransmissionTimer(mtcp_manager_t mtcp, 
 		tcp_stream *cur_stream, uint32_t cur_ts);
 
+/* fires the timers due by cur_ts, at most thresh of them */
 void
-CheckRtmTimeout(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh);
-
-void 
-CheckTimewaitExpire(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh);
-
-void 
-CheckConnectionTimeout(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh);
+CheckTimers(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh);
 
 #endif /* TIMER_H */
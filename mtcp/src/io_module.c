@@ -295,9 +295,7 @@ SetNetEnv(char *dev_name_list, char *port_stat_list)
 			RTE_ALIGN_CEIL((unsigned long)ceil((CONFIG.num_cores *
 							    (CONFIG.rcvbuf_size +
 							     CONFIG.sndbuf_size +
-							     sizeof(struct tcp_stream) +
-							     sizeof(struct tcp_recv_vars) +
-							     sizeof(struct tcp_send_vars) +
+							     sizeof(struct tcp_stream_chunk) +
 							     sizeof(struct fragment_ctx)) *
 							    CONFIG.max_concurrency)/RTE_SOCKET_MEM_SHIFT),
 				       RTE_CACHE_LINE_SIZE);
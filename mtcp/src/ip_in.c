@@ -14,7 +14,8 @@
 /*----------------------------------------------------------------------------*/
 inline int 
 ProcessIPv4Packet(mtcp_manager_t mtcp, uint32_t cur_ts, 
-				  const int ifidx, unsigned char* pkt_data, int len)
+				  const int ifidx, unsigned char* pkt_data, int len, 
+				  uint32_t rxhash)
 {
 	/* check and process IPv4 packets */
 	struct iphdr* iph = (struct iphdr *)(pkt_data + sizeof(struct ethhdr));
@@ -54,7 +55,7 @@ ProcessIPv4Packet(mtcp_manager_t mtcp, uint32_t cur_ts,
 	
 	switch (iph->protocol) {
 		case IPPROTO_TCP:
-			return ProcessTCPPacket(mtcp, cur_ts, ifidx, iph, ip_len);
+			return ProcessTCPPacket(mtcp, cur_ts, ifidx, iph, ip_len, rxhash);
 		case IPPROTO_ICMP:
 			return ProcessICMPPacket(mtcp, iph, ip_len);
 		default:
@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mptcp_cc.h"
+#include "debug.h"
+
+#ifndef MAX
+#define MAX(a, b) ((a)>(b)?(a):(b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a)<(b)?(a):(b))
+#endif
+
+/* BALIA caps the extra decrease of a slow subflow at 1.5 halvings */
+#define BALIA_MAX_DECREASE	1.5
+
+static const char *cc_names[MPTCP_CC_NUM] = {
+	[MPTCP_CC_RENO] = "reno",
+	[MPTCP_CC_LIA] = "lia",
+	[MPTCP_CC_OLIA] = "olia",
+	[MPTCP_CC_BALIA] = "balia",
+};
+/*----------------------------------------------------------------------------*/
+int
+MPTCPCCGetAlgo(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MPTCP_CC_NUM; i++) {
+		if (strcmp(name, cc_names[i]) == 0)
+			return i;
+	}
+
+	return -1;
+}
+/*----------------------------------------------------------------------------*/
+const char *
+MPTCPCCGetName(int algo)
+{
+	if (algo < 0 || algo >= MPTCP_CC_NUM)
+		return "unknown";
+
+	return cc_names[algo];
+}
+/*----------------------------------------------------------------------------*/
+#define CC_TERM(set, i, off)	(*(double *)((char *)&(set)[i] + (off)))
+/*----------------------------------------------------------------------------*/
+/* keeps *max pointing at the member with the largest term after member idx */
+/* changed from old; the set is only walked when the leader itself went down */
+static inline void
+MPTCPCCTrackMax(struct mptcp_subflow *set, int n, size_t off, 
+		int idx, double old, uint8_t *max)
+{
+	int i;
+
+	if (idx != *max) {
+		if (CC_TERM(set, idx, off) > CC_TERM(set, *max, off))
+			*max = idx;
+		return;
+	}
+
+	if (CC_TERM(set, idx, off) >= old)
+		return;
+
+	for (i = 0; i < n; i++) {
+		if (CC_TERM(set, i, off) > CC_TERM(set, *max, off))
+			*max = i;
+	}
+}
+/*----------------------------------------------------------------------------*/
+/* leader of a term once member idx leaves and the last one takes its place */
+static inline uint8_t
+MPTCPCCLeaderAfterRemove(struct mptcp_subflow *set, int n, size_t off, 
+		int idx, uint8_t max)
+{
+	int i, best = -1;
+
+	if (max == idx) {
+		for (i = 0; i < n; i++) {
+			if (i != idx && (best < 0 || 
+					CC_TERM(set, i, off) > CC_TERM(set, best, off)))
+				best = i;
+		}
+		max = best < 0 ? 0 : best;
+	}
+
+	return (max == n - 1) ? idx : max;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPCCOnAck(tcp_stream *sf, uint32_t acked)
+{
+	mptcp_cb *mpcb = sf->mptcp_cb;
+	struct mptcp_cc_vars *cc = &mpcb->cc;
+	struct mptcp_subflow *set = mpcb->subflows, *e;
+	int n = mpcb->num_subflows;
+	int idx = sf->sndvar->mptcp_sf_idx - 1;
+	double rtt, l, old;
+
+	if (idx < 0)
+		return;
+	e = &set[idx];
+
+	e->l_cur += acked;
+	rtt = MAX(sf->rcvvar->srtt, 1);
+	l = MAX(e->l_cur, e->l_prev);
+
+	old = e->cwnd;
+	e->cwnd = sf->sndvar->cwnd;
+	MPTCPCCTrackMax(set, n, offsetof(struct mptcp_subflow, cwnd), 
+			idx, old, &cc->max_cwnd);
+
+	old = e->rate;
+	e->rate = e->cwnd / rtt;
+	cc->tot_rate += e->rate - old;
+	/* do not let rounding drift leave the sum below a single term */
+	if (cc->tot_rate < e->rate)
+		cc->tot_rate = e->rate;
+	MPTCPCCTrackMax(set, n, offsetof(struct mptcp_subflow, rate), 
+			idx, old, &cc->max_rate);
+
+	old = e->lia;
+	e->lia = e->rate / rtt;
+	MPTCPCCTrackMax(set, n, offsetof(struct mptcp_subflow, lia), 
+			idx, old, &cc->max_lia);
+
+	old = e->best;
+	e->best = l * l / rtt;
+	MPTCPCCTrackMax(set, n, offsetof(struct mptcp_subflow, best), 
+			idx, old, &cc->max_best);
+}
+/*----------------------------------------------------------------------------*/
+uint32_t
+MPTCPCCCongAvoid(tcp_stream *sf, uint16_t packets)
+{
+	struct tcp_send_vars *sndvar = sf->sndvar;
+	mptcp_cb *mpcb = sf->mptcp_cb;
+	struct mptcp_cc_vars *cc = &mpcb->cc;
+	struct mptcp_subflow *set = mpcb->subflows;
+	double mss2 = (double)sndvar->mss * sndvar->mss;
+	double reno, inc, coupled, alpha;
+	int idx = sndvar->mptcp_sf_idx - 1;
+
+	reno = packets * mss2 / sndvar->cwnd;
+	if (idx < 0 || cc->tot_rate <= 0)
+		return sndvar->cwnd + (uint32_t)reno;
+
+	/* (cwnd_i / rtt_i^2) / (sum cwnd_k / rtt_k)^2, scaled to bytes per */
+	/* acked packet; with a single subflow this is exactly Reno           */
+	coupled = packets * mss2 / (cc->tot_rate * cc->tot_rate);
+
+	switch (CONFIG.mptcp_cc) {
+	case MPTCP_CC_LIA:
+		/* RFC 6356: alpha * mss^2 / tot_cwnd reduces to this, capped by */
+		/* what an uncoupled flow on the same path would get            */
+		inc = MIN(set[cc->max_lia].lia * coupled, reno);
+		break;
+	case MPTCP_CC_OLIA:
+		/* alpha shifts window from the largest subflow to the best one */
+		/* when they differ (sets of one, ties go to the first leader)  */
+		alpha = 0;
+		if (cc->max_best != cc->max_cwnd) {
+			if (idx == cc->max_best)
+				alpha = 1.0 / mpcb->num_subflows;
+			else if (idx == cc->max_cwnd)
+				alpha = -1.0 / mpcb->num_subflows;
+		}
+		inc = set[idx].lia * coupled + alpha * reno;
+		break;
+	case MPTCP_CC_BALIA:
+		alpha = (set[idx].rate > 0) ?
+				set[cc->max_rate].rate / set[idx].rate : 1;
+		inc = set[idx].lia * coupled *
+				((1 + alpha) / 2) * ((4 + alpha) / 5);
+		break;
+	default:
+		inc = reno;
+		break;
+	}
+
+	if (inc < 0) {
+		if ((double)sndvar->cwnd + inc < sndvar->mss)
+			return sndvar->mss;
+		return sndvar->cwnd - (uint32_t)-inc;
+	}
+	if ((double)sndvar->cwnd + inc > UINT32_MAX)
+		return sndvar->cwnd;
+
+	return sndvar->cwnd + (uint32_t)inc;
+}
+/*----------------------------------------------------------------------------*/
+uint32_t
+MPTCPCCSsthresh(tcp_stream *sf)
+{
+	struct tcp_send_vars *sndvar = sf->sndvar;
+	mptcp_cb *mpcb = sf->mptcp_cb;
+	struct mptcp_subflow *e;
+	uint32_t wnd = MIN(sndvar->cwnd, sndvar->peer_wnd);
+	double alpha;
+	int idx = sndvar->mptcp_sf_idx - 1;
+
+	if (idx < 0)
+		return wnd / 2;
+	e = &mpcb->subflows[idx];
+
+	/* OLIA measures the bytes between losses */
+	e->l_prev = e->l_cur;
+	e->l_cur = 0;
+
+	if (CONFIG.mptcp_cc == MPTCP_CC_BALIA && e->rate > 0) {
+		alpha = mpcb->subflows[mpcb->cc.max_rate].rate / e->rate;
+		return wnd - (uint32_t)(wnd / 2 * MIN(alpha, BALIA_MAX_DECREASE));
+	}
+
+	return wnd / 2;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPCCRemoveSubflow(mptcp_cb *mpcb, int idx)
+{
+	struct mptcp_cc_vars *cc = &mpcb->cc;
+	struct mptcp_subflow *set = mpcb->subflows;
+	int n = mpcb->num_subflows;
+
+	cc->tot_rate = MAX(cc->tot_rate - set[idx].rate, 0);
+
+	cc->max_cwnd = MPTCPCCLeaderAfterRemove(set, n, 
+			offsetof(struct mptcp_subflow, cwnd), idx, cc->max_cwnd);
+	cc->max_rate = MPTCPCCLeaderAfterRemove(set, n, 
+			offsetof(struct mptcp_subflow, rate), idx, cc->max_rate);
+	cc->max_lia = MPTCPCCLeaderAfterRemove(set, n, 
+			offsetof(struct mptcp_subflow, lia), idx, cc->max_lia);
+	cc->max_best = MPTCPCCLeaderAfterRemove(set, n, 
+			offsetof(struct mptcp_subflow, best), idx, cc->max_best);
+}
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,316 @@
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#include "mptcp_crypto.h"
+#include "mptcp.h"
+
+#define ROL32(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha1_init[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0,
+};
+
+static const uint32_t sha256_init[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const uint32_t sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+	0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+	0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+	0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+	0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+	0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+	0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+	0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+	0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+/*----------------------------------------------------------------------------*/
+static inline uint32_t
+LoadBE32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+			((uint32_t)p[2] << 8) | p[3];
+}
+/*----------------------------------------------------------------------------*/
+static inline uint64_t
+LoadBE64(const uint8_t *p)
+{
+	return ((uint64_t)LoadBE32(p) << 32) | LoadBE32(p + 4);
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+StoreBE32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+/*----------------------------------------------------------------------------*/
+static void
+SHA1Compress(uint32_t *h, const uint8_t *block)
+{
+	uint32_t w[16], a, b, c, d, e, f, k, t;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = LoadBE32(block + 4 * i);
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+	/* the schedule is kept as a 16 word ring instead of all 80 words */
+	for (i = 0; i < 80; i++) {
+		if (i >= 16) {
+			w[i & 15] = ROL32(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^
+					w[(i + 2) & 15] ^ w[i & 15], 1);
+		}
+		if (i < 20) {
+			f = d ^ (b & (c ^ d));
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (d & (b | c));
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		t = ROL32(a, 5) + f + e + k + w[i & 15];
+		e = d;
+		d = c;
+		c = ROL32(b, 30);
+		b = a;
+		a = t;
+	}
+
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+/*----------------------------------------------------------------------------*/
+static void
+SHA256Compress(uint32_t *h, const uint8_t *block)
+{
+	uint32_t w[16], s[8], s0, s1, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = LoadBE32(block + 4 * i);
+	memcpy(s, h, sizeof(s));
+
+	for (i = 0; i < 64; i++) {
+		if (i >= 16) {
+			s0 = w[(i + 1) & 15];
+			s0 = ROR32(s0, 7) ^ ROR32(s0, 18) ^ (s0 >> 3);
+			s1 = w[(i + 14) & 15];
+			s1 = ROR32(s1, 17) ^ ROR32(s1, 19) ^ (s1 >> 10);
+			w[i & 15] += s0 + w[(i + 9) & 15] + s1;
+		}
+		t1 = s[7] + (ROR32(s[4], 6) ^ ROR32(s[4], 11) ^ ROR32(s[4], 25)) +
+				(s[6] ^ (s[4] & (s[5] ^ s[6]))) + sha256_k[i] + w[i & 15];
+		t2 = (ROR32(s[0], 2) ^ ROR32(s[0], 13) ^ ROR32(s[0], 22)) +
+				((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+		s[7] = s[6];
+		s[6] = s[5];
+		s[5] = s[4];
+		s[4] = s[3] + t1;
+		s[3] = s[2];
+		s[2] = s[1];
+		s[1] = s[0];
+		s[0] = t1 + t2;
+	}
+
+	for (i = 0; i < 8; i++)
+		h[i] += s[i];
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+HashInit(struct mptcp_hash_ctx *ctx, int sha256)
+{
+	if (sha256)
+		memcpy(ctx->h, sha256_init, sizeof(sha256_init));
+	else
+		memcpy(ctx->h, sha1_init, sizeof(sha1_init));
+	ctx->len = 0;
+	ctx->sha256 = sha256;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+HashCompress(struct mptcp_hash_ctx *ctx, const uint8_t *block)
+{
+	if (ctx->sha256)
+		SHA256Compress(ctx->h, block);
+	else
+		SHA1Compress(ctx->h, block);
+}
+/*----------------------------------------------------------------------------*/
+static void
+HashUpdate(struct mptcp_hash_ctx *ctx, const uint8_t *p, int len)
+{
+	int used = ctx->len & (MPTCP_HASH_BLOCK - 1);
+	int n;
+
+	ctx->len += len;
+
+	if (used) {
+		n = MPTCP_HASH_BLOCK - used;
+		if (len < n) {
+			memcpy(ctx->buf + used, p, len);
+			return;
+		}
+		memcpy(ctx->buf + used, p, n);
+		HashCompress(ctx, ctx->buf);
+		p += n;
+		len -= n;
+	}
+
+	/* whole blocks are hashed in place */
+	for (; len >= MPTCP_HASH_BLOCK; p += MPTCP_HASH_BLOCK, len -= MPTCP_HASH_BLOCK)
+		HashCompress(ctx, p);
+
+	memcpy(ctx->buf, p, len);
+}
+/*----------------------------------------------------------------------------*/
+static void
+HashFinal(struct mptcp_hash_ctx *ctx, uint8_t *digest)
+{
+	int used = ctx->len & (MPTCP_HASH_BLOCK - 1);
+	uint64_t bits = ctx->len << 3;
+	int i, words;
+
+	/* 0x80, zeros, then the message length in bits, big endian */
+	ctx->buf[used++] = 0x80;
+	if (used > MPTCP_HASH_BLOCK - 8) {
+		memset(ctx->buf + used, 0, MPTCP_HASH_BLOCK - used);
+		HashCompress(ctx, ctx->buf);
+		used = 0;
+	}
+	memset(ctx->buf + used, 0, MPTCP_HASH_BLOCK - 8 - used);
+	StoreBE32(ctx->buf + MPTCP_HASH_BLOCK - 8, bits >> 32);
+	StoreBE32(ctx->buf + MPTCP_HASH_BLOCK - 4, bits);
+	HashCompress(ctx, ctx->buf);
+
+	words = ctx->sha256 ? MPTCP_SHA256_LEN / 4 : MPTCP_SHA1_LEN / 4;
+	for (i = 0; i < words; i++)
+		StoreBE32(digest + 4 * i, ctx->h[i]);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSha1(const void *msg, int len, uint8_t *digest)
+{
+	struct mptcp_hash_ctx ctx;
+
+	HashInit(&ctx, 0);
+	HashUpdate(&ctx, (const uint8_t *)msg, len);
+	HashFinal(&ctx, digest);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSha256(const void *msg, int len, uint8_t *digest)
+{
+	struct mptcp_hash_ctx ctx;
+
+	HashInit(&ctx, 1);
+	HashUpdate(&ctx, (const uint8_t *)msg, len);
+	HashFinal(&ctx, digest);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPHmacInit(struct mptcp_hmac_key *hk, int sha256,
+		const void *key, int key_len)
+{
+	uint8_t pad[MPTCP_HASH_BLOCK];
+	int i;
+
+	/* keys longer than a block are replaced by their hash */
+	memset(pad, 0, sizeof(pad));
+	if (key_len > MPTCP_HASH_BLOCK) {
+		if (sha256)
+			MPTCPSha256(key, key_len, pad);
+		else
+			MPTCPSha1(key, key_len, pad);
+	} else {
+		memcpy(pad, key, key_len);
+	}
+
+	for (i = 0; i < MPTCP_HASH_BLOCK; i++)
+		pad[i] ^= 0x36;
+	HashInit(&hk->inner, sha256);
+	HashUpdate(&hk->inner, pad, MPTCP_HASH_BLOCK);
+
+	for (i = 0; i < MPTCP_HASH_BLOCK; i++)
+		pad[i] ^= 0x36 ^ 0x5C;
+	HashInit(&hk->outer, sha256);
+	HashUpdate(&hk->outer, pad, MPTCP_HASH_BLOCK);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPHmac(const struct mptcp_hmac_key *hk, const void *msg, int len,
+		uint8_t *digest)
+{
+	struct mptcp_hash_ctx ctx;
+	uint8_t ihash[MPTCP_SHA256_LEN];
+
+	ctx = hk->inner;
+	HashUpdate(&ctx, (const uint8_t *)msg, len);
+	HashFinal(&ctx, ihash);
+
+	ctx = hk->outer;
+	HashUpdate(&ctx, ihash, ctx.sha256 ? MPTCP_SHA256_LEN : MPTCP_SHA1_LEN);
+	HashFinal(&ctx, digest);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPKeyHash(uint64_t key, uint32_t *token, uint64_t *idsn)
+{
+	uint8_t digest[MPTCP_SHA256_LEN];
+	uint64_t nkey = htobe64(key);
+
+#if TCP_MPTCP_VERSION == 0
+	MPTCPSha1(&nkey, sizeof(nkey), digest);
+	*idsn = LoadBE64(digest + MPTCP_SHA1_LEN - 8);
+#else
+	MPTCPSha256(&nkey, sizeof(nkey), digest);
+	*idsn = LoadBE64(digest + MPTCP_SHA256_LEN - 8);
+#endif
+	*token = LoadBE32(digest);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPJoinHmacInit(struct mptcp_hmac_key *hk, uint64_t my_key, uint64_t peer_key)
+{
+	uint64_t keys[2];
+
+	keys[0] = htobe64(my_key);
+	keys[1] = htobe64(peer_key);
+	MPTCPHmacInit(hk, TCP_MPTCP_VERSION != 0, keys, sizeof(keys));
+}
+/*----------------------------------------------------------------------------*/
+uint64_t
+MPTCPAddAddrHmac(const struct mptcp_hmac_key *hk, uint8_t id, 
+		uint32_t addr, uint16_t port)
+{
+	uint8_t msg[7];
+	uint8_t digest[MPTCP_SHA256_LEN];
+	int len = hk->inner.sha256 ? MPTCP_SHA256_LEN : MPTCP_SHA1_LEN;
+
+	/* id, address and port as they are on the wire, port 0 if absent */
+	msg[0] = id;
+	memcpy(msg + 1, &addr, 4);
+	memcpy(msg + 5, &port, 2);
+	MPTCPHmac(hk, msg, sizeof(msg), digest);
+
+	return LoadBE64(digest + len - 8);
+}
+/*----------------------------------------------------------------------------*/
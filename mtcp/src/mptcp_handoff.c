@@ -0,0 +1,250 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "mptcp_handoff.h"
+#include "tcp_in.h"
+#include "config.h"
+#include "debug.h"
+
+/*----------------------------------------------------------------------------*/
+static inline void
+HandoffMemoryBarrier(volatile uint32_t index)
+{
+	__asm__ volatile("" : : "m" (index) : "memory");
+}
+/*----------------------------------------------------------------------------*/
+struct mptcp_handoff *
+MPTCPHandoffCreate(int cpu)
+{
+	struct mptcp_handoff *ho;
+	int i;
+
+	if (CONFIG.num_cores <= 1)
+		return NULL;
+
+	ho = (struct mptcp_handoff *)calloc(1, sizeof(struct mptcp_handoff));
+	if (!ho) {
+		TRACE_ERROR("Failed to allocate MPTCP handoff of core %d.\n", cpu);
+		return NULL;
+	}
+
+	for (i = 0; i < CONFIG.num_cores && i < MAX_CPUS; i++) {
+		if (i == cpu)
+			continue;
+		ho->rings[i] = (struct mptcp_handoff_ring *)
+				calloc(1, sizeof(struct mptcp_handoff_ring));
+		if (!ho->rings[i]) {
+			TRACE_ERROR("Failed to allocate MPTCP handoff ring %d->%d.\n",
+					i, cpu);
+			MPTCPHandoffDestroy(ho);
+			return NULL;
+		}
+	}
+
+	return ho;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPHandoffDestroy(struct mptcp_handoff *ho)
+{
+	int i;
+
+	if (!ho)
+		return;
+
+	for (i = 0; i < MAX_CPUS; i++)
+		free(ho->rings[i]);
+	free(ho);
+}
+/*----------------------------------------------------------------------------*/
+static inline struct mptcp_redirect *
+RedirectBin(struct mptcp_handoff *ho, const struct iphdr *iph,
+		const struct tcphdr *tcph)
+{
+	uint32_t h;
+
+	h = iph->saddr ^ iph->daddr ^
+			((uint32_t)tcph->source << 16 | tcph->dest);
+	h ^= h >> 16;
+	h ^= h >> 8;
+
+	return ho->redirect[h % MPTCP_REDIRECT_BINS];
+}
+/*----------------------------------------------------------------------------*/
+static inline int
+RedirectMatch(const struct mptcp_redirect *r, const struct iphdr *iph,
+		const struct tcphdr *tcph)
+{
+	return r->used && r->saddr == iph->saddr && r->daddr == iph->daddr &&
+			r->sport == tcph->source && r->dport == tcph->dest;
+}
+/*----------------------------------------------------------------------------*/
+static struct mptcp_redirect *
+RedirectLookup(struct mptcp_handoff *ho, const struct iphdr *iph,
+		const struct tcphdr *tcph)
+{
+	struct mptcp_redirect *bin = RedirectBin(ho, iph, tcph);
+	int i;
+
+	for (i = 0; i < MPTCP_REDIRECT_WAYS; i++) {
+		if (RedirectMatch(&bin[i], iph, tcph))
+			return &bin[i];
+	}
+
+	return NULL;
+}
+/*----------------------------------------------------------------------------*/
+static struct mptcp_redirect *
+RedirectAdd(struct mptcp_handoff *ho, uint32_t cur_ts,
+		const struct iphdr *iph, const struct tcphdr *tcph, int core)
+{
+	struct mptcp_redirect *bin = RedirectBin(ho, iph, tcph);
+	struct mptcp_redirect *r = NULL;
+	int i;
+
+	for (i = 0; i < MPTCP_REDIRECT_WAYS; i++) {
+		/* a retransmitted SYN finds its own entry */
+		if (RedirectMatch(&bin[i], iph, tcph)) {
+			r = &bin[i];
+			break;
+		}
+		if (!r && (!bin[i].used ||
+				TCP_SEQ_GT(cur_ts, bin[i].ts + MPTCP_REDIRECT_IDLE)))
+			r = &bin[i];
+	}
+	if (!r)
+		return NULL;
+
+	if (!r->used)
+		ho->num_redirect++;
+	r->saddr = iph->saddr;
+	r->daddr = iph->daddr;
+	r->sport = tcph->source;
+	r->dport = tcph->dest;
+	r->core = core;
+	r->used = TRUE;
+	r->ts = cur_ts;
+
+	return r;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+RedirectRemove(struct mptcp_handoff *ho, struct mptcp_redirect *r)
+{
+	r->used = FALSE;
+	ho->num_redirect--;
+}
+/*----------------------------------------------------------------------------*/
+/* copies the packet into the ring from this core to core; FALSE if that    */
+/* ring is full or the packet too big, and the packet is dropped            */
+static int
+HandoffForward(mtcp_manager_t mtcp, int core,
+		const struct iphdr *iph, int ip_len)
+{
+	struct mptcp_handoff *dst;
+	struct mptcp_handoff_ring *ring;
+	struct mptcp_handoff_pkt *pkt;
+	uint32_t t, nt;
+
+	if (!g_mtcp[core] || !(dst = g_mtcp[core]->mptcp_handoff))
+		return FALSE;
+	ring = dst->rings[mtcp->ctx->cpu];
+	if (!ring || ip_len > MPTCP_HANDOFF_PKT_LEN)
+		return FALSE;
+
+	t = ring->tail;
+	nt = (t + 1) % MPTCP_HANDOFF_SLOTS;
+	if (nt == ring->head) {
+		TRACE_DBG("MPTCP handoff ring %d->%d is full.\n",
+				mtcp->ctx->cpu, core);
+		return FALSE;
+	}
+
+	pkt = &ring->pkts[t];
+	memcpy(pkt->data, iph, ip_len);
+	pkt->len = ip_len;
+	HandoffMemoryBarrier(ring->tail);
+	ring->tail = nt;
+
+	return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPHandoffCheck(mtcp_manager_t mtcp, uint32_t cur_ts,
+		const struct iphdr *iph, int ip_len, const struct tcphdr *tcph,
+		const struct tcp_options *opts)
+{
+	struct mptcp_handoff *ho = mtcp->mptcp_handoff;
+	struct mptcp_redirect *r;
+	int core;
+
+	if (!ho)
+		return FALSE;
+
+	if (tcph->syn && !tcph->ack) {
+		r = ho->num_redirect ? RedirectLookup(ho, iph, tcph) : NULL;
+		if (!(opts->flags & TCP_OPT_FLAG_MP_JOIN)) {
+			/* the port pair is reused by a new connection of our own */
+			if (r)
+				RedirectRemove(ho, r);
+			return FALSE;
+		}
+
+		core = MPTCPTokenCore(opts->token);
+		if (core == mtcp->ctx->cpu) {
+			if (r)
+				RedirectRemove(ho, r);
+			return FALSE;
+		}
+
+		if (!RedirectAdd(ho, cur_ts, iph, tcph, core)) {
+			TRACE_DBG("No room to redirect MP_JOIN for token %08x "
+					"to core %d.\n", opts->token, core);
+			return TRUE;
+		}
+		TRACE_DBG("MP_JOIN for token %08x goes to core %d.\n",
+				opts->token, core);
+		HandoffForward(mtcp, core, iph, ip_len);
+		return TRUE;
+	}
+
+	if (!ho->num_redirect || !(r = RedirectLookup(ho, iph, tcph)))
+		return FALSE;
+
+	r->ts = cur_ts;
+	HandoffForward(mtcp, r->core, iph, ip_len);
+	if (tcph->rst)
+		RedirectRemove(ho, r);
+
+	return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPHandoffPoll(mtcp_manager_t mtcp, uint32_t cur_ts)
+{
+	struct mptcp_handoff *ho = mtcp->mptcp_handoff;
+	struct mptcp_handoff_ring *ring;
+	struct mptcp_handoff_pkt *pkt;
+	uint32_t h;
+	int i;
+
+	if (!ho)
+		return;
+
+	for (i = 0; i < CONFIG.num_cores; i++) {
+		if (!(ring = ho->rings[i]))
+			continue;
+
+		while ((h = ring->head) != ring->tail) {
+			pkt = &ring->pkts[h];
+			/* no device checksum or hash for a packet off the ring */
+			ProcessTCPPacket(mtcp, cur_ts, -1,
+					(const struct iphdr *)pkt->data, pkt->len, 0);
+			HandoffMemoryBarrier(ring->head);
+			ring->head = (h + 1) % MPTCP_HANDOFF_SLOTS;
+		}
+	}
+}
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mptcp_info.h"
+#include "tcp_in.h"
+#include "tcp_stream.h"
+#include "tcp_send_buffer.h"
+#include "tcp_ring_buffer.h"
+#include "debug.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a)<(b)?(a):(b))
+#endif
+
+/* a reader racing a busy core gives up with EAGAIN after this many copies */
+#define INFO_READ_TRIES 16
+
+/*----------------------------------------------------------------------------*/
+static inline void
+InfoMemoryBarrier(void)
+{
+	__asm__ volatile("" : : : "memory");
+}
+/*----------------------------------------------------------------------------*/
+static void
+FillSubflowInfo(struct mtcp_mptcp_subflow_info *si, 
+		const struct mptcp_subflow *e)
+{
+	const tcp_stream *sf = e->stream;
+
+	si->saddr = sf->saddr;
+	si->daddr = sf->daddr;
+	si->sport = sf->sport;
+	si->dport = sf->dport;
+	si->id = e->id;
+	si->state = sf->state;
+	si->backup = e->backup;
+	si->stalled = e->stalled;
+	si->srtt_us = TS_TO_USEC(sf->rcvvar->srtt >> 3);
+	si->rttvar_us = TS_TO_USEC(sf->rcvvar->rttvar >> 2);
+	si->rto_us = TS_TO_USEC(sf->sndvar->rto);
+	si->cwnd = sf->sndvar->cwnd;
+	si->ssthresh = sf->sndvar->ssthresh;
+	si->mss = sf->sndvar->mss;
+	si->inflight = sf->snd_nxt - sf->sndvar->snd_una;
+	si->retransmits = sf->sndvar->nrtx;
+	si->bytes_sched = e->bytes_sched;
+	si->bytes_reinjected = e->bytes_reinjected;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPInfoPublish(mtcp_manager_t mtcp, mptcp_cb *mpcb, int force)
+{
+	struct mptcp_info_snap *snap;
+	struct mtcp_mptcp_info *info;
+	socket_map_t socket;
+	tcp_stream *meta = mpcb->mpcb_stream;
+	int i;
+
+	if (!mpcb->master || !(socket = mpcb->master->socket) || !meta)
+		return;
+	if (!force && mpcb->info_ts == mtcp->cur_ts)
+		return;
+	mpcb->info_ts = mtcp->cur_ts;
+
+	snap = socket->mptcp_info;
+	if (!snap) {
+		snap = (struct mptcp_info_snap *)calloc(1, sizeof(*snap));
+		if (!snap) {
+			TRACE_ERROR("Failed to allocate MPTCP info of socket %d.\n",
+					socket->id);
+			return;
+		}
+		socket->mptcp_info = snap;
+	}
+
+	snap->seq++;
+	InfoMemoryBarrier();
+
+	info = &snap->info;
+	info->token = mpcb->token;
+	info->num_subflows = mpcb->num_subflows;
+	info->snd_una = mpcb->snd_una_dsn;
+	info->rcv_nxt = mpcb->rcv_nxt_dsn;
+	info->sndbuf_len = meta->sndvar->sndbuf ? meta->sndvar->sndbuf->len : 0;
+	info->sndbuf_size = meta->sndvar->sndbuf ? meta->sndvar->sndbuf->size : 0;
+	info->rcvbuf_len = meta->rcvvar->rcvbuf ? 
+			meta->rcvvar->rcvbuf->merged_len : 0;
+	info->rcvbuf_size = meta->rcvvar->rcvbuf ? meta->rcvvar->rcvbuf->size : 0;
+	info->reinject_queued = 0;
+	for (i = 0; i < mpcb->reinject.cnt; i++)
+		info->reinject_queued += mpcb->reinject.end[i] - mpcb->reinject.seq[i];
+	info->reinjections = mpcb->reinjections;
+	info->bytes_sched = mpcb->bytes_sched;
+	info->bytes_reinjected = mpcb->bytes_reinjected;
+
+	for (i = 0; i < mpcb->num_subflows; i++)
+		FillSubflowInfo(&snap->sf[i], &mpcb->subflows[i]);
+
+	InfoMemoryBarrier();
+	snap->seq++;
+}
+/*----------------------------------------------------------------------------*/
+/* copies len bytes from off in the snapshot; FALSE if it kept changing */
+static int
+InfoRead(const struct mptcp_info_snap *snap, void *dst, size_t off, size_t len,
+		uint8_t *num_subflows)
+{
+	uint32_t seq;
+	int tries;
+
+	for (tries = 0; tries < INFO_READ_TRIES; tries++) {
+		seq = snap->seq;
+		if (seq & 1)
+			continue;
+		InfoMemoryBarrier();
+		memcpy(dst, (const uint8_t *)snap + off, len);
+		if (num_subflows)
+			*num_subflows = snap->info.num_subflows;
+		InfoMemoryBarrier();
+		if (snap->seq == seq)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+/*----------------------------------------------------------------------------*/
+static struct mptcp_info_snap *
+InfoSnapshot(socket_map_t socket)
+{
+	if (socket->socktype != MTCP_SOCK_STREAM || !socket->stream || 
+			!socket->mptcp_info || socket->mptcp_info->seq == 0) {
+		errno = ENOTCONN;
+		return NULL;
+	}
+
+	return socket->mptcp_info;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPInfoGet(socket_map_t socket, struct mtcp_mptcp_info *info)
+{
+	struct mptcp_info_snap *snap = InfoSnapshot(socket);
+
+	if (!snap)
+		return -1;
+	if (!InfoRead(snap, info, offsetof(struct mptcp_info_snap, info), 
+			sizeof(*info), NULL)) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPSubflowInfoGet(socket_map_t socket, 
+		struct mtcp_mptcp_subflow_info *sf, socklen_t *optlen)
+{
+	struct mptcp_info_snap *snap = InfoSnapshot(socket);
+	struct mtcp_mptcp_subflow_info tmp[MPTCP_MAX_SUBFLOWS];
+	uint8_t num;
+	int n;
+
+	if (!snap)
+		return -1;
+	if (!InfoRead(snap, tmp, offsetof(struct mptcp_info_snap, sf), 
+			sizeof(tmp), &num)) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	n = MIN((size_t)num, *optlen / sizeof(*sf));
+	memcpy(sf, tmp, n * sizeof(*sf));
+	*optlen = n * sizeof(*sf);
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
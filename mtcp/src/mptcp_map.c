@@ -0,0 +1,553 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mptcp_map.h"
+#include "tcp_in.h"
+#include "tcp_util.h"
+#include "tcp_send_buffer.h"
+#include "tcp_out.h"
+#include "mptcp_info.h"
+#include "debug.h"
+
+#ifndef MAX
+#define MAX(a, b) ((a)>(b)?(a):(b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a)<(b)?(a):(b))
+#endif
+
+/*----------------------------------------------------------------------------*/
+struct mptcp_map_queue *
+MPTCPMapQueueCreate(uint32_t init_seq)
+{
+	struct mptcp_map_queue *mq;
+
+	mq = (struct mptcp_map_queue *)calloc(1, sizeof(struct mptcp_map_queue));
+	if (!mq) {
+		TRACE_ERROR("Failed to allocate DSS map queue.\n");
+		return NULL;
+	}
+	mq->maps = (struct mptcp_dss_map *)
+		calloc(MPTCP_MAP_QUEUE_INIT, sizeof(struct mptcp_dss_map));
+	if (!mq->maps) {
+		TRACE_ERROR("Failed to allocate DSS map queue.\n");
+		free(mq);
+		return NULL;
+	}
+	mq->size = MPTCP_MAP_QUEUE_INIT;
+	mq->head_seq = init_seq;
+
+	return mq;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPMapQueueDestroy(struct mptcp_map_queue *mq)
+{
+	if (!mq)
+		return;
+
+	free(mq->maps);
+	free(mq);
+}
+/*----------------------------------------------------------------------------*/
+static inline struct mptcp_dss_map *
+MPTCPMapAt(struct mptcp_map_queue *mq, uint32_t i)
+{
+	return &mq->maps[(mq->head + i) & (mq->size - 1)];
+}
+/*----------------------------------------------------------------------------*/
+static int
+MPTCPMapGrow(struct mptcp_map_queue *mq)
+{
+	struct mptcp_dss_map *maps;
+	uint32_t i;
+
+	if (mq->size >= MPTCP_MAP_QUEUE_MAX)
+		return -1;
+
+	maps = (struct mptcp_dss_map *)
+		malloc(mq->size * 2 * sizeof(struct mptcp_dss_map));
+	if (!maps) {
+		TRACE_ERROR("Failed to grow DSS map queue.\n");
+		return -1;
+	}
+	for (i = 0; i < mq->cnt; i++)
+		maps[i] = *MPTCPMapAt(mq, i);
+
+	free(mq->maps);
+	mq->maps = maps;
+	mq->size *= 2;
+	mq->head = 0;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPMapAdd(struct mptcp_map_queue *mq, uint32_t ssn, uint32_t dsn, uint32_t len)
+{
+	struct mptcp_dss_map *map;
+
+	/* no merging with the last mapping: its length may be on the wire */
+	if (mq->cnt == mq->size && MPTCPMapGrow(mq) < 0)
+		return -1;
+
+	map = MPTCPMapAt(mq, mq->cnt);
+	map->ssn = ssn;
+	map->dsn = dsn;
+	map->len = len;
+	mq->cnt++;
+	mq->len += len;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+static struct mptcp_dss_map *
+MPTCPMapFind(struct mptcp_map_queue *mq, uint32_t ssn)
+{
+	uint32_t lo, hi, mid;
+
+	if (mq->cnt == 0 || TCP_SEQ_LT(ssn, mq->head_seq) || 
+			TCP_SEQ_GEQ(ssn, MPTCP_MAP_END(mq))) {
+		return NULL;
+	}
+
+	/* mappings are contiguous in ssn; find the last one starting <= ssn */
+	lo = 0;
+	hi = mq->cnt - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (TCP_SEQ_LEQ(MPTCPMapAt(mq, mid)->ssn, ssn))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return MPTCPMapAt(mq, lo);
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPMapLookup(struct mptcp_map_queue *mq, uint32_t ssn,
+		uint32_t *dsn, uint32_t *len)
+{
+	struct mptcp_dss_map *map;
+
+	map = MPTCPMapFind(mq, ssn);
+	if (!map)
+		return -1;
+
+	*dsn = map->dsn + (ssn - map->ssn);
+	*len = map->ssn + map->len - ssn;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPMapGetDSS(tcp_stream *sf, uint32_t *dsn, uint32_t *len)
+{
+	struct mptcp_dss_map *map = NULL;
+
+	if (sf->sndvar->dss_maps)
+		map = MPTCPMapFind(sf->sndvar->dss_maps, sf->snd_nxt);
+	if (!map) {
+		TRACE_ERROR("Stream %d: no DSS mapping for seq %u\n", 
+				sf->id, sf->snd_nxt);
+		return -1;
+	}
+
+	if (map->ssn != sf->snd_nxt)
+		return 0;
+
+	*dsn = map->dsn;
+	*len = map->len;
+
+	return 1;
+}
+/*----------------------------------------------------------------------------*/
+uint32_t
+MPTCPMapRemove(struct mptcp_map_queue *mq, uint32_t len)
+{
+	struct mptcp_dss_map *map;
+
+	len = MIN(len, mq->len);
+	mq->head_seq += len;
+	mq->len -= len;
+
+	while (mq->cnt > 0) {
+		map = MPTCPMapAt(mq, 0);
+		if (TCP_SEQ_GT(map->ssn + map->len, mq->head_seq))
+			break;
+		mq->head = (mq->head + 1) & (mq->size - 1);
+		mq->cnt--;
+	}
+
+	return len;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPProcessDataAck(mtcp_manager_t mtcp, tcp_stream *sf,
+		const struct tcp_options *opts, uint16_t window)
+{
+	mptcp_cb *mpcb = sf->mptcp_cb;
+	tcp_stream *meta;
+	struct tcp_send_vars *sndvar;
+	uint64_t ack64;
+	uint32_t data_ack, right_edge, prev_edge;
+
+	if (!mpcb || !mpcb->mpcb_stream || !(opts->flags & TCP_OPT_FLAG_DATA_ACK))
+		return;
+	meta = mpcb->mpcb_stream;
+	sndvar = meta->sndvar;
+	ack64 = (opts->flags & TCP_OPT_FLAG_DATA_ACK_8) ? opts->data_ack : 
+			MPTCPExpandDSN(mpcb->snd_una_dsn, (uint32_t)opts->data_ack);
+
+	/* ignore stale DATA_ACKs and ones for data we never sent; in 64 */
+	/* bits an old one can not pass for a new one after a wrap        */
+	if (ack64 < mpcb->snd_una_dsn || 
+			ack64 > MPTCPExpandDSN(mpcb->snd_una_dsn, meta->snd_nxt)) {
+		return;
+	}
+	data_ack = (uint32_t)ack64;
+
+	/* the window is shared by all subflows and counts from the DATA_ACK; */
+	/* its right edge is never moved back (RFC 6824, 3.3.5)               */
+	prev_edge = sndvar->snd_una + sndvar->peer_wnd;
+	right_edge = data_ack + ((uint32_t)window << sf->sndvar->wscale_peer);
+	if (TCP_SEQ_LT(right_edge, prev_edge))
+		right_edge = prev_edge;
+
+	if (TCP_SEQ_GT(data_ack, sndvar->snd_una)) {
+		sndvar->snd_una = data_ack;
+		mpcb->snd_una_dsn = ack64;
+		MPTCPReleaseMetaBuffer(mtcp, mpcb);
+	}
+	sndvar->peer_wnd = right_edge - sndvar->snd_una;
+
+	/* a window update alone does not advance any subflow's snd_una, so */
+	/* the meta stream is queued here for the data it was holding back   */
+	if (TCP_SEQ_GT(right_edge, prev_edge) && sndvar->sndbuf &&
+			TCP_SEQ_LT(meta->snd_nxt, sndvar->sndbuf->head_seq + sndvar->sndbuf->len))
+		AddtoSendList(mtcp, meta);
+
+	MPTCPInfoPublish(mtcp, mpcb, FALSE);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPReleaseMetaBuffer(mtcp_manager_t mtcp, mptcp_cb *mpcb)
+{
+	tcp_stream *meta = mpcb->mpcb_stream;
+	struct tcp_send_vars *sndvar;
+	struct mptcp_map_queue *mq;
+	struct mptcp_dss_map *map;
+	uint32_t upto, dsn;
+	int i;
+
+	if (!meta || !meta->sndvar->sndbuf)
+		return;
+	sndvar = meta->sndvar;
+	upto = sndvar->snd_una;
+
+	/* keep what a subflow may still have to retransmit */
+	for (i = 0; i < mpcb->num_subflows; i++) {
+		mq = mpcb->subflows[i].stream->sndvar->dss_maps;
+		if (!mq || mq->cnt == 0)
+			continue;
+		map = MPTCPMapAt(mq, 0);
+		dsn = map->dsn + (mq->head_seq - map->ssn);
+		if (TCP_SEQ_LT(dsn, upto))
+			upto = dsn;
+	}
+
+	if (!TCP_SEQ_GT(upto, sndvar->sndbuf->head_seq))
+		return;
+
+	SBUF_LOCK(&sndvar->write_lock);
+	SBRemove(mtcp->rbm_snd, sndvar->sndbuf, upto - sndvar->sndbuf->head_seq);
+	sndvar->snd_wnd = sndvar->sndbuf->size - sndvar->sndbuf->len;
+	SBUF_UNLOCK(&sndvar->write_lock);
+
+	if (mpcb->master)
+		RaiseWriteEvent(mtcp, mpcb->master);
+}
+/*----------------------------------------------------------------------------*/
+uint32_t
+MPTCPSubflowRcvAdvance(struct tcp_recv_vars *rcvvar, uint32_t rcv_nxt, 
+		uint32_t seq, uint32_t len)
+{
+	struct mptcp_ooo_ranges *ooo = rcvvar->mptcp_ooo;
+	uint32_t end = seq + len;
+	int i;
+
+	if (TCP_SEQ_LEQ(seq, rcv_nxt)) {
+		if (TCP_SEQ_GT(end, rcv_nxt))
+			rcv_nxt = end;
+
+		/* pull in the ranges that became contiguous */
+		i = 0;
+		while (ooo && i < ooo->cnt) {
+			if (TCP_SEQ_LEQ(ooo->seq[i], rcv_nxt)) {
+				if (TCP_SEQ_GT(ooo->end[i], rcv_nxt))
+					rcv_nxt = ooo->end[i];
+				ooo->cnt--;
+				ooo->seq[i] = ooo->seq[ooo->cnt];
+				ooo->end[i] = ooo->end[ooo->cnt];
+				i = 0;
+				continue;
+			}
+			i++;
+		}
+		return rcv_nxt;
+	}
+
+	if (!ooo) {
+		ooo = rcvvar->mptcp_ooo = 
+			(struct mptcp_ooo_ranges *)calloc(1, sizeof(struct mptcp_ooo_ranges));
+		if (!ooo)
+			return rcv_nxt;
+	}
+
+	for (i = 0; i < ooo->cnt; i++) {
+		if (TCP_SEQ_LEQ(seq, ooo->end[i]) && TCP_SEQ_GEQ(end, ooo->seq[i])) {
+			if (TCP_SEQ_LT(seq, ooo->seq[i]))
+				ooo->seq[i] = seq;
+			if (TCP_SEQ_GT(end, ooo->end[i]))
+				ooo->end[i] = end;
+			return rcv_nxt;
+		}
+	}
+
+	/* out of slots: forget the range, the peer retransmits it */
+	if (ooo->cnt < MPTCP_MAX_OOO_RANGES) {
+		ooo->seq[ooo->cnt] = seq;
+		ooo->end[ooo->cnt] = end;
+		ooo->cnt++;
+	}
+
+	return rcv_nxt;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPRcvMapAdd(struct tcp_recv_vars *rcvvar, uint32_t rcv_nxt, 
+		uint32_t ssn, uint32_t dsn, uint16_t len)
+{
+	struct mptcp_rcv_maps *rm = rcvvar->mptcp_maps;
+	int i;
+
+	if (!rm) {
+		rm = rcvvar->mptcp_maps = 
+			(struct mptcp_rcv_maps *)calloc(1, sizeof(struct mptcp_rcv_maps));
+		if (!rm)
+			return -1;
+	}
+
+	/* forget mappings whose data is all in; a repeated one is replaced */
+	i = 0;
+	while (i < rm->cnt) {
+		if (TCP_SEQ_LEQ(rm->ssn[i] + rm->len[i], rcv_nxt) || rm->ssn[i] == ssn) {
+			rm->cnt--;
+			rm->ssn[i] = rm->ssn[rm->cnt];
+			rm->dsn[i] = rm->dsn[rm->cnt];
+			rm->len[i] = rm->len[rm->cnt];
+			continue;
+		}
+		i++;
+	}
+
+	/* out of slots: the segment is not taken, the peer retransmits it */
+	if (rm->cnt == MPTCP_MAX_RCV_MAPS)
+		return -1;
+
+	rm->ssn[rm->cnt] = ssn;
+	rm->dsn[rm->cnt] = dsn;
+	rm->len[rm->cnt] = len;
+	rm->cnt++;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPRcvMapLookup(struct tcp_recv_vars *rcvvar, uint32_t seq, 
+		uint32_t *dsn, uint32_t *len)
+{
+	struct mptcp_rcv_maps *rm = rcvvar->mptcp_maps;
+	int i;
+
+	if (!rm)
+		return -1;
+
+	for (i = 0; i < rm->cnt; i++) {
+		if (TCP_SEQ_GEQ(seq, rm->ssn[i]) && 
+				TCP_SEQ_LT(seq, rm->ssn[i] + rm->len[i])) {
+			*dsn = rm->dsn[i] + (seq - rm->ssn[i]);
+			*len = rm->ssn[i] + rm->len[i] - seq;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+MPTCPReinjectRemove(struct mptcp_reinject_queue *rq, int i)
+{
+	for (rq->cnt--; i < rq->cnt; i++) {
+		rq->seq[i] = rq->seq[i + 1];
+		rq->end[i] = rq->end[i + 1];
+		rq->from[i] = rq->from[i + 1];
+	}
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPReinjectAdd(mptcp_cb *mpcb, uint32_t seq, uint32_t end, uint8_t from)
+{
+	struct mptcp_reinject_queue *rq = &mpcb->reinject;
+	uint32_t una = mpcb->mpcb_stream->sndvar->snd_una;
+	int i, j;
+
+	if (TCP_SEQ_LT(seq, una))
+		seq = una;
+	if (!TCP_SEQ_LT(seq, end))
+		return;
+
+	for (i = 0; i < rq->cnt; i++) {
+		if (TCP_SEQ_LT(end, rq->seq[i]))
+			break;
+		if (TCP_SEQ_LEQ(seq, rq->end[i]))
+			goto merge;
+	}
+
+	if (rq->cnt == MPTCP_MAX_REINJECT_RANGES) {
+		/* out of slots: grow a neighbour over the gap instead, resending */
+		/* a few bytes twice beats losing the range with a dead subflow    */
+		if (i > 0)
+			i--;
+		goto merge;
+	}
+
+	for (j = rq->cnt; j > i; j--) {
+		rq->seq[j] = rq->seq[j - 1];
+		rq->end[j] = rq->end[j - 1];
+		rq->from[j] = rq->from[j - 1];
+	}
+	rq->seq[i] = seq;
+	rq->end[i] = end;
+	rq->from[i] = from;
+	rq->cnt++;
+	return;
+
+merge:
+	if (TCP_SEQ_LT(seq, rq->seq[i]))
+		rq->seq[i] = seq;
+	if (TCP_SEQ_GT(end, rq->end[i]))
+		rq->end[i] = end;
+	while (i + 1 < rq->cnt && TCP_SEQ_LEQ(rq->seq[i + 1], rq->end[i])) {
+		if (TCP_SEQ_GT(rq->end[i + 1], rq->end[i]))
+			rq->end[i] = rq->end[i + 1];
+		MPTCPReinjectRemove(rq, i + 1);
+	}
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPReinjectPeek(mptcp_cb *mpcb, uint32_t *dsn, uint32_t *len, uint8_t *from)
+{
+	struct mptcp_reinject_queue *rq = &mpcb->reinject;
+	uint32_t una = mpcb->mpcb_stream->sndvar->snd_una;
+
+	/* drop what got DATA_ACKed in the meantime */
+	while (rq->cnt > 0 && TCP_SEQ_LEQ(rq->end[0], una))
+		MPTCPReinjectRemove(rq, 0);
+	if (rq->cnt == 0)
+		return -1;
+
+	if (TCP_SEQ_LT(rq->seq[0], una))
+		rq->seq[0] = una;
+	*dsn = rq->seq[0];
+	*len = rq->end[0] - rq->seq[0];
+	*from = rq->from[0];
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPReinjectConsume(mptcp_cb *mpcb, uint32_t len)
+{
+	struct mptcp_reinject_queue *rq = &mpcb->reinject;
+
+	rq->seq[0] += len;
+	if (!TCP_SEQ_LT(rq->seq[0], rq->end[0]))
+		MPTCPReinjectRemove(rq, 0);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPReinjectSubflow(mtcp_manager_t mtcp, tcp_stream *sf)
+{
+	mptcp_cb *mpcb = sf->mptcp_cb;
+	struct mptcp_map_queue *mq = sf->sndvar->dss_maps;
+	struct mptcp_dss_map *map;
+	tcp_stream *meta;
+	uint32_t i, skip;
+	uint8_t id;
+
+	if (!mpcb || !mpcb->mpcb_stream || !mq || mq->cnt == 0 || 
+			mpcb->num_subflows < 2 || sf->sndvar->mptcp_sf_idx == 0) {
+		return;
+	}
+	meta = mpcb->mpcb_stream;
+	id = mpcb->subflows[sf->sndvar->mptcp_sf_idx - 1].id;
+
+	/* bytes acked on the subflow reached the peer, the rest may not */
+	for (i = 0; i < mq->cnt; i++) {
+		map = MPTCPMapAt(mq, i);
+		skip = (i == 0) ? mq->head_seq - map->ssn : 0;
+		MPTCPReinjectAdd(mpcb, map->dsn + skip, map->dsn + map->len, id);
+	}
+
+	TRACE_DBG("Stream %d: reinjecting %u bytes of subflow %d\n", 
+			meta->id, mq->len, sf->id);
+	if (mpcb->reinject.cnt > 0 && meta->sndvar->sndbuf)
+		AddtoSendList(mtcp, meta);
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPOpportunisticReinject(mptcp_cb *mpcb, uint32_t cur_ts)
+{
+	struct tcp_send_vars *sndvar;
+	struct mptcp_map_queue *mq;
+	struct mptcp_dss_map *map;
+	struct mptcp_subflow *e;
+	uint32_t una = mpcb->mpcb_stream->sndvar->snd_una;
+	uint32_t dsn;
+	int i;
+
+	if (mpcb->num_subflows < 2)
+		return FALSE;
+
+	/* find the subflow whose oldest mapping holds the DATA_ACK back */
+	for (i = 0; i < mpcb->num_subflows; i++) {
+		e = &mpcb->subflows[i];
+		mq = e->stream->sndvar->dss_maps;
+		if (!mq || mq->cnt == 0)
+			continue;
+		map = MPTCPMapAt(mq, 0);
+		dsn = map->dsn + (mq->head_seq - map->ssn);
+		if (TCP_SEQ_LEQ(dsn, una) && TCP_SEQ_LT(una, map->dsn + map->len))
+			break;
+	}
+	if (i == mpcb->num_subflows)
+		return FALSE;
+
+	/* once per RTT of the slow subflow, as its cwnd reacts no faster */
+	sndvar = e->stream->sndvar;
+	if (cur_ts - e->penalized_ts < (e->stream->rcvvar->srtt >> 3))
+		return FALSE;
+	e->penalized_ts = cur_ts;
+
+	sndvar->cwnd = MAX(sndvar->cwnd >> 1, sndvar->mss);
+	sndvar->ssthresh = MAX(sndvar->cwnd, 2 * sndvar->mss);
+	TRACE_CONG("Stream %d: holds back the MPTCP window, cwnd: %u\n", 
+			e->stream->id, sndvar->cwnd);
+
+	MPTCPReinjectAdd(mpcb, una, map->dsn + map->len, e->id);
+
+	return TRUE;
+}
+/*----------------------------------------------------------------------------*/
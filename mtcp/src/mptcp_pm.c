@@ -0,0 +1,503 @@
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "mptcp_pm.h"
+#include "mptcp_token.h"
+#include "tcp_in.h"
+#include "tcp_out.h"
+#include "tcp_stream_queue.h"
+#include "addr_pool.h"
+#include "config.h"
+#include "debug.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a)<(b)?(a):(b))
+#endif
+
+/* a path that went down is tried again after a second, doubling on every */
+/* failed open up to about a minute                                        */
+#define MPTCP_PM_RETRY_TS		SEC_TO_TS(1)
+#define MPTCP_PM_RETRY_MAX_SHIFT	6
+
+/* an ADD_ADDR goes out again every second until it is echoed, a few times */
+#define MPTCP_PM_ANNOUNCE_TS		SEC_TO_TS(1)
+#define MPTCP_PM_ANNOUNCE_TRIES		3
+
+static const char *pm_names[MPTCP_PM_NUM] = {
+	[MPTCP_PM_NONE] = "none",
+	[MPTCP_PM_FULLMESH] = "fullmesh",
+	[MPTCP_PM_NDIFFPORTS] = "ndiffports",
+};
+/*----------------------------------------------------------------------------*/
+int
+MPTCPPMGetMode(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MPTCP_PM_NUM; i++) {
+		if (strcmp(name, pm_names[i]) == 0)
+			return i;
+	}
+
+	return -1;
+}
+/*----------------------------------------------------------------------------*/
+const char *
+MPTCPPMGetName(int mode)
+{
+	if (mode < 0 || mode >= MPTCP_PM_NUM)
+		return "unknown";
+
+	return pm_names[mode];
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPPMIsBackupAddr(uint32_t saddr)
+{
+	int i;
+
+	for (i = 0; i < CONFIG.eths_num; i++) {
+		if (CONFIG.eths[i].ip_addr == saddr)
+			return CONFIG.eths[i].mptcp_backup;
+	}
+
+	return FALSE;
+}
+/*----------------------------------------------------------------------------*/
+static inline struct mptcp_addr *
+MPTCPPMFindAddr(struct mptcp_addr *tbl, uint8_t num, uint8_t id)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (tbl[i].id == id)
+			return &tbl[i];
+	}
+
+	return NULL;
+}
+/*----------------------------------------------------------------------------*/
+/* the entry of id, added if it is new; NULL if the table is full          */
+static inline struct mptcp_addr *
+MPTCPPMSetAddr(struct mptcp_addr *tbl, uint8_t *num, uint8_t id, 
+		uint32_t addr, uint16_t port)
+{
+	struct mptcp_addr *a;
+
+	a = MPTCPPMFindAddr(tbl, *num, id);
+	if (!a) {
+		if (*num >= MPTCP_PM_MAX_ADDRS)
+			return NULL;
+		a = &tbl[(*num)++];
+	}
+
+	memset(a, 0, sizeof(struct mptcp_addr));
+	a->id = id;
+	a->addr = addr;
+	a->port = port;
+
+	return a;
+}
+/*----------------------------------------------------------------------------*/
+uint8_t
+MPTCPPMLocalAddrId(mptcp_cb *mpcb, uint32_t saddr)
+{
+	struct mptcp_addr *a;
+	int i;
+
+	a = MPTCPPMFindAddr(mpcb->pm.local, mpcb->pm.num_local, 0);
+	if (a && a->addr == saddr)
+		return 0;
+
+	for (i = 0; i < CONFIG.eths_num; i++) {
+		if (CONFIG.eths[i].ip_addr == saddr)
+			return i + 1;
+	}
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+MPTCPPMAddPath(mptcp_cb *mpcb, uint32_t saddr, 
+		uint32_t daddr, uint16_t dport, uint8_t rem_id, uint32_t cur_ts)
+{
+	struct mptcp_path *path;
+
+	if (mpcb->pm.num_paths >= MPTCP_PM_MAX_PATHS)
+		return;
+
+	path = &mpcb->pm.paths[mpcb->pm.num_paths++];
+	path->saddr = saddr;
+	path->daddr = daddr;
+	path->dport = dport;
+	path->rem_id = rem_id;
+	path->stream = NULL;
+	path->retries = 0;
+	path->retry_ts = cur_ts;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMInit(mptcp_cb *mpcb, tcp_stream *master, int active, uint32_t cur_ts)
+{
+	struct mptcp_addr *a;
+	int i;
+
+	mpcb->pm.active = active;
+	mpcb->pm.num_paths = 0;
+
+	MPTCPPMSetAddr(mpcb->pm.local, &mpcb->pm.num_local, 0, 
+			master->saddr, master->sport);
+	MPTCPPMSetAddr(mpcb->pm.remote, &mpcb->pm.num_remote, 0, 
+			master->daddr, master->dport);
+
+	switch (CONFIG.mptcp_pm) {
+	case MPTCP_PM_FULLMESH:
+		/* every other local address to the one the peer was reached on; */
+		/* the addresses it announces add their own paths                 */
+		for (i = 0; i < CONFIG.eths_num; i++) {
+			if (CONFIG.eths[i].ip_addr == master->saddr)
+				continue;
+			a = MPTCPPMSetAddr(mpcb->pm.local, &mpcb->pm.num_local, i + 1, 
+					CONFIG.eths[i].ip_addr, master->sport);
+			if (active) {
+				MPTCPPMAddPath(mpcb, CONFIG.eths[i].ip_addr, 
+						master->daddr, master->dport, 0, cur_ts);
+			} else if (a) {
+				/* the peer opens the joins, so tell it where to */
+				a->flags = MPTCP_ADDR_ANNOUNCE;
+				mpcb->pm.signal = TRUE;
+			}
+		}
+		break;
+	case MPTCP_PM_NDIFFPORTS:
+		if (!active)
+			break;
+		for (i = 1; i < CONFIG.mptcp_ndiffports; i++) {
+			MPTCPPMAddPath(mpcb, master->saddr, 
+					master->daddr, master->dport, 0, cur_ts);
+		}
+		break;
+	default:
+		break;
+	}
+
+	mpcb->pm.pending = (mpcb->pm.num_paths > 0);
+}
+/*----------------------------------------------------------------------------*/
+static inline addr_pool_t
+MPTCPPMGetAddressPool(mtcp_manager_t mtcp, uint32_t saddr)
+{
+	int i;
+
+	/* DestroyTCPStream gives the port back to the same pool */
+	if (mtcp->ap)
+		return mtcp->ap;
+
+	for (i = 0; i < CONFIG.eths_num; i++) {
+		if (CONFIG.eths[i].ip_addr == saddr)
+			return ap[i];
+	}
+
+	return NULL;
+}
+/*----------------------------------------------------------------------------*/
+static int
+MPTCPPMOpenPath(mtcp_manager_t mtcp, mptcp_cb *mpcb, struct mptcp_path *path)
+{
+	tcp_stream *master = mpcb->master;
+	tcp_stream *sf;
+	struct sockaddr_in daddr, saddr;
+	addr_pool_t pool;
+	int ret;
+
+	pool = MPTCPPMGetAddressPool(mtcp, path->saddr);
+	if (!pool)
+		return -1;
+
+	daddr.sin_family = AF_INET;
+	daddr.sin_addr.s_addr = path->daddr;
+	daddr.sin_port = path->dport;
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = path->saddr;
+	saddr.sin_port = INPORT_ANY;
+
+	/* a source port whose RSS hash brings the replies to this core */
+	if (FetchAddress(pool, mtcp->ctx->cpu, num_queues, &daddr, &saddr) < 0) {
+		TRACE_ERROR("Stream %d: no free port for an MPTCP subflow.\n",
+				master->id);
+		return -1;
+	}
+
+	sf = CreateTCPStream(mtcp, NULL, MTCP_SOCK_STREAM,
+			saddr.sin_addr.s_addr, saddr.sin_port,
+			daddr.sin_addr.s_addr, daddr.sin_port);
+	if (!sf) {
+		TRACE_ERROR("Failed to create mpjoin tcp_stream!\n");
+		FreeAddress(pool, &saddr);
+		return -1;
+	}
+	sf->is_bound_addr = TRUE;
+
+	if (MPTCPAttachSubflow(sf, mpcb) < 0) {
+		DestroyTCPStream(mtcp, sf);
+		return -1;
+	}
+	sf->isMPJOINStream = 1;
+	sf->socket = master->socket;
+
+	sf->sndvar->cwnd = 1;
+	sf->sndvar->ssthresh = sf->sndvar->mss * 10;
+	sf->state = TCP_ST_SYN_SENT;
+	TRACE_STATE("Stream %d: TCP_ST_SYN_SENT\n", sf->id);
+
+	SQ_LOCK(&mtcp->ctx->connect_lock);
+	ret = StreamEnqueue(mtcp->connectq, sf);
+	SQ_UNLOCK(&mtcp->ctx->connect_lock);
+	mtcp->wakeup_flag = TRUE;
+
+	if (ret < 0) {
+		TRACE_ERROR("mpjoin stream failed to enqueue to conenct queue!\n");
+		DestroyTCPStream(mtcp, sf);
+		return -1;
+	}
+
+	path->stream = sf;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+MPTCPPMBackoff(struct mptcp_path *path, uint32_t cur_ts)
+{
+	path->retry_ts = cur_ts +
+			(MPTCP_PM_RETRY_TS << MIN(path->retries, MPTCP_PM_RETRY_MAX_SHIFT));
+	if (path->retries < UINT8_MAX)
+		path->retries++;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMOpenPaths(mtcp_manager_t mtcp, mptcp_cb *mpcb, uint32_t cur_ts)
+{
+	struct mptcp_path *path;
+	int i;
+
+	/* joins only make sense while the connection itself is up */
+	if (!mpcb->pm.active || !mpcb->master ||
+			mpcb->master->state != TCP_ST_ESTABLISHED) {
+		return;
+	}
+
+	mpcb->pm.pending = FALSE;
+	for (i = 0; i < mpcb->pm.num_paths; i++) {
+		path = &mpcb->pm.paths[i];
+		if (path->stream)
+			continue;
+
+		if (TCP_SEQ_GEQ(cur_ts, path->retry_ts) &&
+				MPTCPPMOpenPath(mtcp, mpcb, path) == 0) {
+			continue;
+		}
+		if (TCP_SEQ_GEQ(cur_ts, path->retry_ts))
+			MPTCPPMBackoff(path, cur_ts);
+		mpcb->pm.pending = TRUE;
+	}
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMSubflowClosed(mtcp_manager_t mtcp, mptcp_cb *mpcb, tcp_stream *sf)
+{
+	struct mptcp_path *path;
+	int i;
+
+	for (i = 0; i < mpcb->pm.num_paths; i++) {
+		path = &mpcb->pm.paths[i];
+		if (path->stream != sf)
+			continue;
+
+		path->stream = NULL;
+		/* a subflow whose SYN got acked was up, start the backoff over */
+		if (TCP_SEQ_GT(sf->sndvar->snd_una, sf->sndvar->iss))
+			path->retries = 0;
+		MPTCPPMBackoff(path, mtcp->cur_ts);
+		mpcb->pm.pending = TRUE;
+		return;
+	}
+
+	/* a subflow the peer joined to one of our addresses timed out: */
+	/* withdraw the address so it stops joining there               */
+	if (!mpcb->pm.active && sf->close_reason == TCP_CONN_LOST)
+		MPTCPPMWithdrawAddr(mpcb, sf->saddr);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMWithdrawAddr(mptcp_cb *mpcb, uint32_t saddr)
+{
+	struct mptcp_addr *a;
+	int i;
+
+	for (i = 0; i < mpcb->pm.num_local; i++) {
+		a = &mpcb->pm.local[i];
+		/* the initial subflow's address goes with the connection */
+		if (a->addr != saddr || a->id == 0)
+			continue;
+
+		a->flags = MPTCP_ADDR_REMOVE;
+		mpcb->pm.signal = TRUE;
+		TRACE_DBG("MPTCP: withdrawing local address id %u.\n", a->id);
+		return;
+	}
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMAddAddr(mtcp_manager_t mtcp, mptcp_cb *mpcb, 
+		const struct tcp_options *opts, uint32_t cur_ts)
+{
+	struct mptcp_addr *a, *first;
+	uint16_t port;
+	int i, known;
+
+	a = MPTCPPMFindAddr(opts->add_addr_echo ? mpcb->pm.local : mpcb->pm.remote, 
+			opts->add_addr_echo ? mpcb->pm.num_local : mpcb->pm.num_remote, 
+			opts->add_addr_id);
+
+	if (opts->add_addr_echo) {
+		if (a && a->addr == opts->add_addr)
+			a->flags &= ~MPTCP_ADDR_ANNOUNCE;
+		return;
+	}
+
+#if TCP_MPTCP_VERSION != 0
+	/* keyed with the peer's key first, the way it made the MAC */
+	if (MPTCPAddAddrHmac(&mpcb->peer_join_hmac, opts->add_addr_id, 
+				opts->add_addr, opts->add_port) != opts->add_addr_hmac) {
+		TRACE_DBG("MPTCP: ADD_ADDR id %u with a bad HMAC.\n", 
+				opts->add_addr_id);
+		return;
+	}
+#endif
+
+	/* a retransmission only needs another echo; an id that moved to */
+	/* another address loses its old paths first                      */
+	known = (a && a->addr == opts->add_addr);
+	if (a && !known)
+		MPTCPPMRemoveAddr(mtcp, mpcb, opts->add_addr_id);
+
+	first = MPTCPPMFindAddr(mpcb->pm.remote, mpcb->pm.num_remote, 0);
+	port = opts->add_port ? opts->add_port : (first ? first->port : 0);
+	a = MPTCPPMSetAddr(mpcb->pm.remote, &mpcb->pm.num_remote, 
+			opts->add_addr_id, opts->add_addr, port);
+	if (!a)
+		return;
+#if TCP_MPTCP_VERSION != 0
+	a->flags = MPTCP_ADDR_ECHO;
+	mpcb->pm.signal = TRUE;
+#endif
+
+	if (known || !port || !mpcb->pm.active || 
+			CONFIG.mptcp_pm != MPTCP_PM_FULLMESH)
+		return;
+
+	/* a path from every local address to the new one */
+	for (i = 0; i < mpcb->pm.num_local; i++) {
+		MPTCPPMAddPath(mpcb, mpcb->pm.local[i].addr, 
+				a->addr, a->port, a->id, cur_ts);
+		mpcb->pm.pending = TRUE;
+	}
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMRemoveAddr(mtcp_manager_t mtcp, mptcp_cb *mpcb, uint8_t id)
+{
+	struct mptcp_addr *a;
+	tcp_stream *sf;
+	uint32_t addr;
+	int i;
+
+	a = MPTCPPMFindAddr(mpcb->pm.remote, mpcb->pm.num_remote, id);
+	if (!a)
+		return;
+	addr = a->addr;
+	*a = mpcb->pm.remote[--mpcb->pm.num_remote];
+
+	/* the paths go first, so closing their subflows does not queue */
+	/* them for another open                                         */
+	for (i = 0; i < mpcb->pm.num_paths; ) {
+		if (mpcb->pm.paths[i].daddr == addr)
+			mpcb->pm.paths[i] = mpcb->pm.paths[--mpcb->pm.num_paths];
+		else
+			i++;
+	}
+
+	/* the initial subflow carries the socket and stays */
+	for (i = 0; i < mpcb->num_subflows; i++) {
+		sf = mpcb->subflows[i].stream;
+		if (sf->daddr != addr || sf == mpcb->master || 
+				sf->state == TCP_ST_CLOSED)
+			continue;
+
+		TRACE_DBG("Stream %d: peer removed its address id %u.\n", sf->id, id);
+		sf->state = TCP_ST_CLOSED;
+		sf->close_reason = TCP_RESET;
+		TRACE_STATE("Stream %d: TCP_ST_CLOSED\n", sf->id);
+		AddtoControlList(mtcp, sf, mtcp->cur_ts);
+	}
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPPMJoinAddr(mptcp_cb *mpcb, uint8_t id, uint32_t daddr)
+{
+	struct mptcp_addr *a;
+
+	a = MPTCPPMFindAddr(mpcb->pm.remote, mpcb->pm.num_remote, id);
+	if (!a || a->addr != daddr)
+		MPTCPPMSetAddr(mpcb->pm.remote, &mpcb->pm.num_remote, id, daddr, 0);
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPPMGetSignal(mptcp_cb *mpcb, uint32_t cur_ts, struct mptcp_addr *out)
+{
+	struct mptcp_addr *a;
+	int i, waiting = FALSE;
+
+	if (!mpcb->pm.signal)
+		return MPTCP_SIG_NONE;
+
+	for (i = 0; i < mpcb->pm.num_remote; i++) {
+		a = &mpcb->pm.remote[i];
+		if (a->flags & MPTCP_ADDR_ECHO) {
+			a->flags &= ~MPTCP_ADDR_ECHO;
+			*out = *a;
+			return MPTCP_SIG_ADD_ADDR_ECHO;
+		}
+	}
+
+	for (i = 0; i < mpcb->pm.num_local; i++) {
+		a = &mpcb->pm.local[i];
+		if (a->flags & MPTCP_ADDR_REMOVE) {
+			*out = *a;
+			*a = mpcb->pm.local[--mpcb->pm.num_local];
+			return MPTCP_SIG_REMOVE_ADDR;
+		}
+		if (!(a->flags & MPTCP_ADDR_ANNOUNCE))
+			continue;
+
+		if (a->tries >= MPTCP_PM_ANNOUNCE_TRIES) {
+			a->flags &= ~MPTCP_ADDR_ANNOUNCE;
+			continue;
+		}
+		if (a->tries == 0 || 
+				TCP_SEQ_GEQ(cur_ts, a->ts + MPTCP_PM_ANNOUNCE_TS)) {
+			a->tries++;
+			a->ts = cur_ts;
+			*out = *a;
+			return MPTCP_SIG_ADD_ADDR;
+		}
+		waiting = TRUE;
+	}
+
+	/* only unechoed ADD_ADDRs waiting for their next try are left */
+	mpcb->pm.signal = waiting;
+	return MPTCP_SIG_NONE;
+}
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "mptcp_sched.h"
+#include "mptcp_map.h"
+#include "socket.h"
+#include "tcp_in.h"
+#include "debug.h"
+
+#ifndef MAX
+#define MAX(a, b) ((a)>(b)?(a):(b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a)<(b)?(a):(b))
+#endif
+
+/*----------------------------------------------------------------------------*/
+uint32_t
+MPTCPSubflowSendSpace(tcp_stream *sf)
+{
+	struct tcp_send_vars *sndvar = sf->sndvar;
+	int32_t space;
+
+	if (sf->state != TCP_ST_ESTABLISHED || sndvar->on_control_list)
+		return 0;
+
+	/* let rewound (retransmit) data drain first; also need a free map slot */
+	if (sndvar->dss_maps && (sf->snd_nxt != MPTCP_MAP_END(sndvar->dss_maps) || 
+				MPTCP_MAP_FULL(sndvar->dss_maps)))
+		return 0;
+
+	space = MIN(sndvar->cwnd, sndvar->peer_wnd) - (sf->snd_nxt - sndvar->snd_una);
+	if (space <= 0 || 
+			(space < sndvar->mss && sf->snd_nxt != sndvar->snd_una))
+		return 0;
+
+	return space > 0 ? space : 0;
+}
+/*----------------------------------------------------------------------------*/
+/* backups carry data only while no regular subflow is established and not  */
+/* stalled; a regular one that merely has a full cwnd keeps them idle        */
+static inline int
+MPTCPBackupsActive(mptcp_cb *mpcb)
+{
+	struct mptcp_subflow *e;
+	int i;
+
+	for (i = 0; i < mpcb->num_subflows; i++) {
+		e = &mpcb->subflows[i];
+		if (!e->backup && !e->stalled && 
+				e->stream->state == TCP_ST_ESTABLISHED)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+static inline int
+MPTCPSubflowUsable(struct mptcp_subflow *e, int backups)
+{
+	return !e->stalled && (!e->backup || backups);
+}
+/*----------------------------------------------------------------------------*/
+/* MinRTT: lowest smoothed RTT among the usable subflows that have room in   */
+/* cwnd; equal RTTs go to the one with less in flight                        */
+/*----------------------------------------------------------------------------*/
+static int
+MinRTTGetSubflows(mptcp_cb *mpcb, tcp_stream **subflows, int max)
+{
+	struct mptcp_subflow *e, *best = NULL;
+	uint32_t srtt, best_srtt = UINT32_MAX;
+	int i, backups;
+
+	backups = MPTCPBackupsActive(mpcb);
+	for (i = 0; i < mpcb->num_subflows; i++) {
+		e = &mpcb->subflows[i];
+		if (!MPTCPSubflowUsable(e, backups))
+			continue;
+
+		/* subflows without an RTT sample rank after the measured ones */
+		srtt = e->srtt ? e->srtt : UINT32_MAX - 1;
+		if (best && (srtt > best_srtt || 
+				(srtt == best_srtt && e->inflight >= best->inflight)))
+			continue;
+		if (!MPTCPSubflowSendSpace(e->stream))
+			continue;
+
+		best = e;
+		best_srtt = srtt;
+	}
+
+	if (!best || max < 1)
+		return 0;
+
+	subflows[0] = best->stream;
+	return 1;
+}
+/*----------------------------------------------------------------------------*/
+/* RoundRobin: each usable subflow sends rr_weight[id] mappings per turn; a  */
+/* subflow with no room in its window loses the rest of its turn             */
+/*----------------------------------------------------------------------------*/
+static int
+RoundRobinGetSubflows(mptcp_cb *mpcb, tcp_stream **subflows, int max)
+{
+	struct mptcp_subflow *e;
+	int tries, backups;
+
+	if (mpcb->num_subflows == 0 || max < 1)
+		return 0;
+
+	backups = MPTCPBackupsActive(mpcb);
+	for (tries = 0; tries < mpcb->num_subflows; tries++) {
+		if (mpcb->rr_idx >= mpcb->num_subflows)
+			mpcb->rr_idx = 0;
+		e = &mpcb->subflows[mpcb->rr_idx];
+		if (mpcb->rr_quota == 0)
+			mpcb->rr_quota = MAX(mpcb->rr_weight[e->id], 1);
+
+		if (MPTCPSubflowUsable(e, backups) && MPTCPSubflowSendSpace(e->stream)) {
+			if (--mpcb->rr_quota == 0)
+				mpcb->rr_idx++;
+			subflows[0] = e->stream;
+			return 1;
+		}
+
+		mpcb->rr_idx++;
+		mpcb->rr_quota = 0;
+	}
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+/* Redundant: the same mapping goes out on every usable subflow with room    */
+/*----------------------------------------------------------------------------*/
+static int
+RedundantGetSubflows(mptcp_cb *mpcb, tcp_stream **subflows, int max)
+{
+	struct mptcp_subflow *e;
+	int i, backups, cnt = 0;
+
+	backups = MPTCPBackupsActive(mpcb);
+	for (i = 0; i < mpcb->num_subflows && cnt < max; i++) {
+		e = &mpcb->subflows[i];
+		if (MPTCPSubflowUsable(e, backups) && MPTCPSubflowSendSpace(e->stream))
+			subflows[cnt++] = e->stream;
+	}
+
+	return cnt;
+}
+/*----------------------------------------------------------------------------*/
+tcp_stream *
+MPTCPReinjectGetSubflow(mptcp_cb *mpcb, uint8_t from)
+{
+	struct mptcp_subflow *e, *best = NULL;
+	uint32_t srtt, best_srtt = UINT32_MAX;
+	int i, backups;
+
+	backups = MPTCPBackupsActive(mpcb);
+	for (i = 0; i < mpcb->num_subflows; i++) {
+		e = &mpcb->subflows[i];
+		/* a subflow in timeout recovery would only stall it again */
+		if (e->id == from || e->stream->sndvar->nrtx > 0 || 
+				!MPTCPSubflowUsable(e, backups))
+			continue;
+
+		srtt = e->srtt ? e->srtt : UINT32_MAX - 1;
+		if (best && srtt >= best_srtt)
+			continue;
+		if (!MPTCPSubflowSendSpace(e->stream))
+			continue;
+
+		best = e;
+		best_srtt = srtt;
+	}
+
+	return best ? best->stream : NULL;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPSubflowStall(tcp_stream *sf)
+{
+	struct mptcp_subflow *e;
+
+	if (!sf->mptcp_cb || sf->sndvar->mptcp_sf_idx == 0)
+		return FALSE;
+
+	e = &sf->mptcp_cb->subflows[sf->sndvar->mptcp_sf_idx - 1];
+	if (e->stalled)
+		return FALSE;
+
+	e->stalled = TRUE;
+	if (!e->backup && MPTCPBackupsActive(sf->mptcp_cb)) {
+		TRACE_INFO("Stream %d: no regular MPTCP subflow left, "
+				"failing over to the backups.\n", sf->id);
+	}
+
+	return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSubflowSetBackup(tcp_stream *sf, uint8_t who, int backup)
+{
+	struct mptcp_subflow *e;
+
+	if (!sf->mptcp_cb || sf->sndvar->mptcp_sf_idx == 0)
+		return;
+
+	e = &sf->mptcp_cb->subflows[sf->sndvar->mptcp_sf_idx - 1];
+	if (backup)
+		e->backup |= who;
+	else
+		e->backup &= ~who;
+	TRACE_DBG("Stream %d: MPTCP subflow priority %s.\n", sf->id, 
+			e->backup ? "backup" : "regular");
+}
+/*----------------------------------------------------------------------------*/
+static const struct mptcp_sched_ops mptcp_scheds[MPTCP_SCHED_NUM] = {
+	[MPTCP_SCHED_MINRTT]		= { "minrtt",		MinRTTGetSubflows },
+	[MPTCP_SCHED_ROUNDROBIN]	= { "roundrobin",	RoundRobinGetSubflows },
+	[MPTCP_SCHED_REDUNDANT]		= { "redundant",	RedundantGetSubflows },
+};
+/*----------------------------------------------------------------------------*/
+int
+MPTCPSetScheduler(mptcp_cb *mpcb, int type)
+{
+	if (type < 0 || type >= MPTCP_SCHED_NUM)
+		return -1;
+
+	mpcb->sched = &mptcp_scheds[type];
+	mpcb->rr_idx = 0;
+	mpcb->rr_quota = 0;
+	TRACE_DBG("MPTCP scheduler set to %s\n", mpcb->sched->name);
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPSetSchedWeights(mptcp_cb *mpcb, const uint8_t *weights, int num)
+{
+	if (num <= 0 || num > MPTCP_MAX_SUBFLOWS)
+		return -1;
+
+	memcpy(mpcb->rr_weight, weights, num);
+	mpcb->rr_quota = 0;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSchedSync(mptcp_cb *mpcb, socket_map_t socket)
+{
+	uint8_t weight[MTCP_MPTCP_MAX_WEIGHTS];
+	uint32_t seq;
+	int sched, num;
+
+	seq = socket->mptcp_sched_seq;
+	if (seq == mpcb->sched_seq || (seq & 1))
+		return;
+	SchedMemoryBarrier();
+	sched = socket->mptcp_sched;
+	num = MIN(socket->mptcp_weight_num, MPTCP_MAX_SUBFLOWS);
+	memcpy(weight, socket->mptcp_weight, num);
+	SchedMemoryBarrier();
+	/* changed while we copied: the next flush tries again */
+	if (socket->mptcp_sched_seq != seq)
+		return;
+
+	mpcb->sched_seq = seq;
+	if (mpcb->sched != &mptcp_scheds[sched])
+		MPTCPSetScheduler(mpcb, sched);
+	if (num)
+		MPTCPSetSchedWeights(mpcb, weight, num);
+}
+/*----------------------------------------------------------------------------*/
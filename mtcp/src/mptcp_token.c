@@ -0,0 +1,247 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mptcp_token.h"
+#include "mptcp_sched.h"
+#include "mptcp_cc.h"
+#include "mptcp_pm.h"
+#include "mptcp_map.h"
+#include "mptcp_handoff.h"
+#include "mptcp_info.h"
+#include "tcp_util.h"
+#include "debug.h"
+
+/*----------------------------------------------------------------------------*/
+struct mptcp_token_table *
+MPTCPTokenTableCreate(int max_conns)
+{
+	struct mptcp_token_table *tt;
+	uint32_t slots = 1;
+
+	/* keep the load factor at or below one half */
+	while (slots < (uint32_t)max_conns * 2)
+		slots <<= 1;
+
+	tt = (struct mptcp_token_table *)calloc(1, sizeof(struct mptcp_token_table));
+	if (!tt) {
+		TRACE_ERROR("Failed to allocate MPTCP token table.\n");
+		return NULL;
+	}
+	tt->ents = (struct mptcp_token_entry *)
+		calloc(slots, sizeof(struct mptcp_token_entry));
+	if (!tt->ents) {
+		TRACE_ERROR("Failed to allocate MPTCP token table.\n");
+		free(tt);
+		return NULL;
+	}
+	tt->mask = slots - 1;
+
+	return tt;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPTokenTableDestroy(struct mptcp_token_table *tt)
+{
+	if (!tt)
+		return;
+
+	free(tt->ents);
+	free(tt);
+}
+/*----------------------------------------------------------------------------*/
+/* tokens are SHA-1 output already, the low bits are a fine index */
+static inline uint32_t
+MPTCPTokenFind(struct mptcp_token_table *tt, uint32_t token)
+{
+	uint32_t i = token & tt->mask;
+
+	while (tt->ents[i].mpcb && tt->ents[i].token != token)
+		i = (i + 1) & tt->mask;
+
+	return i;
+}
+/*----------------------------------------------------------------------------*/
+mptcp_cb *
+MPTCPTokenLookup(struct mptcp_token_table *tt, uint32_t token)
+{
+	return tt->ents[MPTCPTokenFind(tt, token)].mpcb;
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPTokenInsert(struct mptcp_token_table *tt, mptcp_cb *mpcb)
+{
+	uint32_t i;
+
+	/* one free slot always stays so that probing terminates */
+	if (tt->cnt >= tt->mask)
+		return -1;
+
+	i = MPTCPTokenFind(tt, mpcb->token);
+	if (tt->ents[i].mpcb)
+		return -1;
+
+	tt->ents[i].token = mpcb->token;
+	tt->ents[i].mpcb = mpcb;
+	tt->cnt++;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPTokenRemove(struct mptcp_token_table *tt, mptcp_cb *mpcb)
+{
+	uint32_t i, j, home;
+
+	i = MPTCPTokenFind(tt, mpcb->token);
+	if (tt->ents[i].mpcb != mpcb)
+		return;
+
+	/* shift back the entries of the run that probed past slot i */
+	j = i;
+	while (1) {
+		tt->ents[i].mpcb = NULL;
+		do {
+			j = (j + 1) & tt->mask;
+			if (!tt->ents[j].mpcb) {
+				tt->cnt--;
+				return;
+			}
+			home = tt->ents[j].token & tt->mask;
+		} while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+		tt->ents[i] = tt->ents[j];
+		i = j;
+	}
+}
+/*----------------------------------------------------------------------------*/
+mptcp_cb *
+MPTCPCreateCB(mtcp_manager_t mtcp, int sched)
+{
+	mptcp_cb *mpcb;
+	uint64_t key;
+	int i, tries;
+
+	mpcb = (mptcp_cb *)calloc(1, sizeof(mptcp_cb));
+	if (!mpcb) {
+		TRACE_ERROR("Failed to allocate mptcp_cb.\n");
+		return NULL;
+	}
+	MPTCPSetScheduler(mpcb, sched);
+
+	/* the token names the connection in MP_JOIN SYNs, so it must be */
+	/* unique among the connections of this core, and it must map to */
+	/* this core so that joins RSS sends elsewhere find their way    */
+	for (tries = 0; tries < MPTCP_KEY_GEN_TRIES * CONFIG.num_cores; tries++) {
+		key = 0;
+		for (i = 0; i < 8; ++i) {
+			key = (key << 8) | (rand() & 0xFF);
+		}
+		mpcb->myKey = key;
+		MPTCPKeyHash(key, &mpcb->token, &mpcb->my_idsn);
+		if (MPTCPTokenCore(mpcb->token) != mtcp->ctx->cpu)
+			continue;
+		mpcb->snd_una_dsn = mpcb->my_idsn + 1;
+		if (MPTCPTokenInsert(mtcp->mptcp_tokens, mpcb) == 0)
+			return mpcb;
+	}
+
+	TRACE_ERROR("Failed to find a free MPTCP token (%u in use).\n",
+			mtcp->mptcp_tokens->cnt);
+	free(mpcb);
+	return NULL;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPSetPeerKey(mptcp_cb *mpcb, uint64_t key)
+{
+	mpcb->peerKey = key;
+	MPTCPKeyHash(key, &mpcb->peer_token, &mpcb->peer_idsn);
+	mpcb->rcv_nxt_dsn = mpcb->peer_idsn + 1;
+	MPTCPJoinHmacInit(&mpcb->join_hmac, mpcb->myKey, key);
+	MPTCPJoinHmacInit(&mpcb->peer_join_hmac, key, mpcb->myKey);
+}
+/*----------------------------------------------------------------------------*/
+int
+MPTCPAttachSubflow(tcp_stream *sf, mptcp_cb *mpcb)
+{
+	struct mptcp_subflow *set, *e;
+	int size;
+
+	if (mpcb->num_subflows == mpcb->max_subflows) {
+		if (mpcb->max_subflows >= MPTCP_MAX_SUBFLOWS) {
+			TRACE_ERROR("Stream %d: MPTCP subflow set is full.\n", sf->id);
+			return -1;
+		}
+		size = mpcb->max_subflows ? mpcb->max_subflows * 2 : MPTCP_SUBFLOWS_INIT;
+		set = (struct mptcp_subflow *)
+			realloc(mpcb->subflows, size * sizeof(struct mptcp_subflow));
+		if (!set) {
+			TRACE_ERROR("Failed to grow MPTCP subflow set.\n");
+			return -1;
+		}
+		mpcb->subflows = set;
+		mpcb->max_subflows = size;
+	}
+
+	e = &mpcb->subflows[mpcb->num_subflows++];
+	memset(e, 0, sizeof(struct mptcp_subflow));
+	e->stream = sf;
+	e->id = mpcb->next_id++ % MPTCP_MAX_SUBFLOWS;
+	/* the peer learns it from the MP_JOIN B flag, or else an MP_PRIO */
+	if (MPTCPPMIsBackupAddr(sf->saddr)) {
+		e->backup = MPTCP_BACKUP_LOCAL;
+		e->send_prio = TRUE;
+	}
+
+	sf->mptcp_cb = mpcb;
+	sf->sndvar->mptcp_sf_idx = mpcb->num_subflows;
+	if (!mpcb->master)
+		mpcb->master = sf;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPDetachSubflow(mtcp_manager_t mtcp, tcp_stream *sf)
+{
+	mptcp_cb *mpcb = sf->mptcp_cb;
+	int idx = sf->sndvar->mptcp_sf_idx - 1;
+	int last;
+
+	if (!mpcb || idx < 0)
+		return;
+	last = mpcb->num_subflows - 1;
+
+	/* what it still had in flight goes out on the other subflows */
+	MPTCPReinjectSubflow(mtcp, sf);
+	MPTCPPMSubflowClosed(mtcp, mpcb, sf);
+	MPTCPCCRemoveSubflow(mpcb, idx);
+	if (idx != last) {
+		mpcb->subflows[idx] = mpcb->subflows[last];
+		mpcb->subflows[idx].stream->sndvar->mptcp_sf_idx = idx + 1;
+	}
+	mpcb->num_subflows--;
+	if (mpcb->rr_idx == last)
+		mpcb->rr_idx = idx;
+	/* while the master, and with it the socket, is still known */
+	MPTCPInfoPublish(mtcp, mpcb, TRUE);
+
+	sf->sndvar->mptcp_sf_idx = 0;
+	sf->mptcp_cb = NULL;
+	if (mpcb->master == sf)
+		mpcb->master = NULL;
+
+	if (mpcb->num_subflows == 0)
+		MPTCPDestroyCB(mtcp, mpcb);
+}
+/*----------------------------------------------------------------------------*/
+void
+MPTCPDestroyCB(mtcp_manager_t mtcp, mptcp_cb *mpcb)
+{
+	MPTCPTokenRemove(mtcp->mptcp_tokens, mpcb);
+	if (mpcb->mpcb_stream)
+		DestroyMpcbTCPStream(mtcp, mpcb->mpcb_stream);
+	free(mpcb->subflows);
+	free(mpcb);
+}
+/*----------------------------------------------------------------------------*/
@@ -200,12 +200,14 @@ netmap_recv_pkts(struct mtcp_thread_context *ctxt, int ifidx)
 }
 /*----------------------------------------------------------------------------*/
 uint8_t *
-netmap_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len)
+netmap_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len, 
+		uint32_t *rxhash)
 {
 	struct netmap_private_context *npc;
 	npc = (struct netmap_private_context *)ctxt->io_private_context;
 
 	*len = npc->rcv_pkt_len[index];
+	*rxhash = 0;
 	return (unsigned char *)npc->rcv_pktbuf[index];
 }
 /*----------------------------------------------------------------------------*/
@@ -9,6 +9,8 @@
 #include "debug.h"
 /* for num_devices_* */
 #include "config.h"
+/* for SEC_TO_TS */
+#include "tcp_in.h"
 /* for rte_max_eth_ports */
 #include <rte_common.h>
 /* for rte_eth_rxconf */
@@ -211,7 +213,7 @@ onvm_send_pkts(struct mtcp_thread_context *ctxt, int nif)
 		mtcp->nstat.tx_packets[nif] += cnt;
 #ifdef ENABLE_STATS_IOCTL
 		/* only pass stats after >= 1 sec interval */
-		if (abs(mtcp->cur_ts - dpc->cur_ts) >= 1000 &&
+		if (abs(mtcp->cur_ts - dpc->cur_ts) >= SEC_TO_TS(1) &&
 		    likely(dpc->fd >= 0)) {
 			/* rte_get_stats is global func, use only for 1 core */
 			if (ctxt->cpu == 0) {
@@ -350,7 +352,8 @@ onvm_recv_pkts(struct mtcp_thread_context *ctxt, int ifidx)
 }
 /*----------------------------------------------------------------------------*/
 uint8_t *
-onvm_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len)
+onvm_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len, 
+	      uint32_t *rxhash)
 {
 	struct dpdk_private_context *dpc;
 	struct rte_mbuf *m;
@@ -361,6 +364,7 @@ onvm_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *
 	m = dpc->pkts_burst[index];
 	//rte_prefetch0(rte_pktmbuf_mtod(m, void *));
 	*len = m->pkt_len;
+	*rxhash = (m->ol_flags & PKT_RX_RSS_HASH) ? m->hash.rss : 0;
 	pktbuf = rte_pktmbuf_mtod(m, uint8_t *);
 
 	/* enqueue the pkt ptr in mbuf */
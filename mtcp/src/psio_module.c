@@ -275,7 +275,8 @@ psio_recv_pkts(struct mtcp_thread_context *ctxt, int ifidx)
 }
 /*----------------------------------------------------------------------------*/
 uint8_t *
-psio_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len)
+psio_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *len, 
+	      uint32_t *rxhash)
 {
 	struct psio_private_context *ppc;
 	uint8_t *pktbuf;
@@ -283,6 +284,7 @@ psio_get_rptr(struct mtcp_thread_context *ctxt, int ifidx, int index, uint16_t *
 	ppc = (struct psio_private_context *) ctxt->io_private_context;	
 	pktbuf = (uint8_t *)(ppc->chunk.buf + ppc->chunk.info[index].offset);
 	*len = ppc->chunk.info[index].len;
+	*rxhash = 0;
 
 	(void)(ifidx);
 	return pktbuf;
@@ -1,5 +1,6 @@
 #include "mtcp.h"
 #include "socket.h"
+#include "mptcp_info.h"
 #include "debug.h"
 
 /*---------------------------------------------------------------------------*/
@@ -39,6 +40,12 @@ AllocateSocket(mctx_t mctx, int socktype, int need_lock)
 	
 	socket->socktype = socktype;
 	socket->opts = 0;
+	socket->mptcp_sched = MPTCP_SCHED_MINRTT;
+	socket->mptcp_weight_num = 0;
+	socket->mptcp_sched_seq = 0;
+	/* the snapshot is reused, but not what the last connection left in it */
+	if (socket->mptcp_info)
+		socket->mptcp_info->seq = 0;
 	socket->stream = NULL;
 	socket->epoll = 0;
 	socket->events = 0;
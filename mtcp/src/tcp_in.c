@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <time.h>
 #include <inttypes.h>
+#include <string.h>
 #include <arpa/inet.h>
 
 #include "tcp_util.h"
@@ -13,6 +14,13 @@
 #include "ip_in.h"
 #include "clock.h"
 #include "mptcp.h"
+#include "mptcp_sched.h"
+#include "mptcp_map.h"
+#include "mptcp_cc.h"
+#include "mptcp_token.h"
+#include "mptcp_pm.h"
+#include "mptcp_handoff.h"
+#include "mptcp_info.h"
 #include "config.h"
 #include "mtcp.h"
 
@@ -27,9 +35,6 @@
 #define RECOVERY_AFTER_LOSS TRUE
 #define SELECTIVE_WRITE_EVENT_NOTIFY TRUE
 
-static inline
-int CopyFromSubflowToMpcb(mtcp_manager_t mtcp, tcp_stream *mpcb_stream, tcp_stream *subflow_stream, uint32_t subflow_seq, int payloadlen, uint32_t data_seq);
-
 /*----------------------------------------------------------------------------*/
 static inline int 
 FilterSYNPacket(mtcp_manager_t mtcp, uint32_t ip, uint16_t port)
@@ -68,7 +73,8 @@ FilterSYNPacket(mtcp_manager_t mtcp, uint32_t ip, uint16_t port)
 /*----------------------------------------------------------------------------*/
 static inline tcp_stream *
 HandlePassiveOpen(mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *iph, 
-		const struct tcphdr *tcph, uint32_t seq, uint16_t window)
+		const struct tcphdr *tcph, const struct tcp_options *opts, 
+		uint32_t seq, uint16_t window)
 {
 	tcp_stream *cur_stream = NULL;
 
@@ -83,15 +89,15 @@ HandlePassiveOpen(mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *iph,
 	cur_stream->sndvar->peer_wnd = window;
 	cur_stream->rcv_nxt = cur_stream->rcvvar->irs;
 	cur_stream->sndvar->cwnd = 1;
-	ParseTCPOptions(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, 
-			(tcph->doff << 2) - TCP_HEADER_LEN);
+	SetTCPOptions(cur_stream, cur_ts, opts);
 
 	return cur_stream;
 }
 /*----------------------------------------------------------------------------*/
 static inline int
 HandleActiveOpen(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts, 
-		struct tcphdr *tcph, uint32_t seq, uint32_t ack_seq, uint16_t window)
+		struct tcphdr *tcph, const struct tcp_options *opts, 
+		uint32_t seq, uint32_t ack_seq, uint16_t window)
 {
 	cur_stream->rcvvar->irs = seq;
 	cur_stream->snd_nxt = ack_seq;
@@ -99,8 +105,7 @@ HandleActiveOpen(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 	cur_stream->rcvvar->snd_wl1 = cur_stream->rcvvar->irs - 1;
 	cur_stream->rcv_nxt = cur_stream->rcvvar->irs + 1;
 	cur_stream->rcvvar->last_ack_seq = ack_seq;
-	ParseTCPOptions(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, 
-			(tcph->doff << 2) - TCP_HEADER_LEN);
+	SetTCPOptions(cur_stream, cur_ts, opts);
 	cur_stream->sndvar->cwnd = ((cur_stream->sndvar->cwnd == 1)? 
 			(cur_stream->sndvar->mss * TCP_INIT_CWND): cur_stream->sndvar->mss);
 	cur_stream->sndvar->ssthresh = cur_stream->sndvar->mss * 10;
@@ -114,20 +119,20 @@ HandleActiveOpen(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 static inline int
 ValidateSequence(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts, 
-		struct tcphdr *tcph, uint32_t seq, uint32_t ack_seq, int payloadlen)
+		struct tcphdr *tcph, const struct tcp_options *opts, 
+		uint32_t seq, uint32_t ack_seq, int payloadlen)
 {
 	/* Protect Against Wrapped Sequence number (PAWS) */
 	if (!tcph->rst && cur_stream->saw_timestamp) {
 		struct tcp_timestamp ts;
 		
-		if (!ParseTCPTimestamp(cur_stream, &ts, 
-				(uint8_t *)tcph + TCP_HEADER_LEN, 
-				(tcph->doff << 2) - TCP_HEADER_LEN)) {
+		if (!(opts->flags & TCP_OPT_FLAG_TIMESTAMP)) {
 			/* if there is no timestamp */
 			/* TODO: implement here */
 			TRACE_DBG("No timestamp found.\n");
 			return FALSE;
 		}
+		ts = opts->ts;
 
 		/* RFC1323: if SEG.TSval < TS.Recent, drop and send ack */
 		if (TCP_SEQ_LT(ts.ts_val, cur_stream->rcvvar->ts_recent)) {
@@ -263,8 +268,8 @@ inline void
 EstimateRTT(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t mrtt)
 {
 	/* This function should be called for not retransmitted packets */
-	/* TODO: determine tcp_rto_min */
-#define TCP_RTO_MIN 0
+	/* a floor under rttvar keeps sub-ms RTTs from firing spurious RTOs */
+#define TCP_RTO_MIN MSEC_TO_TS(1)
 	long m = mrtt;
 	uint32_t tcp_rto_min = TCP_RTO_MIN;
 	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
@@ -313,20 +318,98 @@ EstimateRTT(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t mrtt)
 			rcvvar->mdev_max, rcvvar->rttvar, rcvvar->rtt_seq);
 }
 
+#if TCP_OPT_SACK_ENABLED && !USE_CCP
+/*----------------------------------------------------------------------------*/
+/* SACKRecovery: RFC 6675 loss recovery for peers that SACK. It starts on   */
+/* the third duplicate ACK or once the scoreboard deems snd_una lost, and    */
+/* ends when the ACK covers what was sent before it started. snd_nxt is not  */
+/* rewound: SendSACKRetransmits() resends the lost holes as pipe allows      */
+/*----------------------------------------------------------------------------*/
+static inline void
+SACKRecovery(mtcp_manager_t mtcp, tcp_stream *cur_stream, 
+		uint32_t ack_seq, uint8_t dup)
+{
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+
+	if (sndvar->sack_recovery) {
+		if (TCP_SEQ_GEQ(ack_seq, sndvar->recovery_point)) {
+			sndvar->sack_recovery = FALSE;
+			sndvar->sack_rxt_una = FALSE;
+			sndvar->cwnd = sndvar->ssthresh;
+			TRACE_LOSS("SACK recovery done. ack_seq: %u, cwnd: %u\n", 
+					ack_seq, sndvar->cwnd);
+		} else {
+			/* a partial ACK: the holes left get resent */
+			if (TCP_SEQ_LT(sndvar->high_rxt, ack_seq))
+				sndvar->high_rxt = ack_seq;
+			AddtoSendList(mtcp, cur_stream);
+		}
+		return;
+	}
+
+	if (!TCP_SEQ_LT(ack_seq, cur_stream->snd_nxt) || 
+			TCP_SEQ_LT(ack_seq, sndvar->recovery_point))
+		return;
+	if (!(dup && cur_stream->rcvvar->dup_acks == TCP_DUPTHRESH) && 
+			!SACKIsLost(cur_stream, ack_seq))
+		return;
+
+	TRACE_LOSS("SACK recovery from %u to %u, %u bytes SACKed\n", 
+			ack_seq, cur_stream->snd_nxt, cur_stream->rcvvar->sacked_bytes);
+#if RTM_STAT
+	sndvar->rstat.tdp_ack_cnt++;
+	sndvar->rstat.tdp_ack_bytes += (cur_stream->snd_nxt - ack_seq);
+#endif
+	sndvar->sack_recovery = TRUE;
+	sndvar->recovery_point = cur_stream->snd_nxt;
+	sndvar->high_rxt = ack_seq;
+	/* RFC 6675 (4.3): snd_una goes out now, even if too little is SACKed */
+	/* above it for NextSeg to deem it lost                               */
+	sndvar->sack_rxt_una = TRUE;
+
+	if (MPTCP_CC_COUPLED(cur_stream))
+		sndvar->ssthresh = MPTCPCCSsthresh(cur_stream);
+	else
+		sndvar->ssthresh = MIN(sndvar->cwnd, sndvar->peer_wnd) / 2;
+	if (sndvar->ssthresh < 2 * sndvar->mss) {
+		sndvar->ssthresh = 2 * sndvar->mss;
+	}
+	sndvar->cwnd = sndvar->ssthresh;
+
+	if (sndvar->nrtx < TCP_MAX_RTX) {
+		sndvar->nrtx++;
+	}
+
+	AddtoSendList(mtcp, cur_stream);
+}
+#endif /* TCP_OPT_SACK_ENABLED && !USE_CCP */
 /*----------------------------------------------------------------------------*/
 static inline void
 ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts, 
-		struct tcphdr *tcph, uint32_t seq, uint32_t ack_seq, 
-		uint16_t window, int payloadlen)
+		struct tcphdr *tcph, const struct tcp_options *opts, 
+		uint32_t seq, uint32_t ack_seq, uint16_t window, int payloadlen)
 {
 	struct tcp_send_vars *sndvar = cur_stream->sndvar;
 	uint32_t cwindow, cwindow_prev;
 	uint32_t rmlen;
 	uint32_t snd_wnd_prev;
 	uint32_t right_wnd_edge;
+	uint32_t buf_head_seq, buf_len;
 	uint8_t dup;
 	int ret;
 
+	if (sndvar->sndbuf) {
+		buf_head_seq = sndvar->sndbuf->head_seq;
+		buf_len = sndvar->sndbuf->len;
+	} else {
+		/* MPTCP subflow: the payload lives in the meta send buffer */
+		MPTCPProcessDataAck(mtcp, cur_stream, opts, window);
+		if (!sndvar->dss_maps)
+			return;
+		buf_head_seq = sndvar->dss_maps->head_seq;
+		buf_len = sndvar->dss_maps->len;
+	}
+
 	cwindow = window;
 	if (!tcph->syn) {
 		cwindow = cwindow << sndvar->wscale_peer;
@@ -344,11 +427,11 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 		}
 	}
 	
-	if (TCP_SEQ_GT(ack_seq, sndvar->sndbuf->head_seq + sndvar->sndbuf->len)) {
+	if (TCP_SEQ_GT(ack_seq, buf_head_seq + buf_len)) {
 		TRACE_DBG("Stream %d (%s): invalid acknologement. "
 				"ack_seq: %u, possible max_ack_seq: %u\n", cur_stream->id, 
 				TCPStateToString(cur_stream), ack_seq, 
-				sndvar->sndbuf->head_seq + sndvar->sndbuf->len);
+				buf_head_seq + buf_len);
 		return;
 	}
 
@@ -420,6 +503,15 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 			  ack_seq-sndvar->iss, cur_stream->snd_nxt-sndvar->iss,
 			  sndvar->cwnd / sndvar->mss);
 	}
+#endif
+#if TCP_OPT_SACK_ENABLED
+	ParseSACKOption(cur_stream, ack_seq, opts);
+#endif /* TCP_OPT_SACK_ENABLED */
+
+#if TCP_OPT_SACK_ENABLED && !USE_CCP
+	if (cur_stream->sack_permit) {
+		SACKRecovery(mtcp, cur_stream, ack_seq, dup);
+	} else
 #endif
 	/* Fast retransmission */
 	if (dup && cur_stream->rcvvar->dup_acks == 3) {
@@ -438,6 +530,7 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 #if USE_CCP
 			ccp_record_event(mtcp, cur_stream, EVENT_TRI_DUPACK, ack_seq);
 #endif
+			CancelRTTSample(cur_stream);
 			if (ack_seq != sndvar->snd_una) {
 				TRACE_DBG("ack_seq and snd_una mismatch on tdp ack. "
 						"ack_seq: %u, snd_una: %u\n", 
@@ -452,7 +545,10 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 
 		/* update congestion control variables */
 		/* ssthresh to half of min of cwnd and peer wnd */
-		sndvar->ssthresh = MIN(sndvar->cwnd, sndvar->peer_wnd) / 2;
+		if (MPTCP_CC_COUPLED(cur_stream))
+			sndvar->ssthresh = MPTCPCCSsthresh(cur_stream);
+		else
+			sndvar->ssthresh = MIN(sndvar->cwnd, sndvar->peer_wnd) / 2;
 		if (sndvar->ssthresh < 2 * sndvar->mss) {
 			sndvar->ssthresh = 2 * sndvar->mss;
 		}
@@ -480,11 +576,6 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 		}
 	}
 
-#if TCP_OPT_SACK_ENABLED
-	ParseSACKOption(cur_stream, ack_seq, (uint8_t *)tcph + TCP_HEADER_LEN, 
-			(tcph->doff << 2) - TCP_HEADER_LEN);
-#endif /* TCP_OPT_SACK_ENABLED */
-
 #if RECOVERY_AFTER_LOSS
 #if USE_CCP
 	/* updating snd_nxt (when recovered from loss) */
@@ -512,9 +603,9 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 		cur_stream->snd_nxt = ack_seq;
 		TRACE_DBG("Sending again..., ack_seq=%u sndlen=%u cwnd=%u\n",
                         ack_seq-sndvar->iss,
-                        sndvar->sndbuf->len,
+                        buf_len,
                         sndvar->cwnd / sndvar->mss);
-		if (sndvar->sndbuf->len == 0) {
+		if (buf_len == 0) {
 			RemoveFromSendList(mtcp, cur_stream);
 		} else {
 			AddtoSendList(mtcp, cur_stream);
@@ -522,7 +613,7 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 	}
 #endif /* RECOVERY_AFTER_LOSS */
 
-	rmlen = ack_seq - sndvar->sndbuf->head_seq;
+	rmlen = ack_seq - buf_head_seq;
 	uint16_t packets = rmlen / sndvar->eff_mss;
 	if (packets * sndvar->eff_mss > rmlen) {
 		packets++;
@@ -535,7 +626,7 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 #endif
 
 	/* If ack_seq is previously acked, return */
-	if (TCP_SEQ_GEQ(sndvar->sndbuf->head_seq, ack_seq)) {
+	if (TCP_SEQ_GEQ(buf_head_seq, ack_seq)) {
 		return;
 	}
 
@@ -543,26 +634,35 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 	if (rmlen > 0) {
 		/* Routine goes here only if there is new payload (not retransmitted) */
 		
-		/* Estimate RTT and calculate rto */
-		if (cur_stream->saw_timestamp) {
-			EstimateRTT(mtcp, cur_stream, 
-					cur_ts - cur_stream->rcvvar->ts_lastack_rcvd);
+		/* Estimate RTT and calculate rto: the timed segment gives a sample */
+		/* in clock ticks; the ms echo of the timestamp option only seeds it */
+		if (sndvar->rtt_timing && TCP_SEQ_GEQ(ack_seq, sndvar->rtt_end)) {
+			sndvar->rtt_timing = FALSE;
+			EstimateRTT(mtcp, cur_stream, cur_ts - sndvar->rtt_ts);
+			sndvar->rto = (cur_stream->rcvvar->srtt >> 3) + cur_stream->rcvvar->rttvar;
+			assert(sndvar->rto > 0);
+		} else if (cur_stream->saw_timestamp && cur_stream->rcvvar->srtt == 0) {
+			EstimateRTT(mtcp, cur_stream, MSEC_TO_TS(mtcp->cur_tsval - 
+					cur_stream->rcvvar->ts_lastack_rcvd));
 			sndvar->rto = (cur_stream->rcvvar->srtt >> 3) + cur_stream->rcvvar->rttvar;
 			assert(sndvar->rto > 0);
-		} else {
-			//TODO: Need to implement timestamp estimation without timestamp
-			TRACE_RTT("NOT IMPLEMENTED.\n");
 		}
 
 		// TODO CCP should comment this out? 
-		/* Update congestion control variables */
-		if (cur_stream->state >= TCP_ST_ESTABLISHED) {
+		/* Update congestion control variables; cwnd holds at ssthresh */
+		/* through SACK recovery */
+		if (cur_stream->state >= TCP_ST_ESTABLISHED && !sndvar->sack_recovery) {
+			if (MPTCP_CC_COUPLED(cur_stream))
+				MPTCPCCOnAck(cur_stream, rmlen);
+
 			if (sndvar->cwnd < sndvar->ssthresh) {
 				if ((sndvar->cwnd + sndvar->mss) > sndvar->cwnd) {
 					sndvar->cwnd += (sndvar->mss * packets);
 				}
 				TRACE_CONG("slow start cwnd: %u, ssthresh: %u\n", 
 						sndvar->cwnd, sndvar->ssthresh);
+			} else if (MPTCP_CC_COUPLED(cur_stream)) {
+				sndvar->cwnd = MPTCPCCCongAvoid(cur_stream, packets);
 			} else {
 				uint32_t new_cwnd = sndvar->cwnd + 
 						packets * sndvar->mss * sndvar->mss / 
@@ -575,28 +675,49 @@ ProcessACK(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts,
 			}
 		}
 
-		if (SBUF_LOCK(&sndvar->write_lock)) {
-			if (errno == EDEADLK)
-				perror("ProcessACK: write_lock blocked\n");
-			assert(0);
-		}
-		ret = SBRemove(mtcp->rbm_snd, sndvar->sndbuf, rmlen);
-		sndvar->snd_una = ack_seq;
-		snd_wnd_prev = sndvar->snd_wnd;
-		sndvar->snd_wnd = sndvar->sndbuf->size - sndvar->sndbuf->len;
+		if (!sndvar->sndbuf) {
+			/* MPTCP subflow: the meta buffer is trimmed once the */
+			/* DATA_ACK covers the data as well */
+			ret = MPTCPMapRemove(sndvar->dss_maps, rmlen);
+			sndvar->snd_una = ack_seq;
+			MPTCPSubflowRefresh(cur_stream);
+			MPTCPSubflowResume(cur_stream);
+			MPTCPReleaseMetaBuffer(mtcp, cur_stream->mptcp_cb);
+			UpdateRetransmissionTimer(mtcp, cur_stream, cur_ts);
+		} else {
+			if (SBUF_LOCK(&sndvar->write_lock)) {
+				if (errno == EDEADLK)
+					perror("ProcessACK: write_lock blocked\n");
+				assert(0);
+			}
+			ret = SBRemove(mtcp->rbm_snd, sndvar->sndbuf, rmlen);
+			sndvar->snd_una = ack_seq;
+			snd_wnd_prev = sndvar->snd_wnd;
+			sndvar->snd_wnd = sndvar->sndbuf->size - sndvar->sndbuf->len;
 
-		/* If there was no available sending window */
-		/* notify the newly available window to application */
+			/* If there was no available sending window */
+			/* notify the newly available window to application */
 #if SELECTIVE_WRITE_EVENT_NOTIFY
-		if (snd_wnd_prev <= 0) {
+			if (snd_wnd_prev <= 0) {
 #endif /* SELECTIVE_WRITE_EVENT_NOTIFY */
-			RaiseWriteEvent(mtcp, cur_stream);
+				RaiseWriteEvent(mtcp, cur_stream);
 #if SELECTIVE_WRITE_EVENT_NOTIFY
-		}
+			}
 #endif /* SELECTIVE_WRITE_EVENT_NOTIFY */
 
-		SBUF_UNLOCK(&sndvar->write_lock);
-		UpdateRetransmissionTimer(mtcp, cur_stream, cur_ts);
+			SBUF_UNLOCK(&sndvar->write_lock);
+			UpdateRetransmissionTimer(mtcp, cur_stream, cur_ts);
+		}
+
+		/* the subflow has window again; let the scheduler push meta data */
+		if (cur_stream->mptcp_cb && cur_stream->mptcp_cb->mpcb_stream && 
+				!IS_MPCB_STREAM(cur_stream)) {
+			tcp_stream *meta = cur_stream->mptcp_cb->mpcb_stream;
+			if (meta->sndvar->sndbuf && (cur_stream->mptcp_cb->reinject.cnt > 0 || 
+					TCP_SEQ_LT(meta->snd_nxt, meta->sndvar->sndbuf->head_seq + 
+					meta->sndvar->sndbuf->len)))
+				AddtoSendList(mtcp, meta);
+		}
 	}
 
 	UNUSED(ret);
@@ -665,6 +786,10 @@ ProcessTCPPayload(mtcp_manager_t mtcp, tcp_stream *cur_stream,
 
 	if (TCP_SEQ_LEQ(cur_stream->rcv_nxt, prev_rcv_nxt)) {
 		/* There are some lost packets */
+#if TCP_OPT_SACK_ENABLED
+		if (TCP_SEQ_GT(seq, cur_stream->rcv_nxt))
+			cur_stream->rcvvar->sack_recent = seq;
+#endif
 		return FALSE;
 	}
 
@@ -682,9 +807,154 @@ ProcessTCPPayload(mtcp_manager_t mtcp, tcp_stream *cur_stream,
 	return TRUE;
 }
 /*----------------------------------------------------------------------------*/
+/* ProcessMPTCPPayload: places subflow payload straight into the meta receive */
+/* buffer at its DSN; the subflow itself only tracks sequence progress        */
+/* Return: TRUE (1) in normal case, FALSE (0) if immediate ACK is required    */
+/*----------------------------------------------------------------------------*/
+static inline int 
+ProcessMPTCPPayload(mtcp_manager_t mtcp, tcp_stream *cur_stream, 
+		uint32_t cur_ts, const struct tcp_options *opts, uint8_t *payload, 
+		uint32_t seq, int payloadlen)
+{
+	mptcp_cb *mpcb = cur_stream->mptcp_cb;
+	tcp_stream *meta = mpcb->mpcb_stream;
+	struct tcp_recv_vars *rcvvar = meta->rcvvar;
+	uint32_t prev_rcv_nxt, prev_data_nxt;
+	uint64_t dsn64;
+	uint32_t dsn, dlen, off;
+	int ret;
+
+	/* if seq and segment length is lower than rcv_nxt, ignore and send ack */
+	if (TCP_SEQ_LT(seq + payloadlen, cur_stream->rcv_nxt)) {
+		return FALSE;
+	}
+	/* if payload exceeds receiving buffer, drop and send ack */
+	if (TCP_SEQ_GT(seq + payloadlen, 
+				cur_stream->rcv_nxt + cur_stream->rcvvar->rcv_wnd)) {
+		return FALSE;
+	}
+
+	/* allocate receive buffer if not exist */
+	if (!rcvvar->rcvbuf) {
+		rcvvar->rcvbuf = RBInit(mtcp->mptcp_rbm_rcv, rcvvar->irs + 1);
+		if (!rcvvar->rcvbuf) {
+			TRACE_ERROR("Stream %d: Failed to allocate receive buffer.\n", 
+					meta->id);
+			meta->state = TCP_ST_CLOSED;
+			meta->close_reason = TCP_NO_MEM;
+			RaiseErrorEvent(mtcp, meta);
+
+			return ERROR;
+		}
+	}
+
+	/* a mapping comes with the first segment it covers, the ones after */
+	/* it are placed by their subflow sequence number; ssn 0 is a       */
+	/* DATA_FIN of its own                                               */
+	if ((opts->flags & TCP_OPT_FLAG_DSS_MAP) && opts->dss_ssn && opts->dss_len) {
+		dsn64 = (opts->flags & TCP_OPT_FLAG_DSN_8) ? opts->dsn : 
+				MPTCPExpandDSN(mpcb->rcv_nxt_dsn, (uint32_t)opts->dsn);
+		/* an 8 byte DSN 2^31 or more away is from before a wrap */
+		if (MPTCPExpandDSN(mpcb->rcv_nxt_dsn, (uint32_t)dsn64) == dsn64) {
+			MPTCPRcvMapAdd(cur_stream->rcvvar, cur_stream->rcv_nxt, 
+					cur_stream->rcvvar->irs + opts->dss_ssn, 
+					(uint32_t)dsn64, opts->dss_len);
+		}
+	}
+
+	/* data we can not place is not taken on the subflow either, so the */
+	/* peer sends it again, with the mapping                             */
+	if (MPTCPRcvMapLookup(cur_stream->rcvvar, seq, &dsn, &dlen) < 0 || 
+			dlen < (uint32_t)payloadlen) {
+		return FALSE;
+	}
+
+	/* nor is data beyond the connection-level window; what is wholly */
+	/* below its rcv_nxt came on another subflow and is taken here     */
+	if (TCP_SEQ_GT(dsn + payloadlen, meta->rcv_nxt + rcvvar->rcv_wnd)) {
+		return FALSE;
+	}
+
+	prev_data_nxt = meta->rcv_nxt;
+	if (TCP_SEQ_GT(dsn + payloadlen, meta->rcv_nxt)) {
+		if (SBUF_LOCK(&rcvvar->read_lock)) {
+			if (errno == EDEADLK)
+				perror("ProcessMPTCPPayload: read_lock blocked\n");
+			assert(0);
+		}
+
+		/* RBPut() drops a segment that starts below the read head, so */
+		/* the part another subflow delivered already is cut off      */
+		off = TCP_SEQ_LT(dsn, meta->rcv_nxt) ? meta->rcv_nxt - dsn : 0;
+		ret = RBPut(mtcp->mptcp_rbm_rcv, rcvvar->rcvbuf, payload + off, 
+				(uint32_t)payloadlen - off, dsn + off);
+		if (ret <= 0) {
+			TRACE_ERROR("Cannot merge payload. reason: %d\n", ret);
+			SBUF_UNLOCK(&rcvvar->read_lock);
+			return FALSE;
+		}
+
+		meta->rcv_nxt = rcvvar->rcvbuf->head_seq + rcvvar->rcvbuf->merged_len;
+		if (mpcb->isDataFINReceived == 1) {
+			meta->rcv_nxt++;
+		}
+		mpcb->rcv_nxt_dsn = MPTCPExpandDSN(mpcb->rcv_nxt_dsn, meta->rcv_nxt);
+		rcvvar->rcv_wnd = rcvvar->rcvbuf->size - rcvvar->rcvbuf->merged_len;
+
+		SBUF_UNLOCK(&rcvvar->read_lock);
+	}
+
+	prev_rcv_nxt = cur_stream->rcv_nxt;
+	cur_stream->rcv_nxt = MPTCPSubflowRcvAdvance(cur_stream->rcvvar, 
+			cur_stream->rcv_nxt, seq, payloadlen);
+	/* subflows advertise the connection-level window */
+	cur_stream->rcvvar->rcv_wnd = rcvvar->rcv_wnd;
+
+	if (TCP_SEQ_GT(meta->rcv_nxt, prev_data_nxt) && 
+			cur_stream->state == TCP_ST_ESTABLISHED && mpcb->master) {
+		/* the application socket sits on the master subflow */
+		RaiseReadEvent(mtcp, mpcb->master);
+	}
+
+	if (TCP_SEQ_LEQ(cur_stream->rcv_nxt, prev_rcv_nxt)) {
+		/* There are some lost packets */
+#if TCP_OPT_SACK_ENABLED
+		if (TCP_SEQ_GT(seq, cur_stream->rcv_nxt))
+			cur_stream->rcvvar->sack_recent = seq;
+#endif
+		return FALSE;
+	}
+
+	return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+/* attaches the stream of an MP_JOIN SYN to the connection its token names; */
+/* -1 if there is no such connection or no room for another subflow         */
+static inline int
+MPTCPJoinPassive(mtcp_manager_t mtcp, tcp_stream *cur_stream, 
+		const struct tcp_options *opts)
+{
+	mptcp_cb *mpcb;
+
+	if (opts->join_len != MPTCP_OPT_JOIN_SYN_LEN)
+		return -1;
+	mpcb = MPTCPTokenLookup(mtcp->mptcp_tokens, opts->token);
+	if (!mpcb || MPTCPAttachSubflow(cur_stream, mpcb) < 0)
+		return -1;
+
+	cur_stream->isReceivedMPJoinSYN = 1;
+	cur_stream->isMPJOINStream = 1;
+	cur_stream->peerRandomNumber = opts->nonce;
+	MPTCPSubflowSetBackup(cur_stream, MPTCP_BACKUP_PEER, opts->join_backup);
+	MPTCPPMJoinAddr(mpcb, opts->join_addr_id, cur_stream->daddr);
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
 static inline tcp_stream *
 CreateNewFlowHTEntry(mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *iph, 
-		int ip_len, const struct tcphdr* tcph, uint32_t seq, uint32_t ack_seq,
+		int ip_len, const struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t seq, uint32_t ack_seq,
 		int payloadlen, uint16_t window)
 {
 	tcp_stream *cur_stream;
@@ -708,7 +978,7 @@ CreateNewFlowHTEntry(mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *i
 
 		/* now accept the connection */
 		cur_stream = HandlePassiveOpen(mtcp, 
-				cur_ts, iph, tcph, seq, window);
+				cur_ts, iph, tcph, opts, seq, window);
 		if (!cur_stream) {
 			TRACE_DBG("Not available space in flow pool.\n");
 #ifdef DBGMSG
@@ -722,6 +992,21 @@ CreateNewFlowHTEntry(mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *i
 			return NULL;
 		}
 
+		/* an MP_JOIN for no connection of ours, or for one that has no */
+		/* room for another subflow, is refused (RFC 8684 3.2)          */
+		if ((opts->flags & TCP_OPT_FLAG_MP_JOIN) && 
+				MPTCPJoinPassive(mtcp, cur_stream, opts) < 0) {
+			TRACE_DBG("Refusing MP_JOIN SYN for token %08x.\n", opts->token);
+			cur_stream->close_reason = TCP_NOT_ACCEPTED;
+			DestroyTCPStream(mtcp, cur_stream);
+			SendTCPPacketStandalone(mtcp, 
+					iph->daddr, tcph->dest, iph->saddr, tcph->source, 
+					0, seq + payloadlen + 1, 0, TCP_FLAG_RST | TCP_FLAG_ACK, 
+					NULL, 0, cur_ts, 0);
+
+			return NULL;
+		}
+
 		return cur_stream;
 	} else if (tcph->rst) {
 		TRACE_DBG("Reset packet comes\n");
@@ -757,47 +1042,31 @@ CreateNewFlowHTEntry(mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *i
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_LISTEN (mtcp_manager_t mtcp, uint32_t cur_ts, 
-		tcp_stream* cur_stream, struct tcphdr* tcph) {
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts) {
 	
-	// Have to check for MP options here
-	// use something like ParseMPTCP options
-	uint8_t mptcp_option = ParseMPTCPOptions(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-	uint64_t peerKey = GetPeerKey(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
+	uint8_t mptcp_option = opts->mptcp_subtype;
+	uint64_t peerKey = (opts->flags & TCP_OPT_FLAG_MP_CAPABLE) ? opts->snd_key : 0;
 	if (mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE && peerKey) {
-		cur_stream->isReceivedMPCapableSYN = 1;
-		cur_stream->mptcp_cb = (mptcp_cb *)calloc(1, sizeof(mptcp_cb));
-		cur_stream->mptcp_cb->peerKey = peerKey;
-		uint64_t random_number = 0;
-		for (int i = 0; i < 8; ++i) {
-			random_number = (random_number << 8) | (rand() & 0xFF);
-		}
-		cur_stream->mptcp_cb->myKey = random_number;
-		uint32_t myToken = GetToken(cur_stream->mptcp_cb->myKey);
-		mtcp->mptcp_conns.token[mtcp->mptcp_conns.num_connections] = myToken;
-		mtcp->mptcp_conns.mptcp_cbs[mtcp->mptcp_conns.num_connections++] = cur_stream->mptcp_cb;
-
+		struct tcp_listener *listener;
+		mptcp_cb *mpcb;
 
-	}
-	// Haathim_TODO:Check for MP_JOIN option
-	if (mptcp_option == TCP_MPTCP_SUBTYPE_JOIN) {
-		
-		uint32_t token = GetTokenFromMPJoinSYN(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-		uint32_t peerRandomNumber = GetPeerRandomNumberFromMPJoinSYN(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-		// Have to check if ok ot proceed
-		// check in the table if we have a mptcp connection for that token
-		cur_stream->isReceivedMPJoinSYN = 1;
-		cur_stream->isMPJOINStream = 1; //Haathim_TODO: Check if this is needed and if correct
-		cur_stream->peerRandomNumber = peerRandomNumber;
-		// using token add the relevenat motco_cb to it
-		for(int i=0;i<mtcp->mptcp_conns.num_connections;i++){
-			if(mtcp->mptcp_conns.token[i] == token){
-				cur_stream->mptcp_cb = mtcp->mptcp_conns.mptcp_cbs[i];
-				// cur_stream->mptcp_cb->tcp_streams[cur_stream->mptcp_cb->num_streams++] = cur_stream;
-				cur_stream->isMPJOINStream = 1;
-				break;
-			}
+		/* accepted connections inherit the scheduler of the listening socket */
+		listener = (struct tcp_listener *)ListenerHTSearch(mtcp->listeners, &tcph->dest);
+		mpcb = MPTCPCreateCB(mtcp, listener ? 
+				listener->socket->mptcp_sched : MPTCP_SCHED_MINRTT);
+		if (mpcb && MPTCPAttachSubflow(cur_stream, mpcb) < 0) {
+			MPTCPDestroyCB(mtcp, mpcb);
+			mpcb = NULL;
+		}
+		if (mpcb) {
+			cur_stream->isReceivedMPCapableSYN = 1;
+			MPTCPSetPeerKey(mpcb, peerKey);
+		} else {
+			/* no MP_CAPABLE in the SYN/ACK, the peer falls back to TCP */
+			TRACE_ERROR("Stream %d: MPTCP refused, no token available.\n", 
+					cur_stream->id);
 		}
-
 	}
 
 	if (tcph->syn) {
@@ -813,9 +1082,35 @@ Handle_TCP_ST_LISTEN (mtcp_manager_t mtcp, uint32_t cur_ts,
 
 }
 /*----------------------------------------------------------------------------*/
+/* checks the MAC of an MP_JOIN SYN/ACK (64 bits of it) or third ACK (160    */
+/* bits): the peer's key and random number come first in it, as in the MACs  */
+/* it sends. FALSE if the segment has no such MP_JOIN                        */
+static inline int
+MPTCPJoinHmacValid(tcp_stream *cur_stream, const struct tcp_options *opts)
+{
+	uint32_t nonces[2];
+	uint8_t hash[MPTCP_SHA256_LEN];
+
+	if (!cur_stream->mptcp_cb || opts->mptcp_subtype != TCP_MPTCP_SUBTYPE_JOIN)
+		return FALSE;
+	if (opts->join_len != MPTCP_OPT_JOIN_SYNACK_LEN && 
+			opts->join_len != MPTCP_OPT_JOIN_ACK_LEN)
+		return FALSE;
+
+	nonces[0] = htobe32(cur_stream->peerRandomNumber);
+	nonces[1] = htobe32(cur_stream->myRandomNumber);
+	MPTCPHmac(&cur_stream->mptcp_cb->peer_join_hmac, nonces, sizeof(nonces), 
+			hash);
+
+	if (opts->join_len == MPTCP_OPT_JOIN_SYNACK_LEN)
+		return be64toh(*(uint64_t *)hash) == opts->join_hmac;
+	return memcmp(hash, opts->join_mac, MPTCP_SHA1_LEN) == 0;
+}
+/*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_SYN_SENT (mtcp_manager_t mtcp, uint32_t cur_ts, 
-		tcp_stream* cur_stream, const struct iphdr* iph, struct tcphdr* tcph,
+		tcp_stream* cur_stream, const struct iphdr* iph, struct tcphdr* tcph, 
+		const struct tcp_options *opts, 
 		uint32_t seq, uint32_t ack_seq, int payloadlen, uint16_t window)
 {
 
@@ -855,12 +1150,15 @@ Handle_TCP_ST_SYN_SENT (mtcp_manager_t mtcp, uint32_t cur_ts,
 	if (tcph->syn) {
 		if (tcph->ack) {
 
-			// Can we use ParseMPTCPOptions??
-			// peerKey = ParseMPTCPOptions(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-			// Here GetPeerKey check first if there is a MP_CAPABLE option and then for the key in it
-			peerKey = GetPeerKey(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
+			peerKey = (opts->mptcp_subtype == TCP_MPTCP_SUBTYPE_CAPABLE) ? 
+					opts->snd_key : 0;
 			
-			if(peerKey != 0){
+			if (cur_stream->mptcp_cb && !cur_stream->isMPJOINStream && !peerKey) {
+				/* MP_CAPABLE was not echoed: go on as plain TCP */
+				TRACE_DBG("Stream %d: MPTCP fallback to TCP.\n", cur_stream->id);
+				MPTCPDetachSubflow(mtcp, cur_stream);
+			}
+			if (peerKey != 0 && cur_stream->mptcp_cb && !cur_stream->isMPJOINStream) {
 				cur_stream->peerKey = peerKey;
 				// Which means can that peer supports MPTCP
 				// Have to initialize the tcp_stream of mpcb here
@@ -869,31 +1167,50 @@ Handle_TCP_ST_SYN_SENT (mtcp_manager_t mtcp, uint32_t cur_ts,
 				socket = cur_stream->socket;
 				cur_stream->mptcp_cb->mpcb_stream = CreateMpcbTCPStream(mtcp, socket, socket->socktype, socket->saddr.sin_addr.s_addr, socket->saddr.sin_port, cur_stream->daddr, cur_stream->dport);
 
-				
-				cur_stream->mptcp_cb->tcp_streams[0] = cur_stream;
-				cur_stream->mptcp_cb->peer_idsn = GetPeerIdsnFromKey(peerKey);
-				cur_stream->mptcp_cb->mpcb_stream->rcvvar->irs = GetPeerIdsnFromKey(peerKey);
-				cur_stream->mptcp_cb->mpcb_stream->sndvar->iss = GetPeerIdsnFromKey(cur_stream->mptcp_cb->myKey);
-				cur_stream->mptcp_cb->my_idsn = GetPeerIdsnFromKey(cur_stream->mptcp_cb->myKey);
-				cur_stream->mptcp_cb->peerKey = peerKey;
+				cur_stream->mptcp_cb->mpcb_stream->mptcp_cb = cur_stream->mptcp_cb;
+				MPTCPSetPeerKey(cur_stream->mptcp_cb, peerKey);
+				cur_stream->mptcp_cb->mpcb_stream->rcvvar->irs = cur_stream->mptcp_cb->peer_idsn;
+				cur_stream->mptcp_cb->mpcb_stream->sndvar->iss = cur_stream->mptcp_cb->my_idsn;
 				cur_stream->mptcp_cb->mpcb_stream->snd_nxt = cur_stream->mptcp_cb->my_idsn + 1;
+				cur_stream->mptcp_cb->mpcb_stream->sndvar->snd_una = cur_stream->mptcp_cb->my_idsn + 1;
 				cur_stream->mptcp_cb->mpcb_stream->rcv_nxt = cur_stream->mptcp_cb->peer_idsn + 1;
+				cur_stream->mptcp_cb->mpcb_stream->sndvar->peer_wnd = cur_stream->sndvar->peer_wnd;
 				cur_stream->mptcp_cb->mpcb_stream->state = TCP_ST_ESTABLISHED;
-				cur_stream->mptcp_cb->num_streams = 1;
-				cur_stream->mptcp_cb->isSentMPJoinSYN = 0;
+				MPTCPPMInit(cur_stream->mptcp_cb, cur_stream, TRUE, cur_ts);
+				MPTCPInfoPublish(mtcp, cur_stream->mptcp_cb, TRUE);
 			}
 		
 			// Need to check for the MP_JOIN option
 			if (cur_stream->isMPJOINStream)
 			{
-				// truncatedHMAC = checkMP_JOIN_SYN_ACK(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-				// Haathim_TODO: Need to check if Server's response is correct (Uncomment truncatedHMAC and then proceed)
-				checkMP_JOIN_SYN_ACK(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-				cur_stream->mptcp_cb->tcp_streams[cur_stream->mptcp_cb->num_streams++] = cur_stream;
+				if (opts->mptcp_subtype == TCP_MPTCP_SUBTYPE_JOIN && 
+						opts->join_len == MPTCP_OPT_JOIN_SYNACK_LEN)
+					cur_stream->peerRandomNumber = opts->nonce;
+				/* a SYN/ACK without MP_JOIN or with a wrong MAC ends the 
+				   subflow with a RST (RFC 8684 3.2) */
+				if (opts->join_len != MPTCP_OPT_JOIN_SYNACK_LEN || 
+						!MPTCPJoinHmacValid(cur_stream, opts)) {
+					TRACE_ERROR("Stream %d: MP_JOIN SYN/ACK failed "
+							"authentication.\n", cur_stream->id);
+					SendTCPPacketStandalone(mtcp, 
+							iph->daddr, tcph->dest, iph->saddr, tcph->source, 
+							ack_seq, seq + 1, 0, TCP_FLAG_RST | TCP_FLAG_ACK, 
+							NULL, 0, cur_ts, 0);
+					cur_stream->state = TCP_ST_CLOSED;
+					cur_stream->close_reason = TCP_CONN_FAIL;
+					if (cur_stream->socket) {
+						RaiseErrorEvent(mtcp, cur_stream);
+					} else {
+						DestroyTCPStream(mtcp, cur_stream);
+					}
+					return;
+				}
+				MPTCPSubflowSetBackup(cur_stream, MPTCP_BACKUP_PEER, 
+						opts->join_backup);
 			}
 			
 			int ret = HandleActiveOpen(mtcp, 
-					cur_stream, cur_ts, tcph, seq, ack_seq, window);
+					cur_stream, cur_ts, tcph, opts, seq, ack_seq, window);
 			if (!ret) {
 				return;
 			}
@@ -931,10 +1248,11 @@ Handle_TCP_ST_SYN_SENT (mtcp_manager_t mtcp, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_SYN_RCVD (mtcp_manager_t mtcp, uint32_t cur_ts,
-		tcp_stream* cur_stream, struct tcphdr* tcph, uint32_t ack_seq) 
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t ack_seq) 
 {
 	struct tcp_send_vars *sndvar = cur_stream->sndvar;
-	uint64_t peerKey = 0, myKey = 0;
+	mptcp_cb *mpcb;
 	uint8_t mptcp_option;
 	int ret;
 	if (tcph->ack) {
@@ -951,6 +1269,22 @@ Handle_TCP_ST_SYN_RCVD (mtcp_manager_t mtcp, uint32_t cur_ts,
 			return;
 		}
 
+		/* the third ACK of an MP_JOIN carries the initiator's MAC; without */
+		/* it the subflow ends with a RST (RFC 8684 3.2)                    */
+		if (cur_stream->isReceivedMPJoinSYN && cur_stream->mptcp_cb && 
+				(opts->join_len != MPTCP_OPT_JOIN_ACK_LEN || 
+				!MPTCPJoinHmacValid(cur_stream, opts))) {
+			TRACE_ERROR("Stream %d: MP_JOIN ACK failed authentication.\n", 
+					cur_stream->id);
+			MPTCPDetachSubflow(mtcp, cur_stream);
+			cur_stream->snd_nxt = ack_seq;
+			cur_stream->close_reason = TCP_CONN_FAIL;
+			cur_stream->state = TCP_ST_CLOSED;
+			TRACE_STATE("Stream %d: TCP_ST_CLOSED\n", cur_stream->id);
+			AddtoControlList(mtcp, cur_stream, cur_ts);
+			return;
+		}
+
 		sndvar->snd_una++;
 		cur_stream->snd_nxt = ack_seq;
 		prior_cwnd = sndvar->cwnd;
@@ -965,48 +1299,44 @@ Handle_TCP_ST_SYN_RCVD (mtcp_manager_t mtcp, uint32_t cur_ts,
 
 		cur_stream->state = TCP_ST_ESTABLISHED;
 		TRACE_STATE("Stream %d: TCP_ST_ESTABLISHED\n", cur_stream->id);
-		// Haathim_TODO: Here only need to make to Multipath TCP connection (but did i store the peer key that i sent?)
-		// check if keys are correct
-		mptcp_option = ParseMPTCPOptions(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-		peerKey = GetPeerKey(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-		// print mptcp option
-		if (mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE && peerKey && cur_stream->mptcp_cb != NULL) {
-			if(peerKey == cur_stream->mptcp_cb->peerKey){
-				myKey = GetMyKeyFromMPCapbleACK(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-				if(myKey == cur_stream->mptcp_cb->myKey){
-					cur_stream->mptcp_cb->mpcb_stream = CreateMpcbTCPStream(mtcp, NULL, MTCP_SOCK_STREAM, cur_stream->saddr, cur_stream->sport, cur_stream->daddr, cur_stream->dport);
-					
-					cur_stream->mptcp_cb->tcp_streams[0] = cur_stream;
-					cur_stream->mptcp_cb->peer_idsn = GetPeerIdsnFromKey(peerKey);
-					cur_stream->mptcp_cb->mpcb_stream->rcvvar->irs = GetPeerIdsnFromKey(peerKey);
-					cur_stream->mptcp_cb->mpcb_stream->sndvar->iss = GetPeerIdsnFromKey(myKey);
-					cur_stream->mptcp_cb->my_idsn = GetPeerIdsnFromKey(myKey);
-					cur_stream->mptcp_cb->peerKey = peerKey;
-					cur_stream->mptcp_cb->mpcb_stream->snd_nxt = cur_stream->mptcp_cb->my_idsn + 1;
-					cur_stream->mptcp_cb->mpcb_stream->rcv_nxt = cur_stream->mptcp_cb->peer_idsn + 1;
-					cur_stream->mptcp_cb->mpcb_stream->state = TCP_ST_ESTABLISHED;
-					cur_stream->mptcp_cb->num_streams = 1;
-
-
-				}
+		mptcp_option = opts->mptcp_subtype;
+		mpcb = cur_stream->mptcp_cb;
+		if (cur_stream->isReceivedMPCapableSYN && mpcb && !mpcb->mpcb_stream) {
+			/* our keys come back in the MP_CAPABLE of this ACK; if it got */
+			/* lost, a DSS on the first data segment shows the same        */
+			if ((mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE && 
+					opts->snd_key == mpcb->peerKey && 
+					opts->rcv_key == mpcb->myKey) || 
+					(opts->flags & (TCP_OPT_FLAG_DATA_ACK | TCP_OPT_FLAG_DSS_MAP))) {
+				mpcb->mpcb_stream = CreateMpcbTCPStream(mtcp, NULL, MTCP_SOCK_STREAM, cur_stream->saddr, cur_stream->sport, cur_stream->daddr, cur_stream->dport);
+				mpcb->mpcb_stream->mptcp_cb = mpcb;
+				/* both IDSNs were hashed when the keys were first seen */
+				mpcb->mpcb_stream->rcvvar->irs = mpcb->peer_idsn;
+				mpcb->mpcb_stream->sndvar->iss = mpcb->my_idsn;
+				mpcb->mpcb_stream->snd_nxt = mpcb->my_idsn + 1;
+				mpcb->mpcb_stream->sndvar->snd_una = mpcb->my_idsn + 1;
+				mpcb->mpcb_stream->rcv_nxt = mpcb->peer_idsn + 1;
+				mpcb->mpcb_stream->sndvar->peer_wnd = cur_stream->sndvar->peer_wnd;
+				mpcb->mpcb_stream->state = TCP_ST_ESTABLISHED;
+				MPTCPPMInit(mpcb, cur_stream, FALSE, cur_ts);
+			} else {
+				/* MP_CAPABLE was not echoed: go on as plain TCP */
+				TRACE_DBG("Stream %d: MPTCP fallback to TCP.\n", cur_stream->id);
+				cur_stream->isReceivedMPCapableSYN = 0;
+				MPTCPDetachSubflow(mtcp, cur_stream);
 			}
-										
 		}
-		else if (mptcp_option == (uint8_t)1)
+		else if (cur_stream->isReceivedMPJoinSYN && mpcb)
 		{
-
-			if(cur_stream->mptcp_cb != NULL){
-				// check if the HMAC is correct
-				// uint8_t isHMACCorrect = checkHMAC(cur_stream, cur_ts, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-				uint8_t isHMACCorrect = 1; //assume true for now
-				// Haathim_TODO: check if the current packet is a MP_JOIN_ACK (is there a better wau to check this?)
-				// if yes then check if the response is correct
-				// and then enqueue an ack becuase client is waiting for it
-				if (isHMACCorrect){
-					EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_NOW);
-				}
-			}
-		}	
+			/* the initiator waits for the ACK of its MAC */
+			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_NOW);
+			/* a joined subflow is not accepted by the application; it */
+			/* shares the socket of its connection, as on the active side */
+			cur_stream->socket = mpcb->master ? mpcb->master->socket : NULL;
+			if (CONFIG.tcp_timeout > 0)
+				AddtoTimeoutList(mtcp, cur_stream);
+			return;
+		}
 		/* update listening socket */
 		listener = (struct tcp_listener *)ListenerHTSearch(mtcp->listeners, &tcph->dest);
 
@@ -1040,7 +1370,8 @@ Handle_TCP_ST_SYN_RCVD (mtcp_manager_t mtcp, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_ESTABLISHED (mtcp_manager_t mtcp, uint32_t cur_ts,
-		tcp_stream* cur_stream, struct tcphdr* tcph, uint32_t seq, uint32_t ack_seq,
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t seq, uint32_t ack_seq,
 		uint8_t *payload, int payloadlen, uint16_t window) 
 {
 	if (tcph->syn) {
@@ -1053,89 +1384,58 @@ Handle_TCP_ST_ESTABLISHED (mtcp_manager_t mtcp, uint32_t cur_ts,
 		return;
 	}
 
-	// get data seq if avaible
-	uint32_t dataSeq;
 	if(cur_stream->mptcp_cb != NULL){
-		// dataSeq = GetDataSeq(cur_stream, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-		// if (dataSeq > 0){
-		// }
-
 		// check if DATA-FIN is there
-		if(isDataFINPresent(cur_stream, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN)){
+		if (opts->flags & TCP_OPT_FLAG_DATA_FIN) {
 			// Store that info in the mptcp_cb
 			cur_stream->mptcp_cb->isDataFINReceived = 1;
 		}
+		/* the peer asks us not to send on this subflow, or lifts that */
+		if (opts->flags & TCP_OPT_FLAG_MP_PRIO) {
+			MPTCPSubflowSetBackup(cur_stream, MPTCP_BACKUP_PEER, 
+					opts->prio_backup);
+		}
+		if (cur_stream->mptcp_cb->mpcb_stream) {
+			int i;
+
+			if (opts->flags & TCP_OPT_FLAG_ADD_ADDR)
+				MPTCPPMAddAddr(mtcp, cur_stream->mptcp_cb, opts, cur_ts);
+			if (opts->flags & TCP_OPT_FLAG_REMOVE_ADDR) {
+				for (i = 0; i < opts->rm_addr_cnt; i++) {
+					MPTCPPMRemoveAddr(mtcp, cur_stream->mptcp_cb, 
+							opts->rm_addr_ids[i]);
+				}
+			}
+		}
 
 	}
 	
-	// Haathim_TODO: Need to add the data into the mpcb rcv buf after adding to normal rcv buf
-	// which is done in the ProcessTCPPayload function
-	// after adding to mpcb rcv buf need to send a DATAACK through any ofthe subflows
-	// Just like senfing a normal data
-
 	if (payloadlen > 0) {
-		/*SECOND TRY*/
-		if (ProcessTCPPayload(mtcp, cur_stream, 
-				cur_ts, payload, seq, payloadlen)) {
+		int merged;
+
+		if (cur_stream->mptcp_cb && cur_stream->mptcp_cb->mpcb_stream) {
+			merged = ProcessMPTCPPayload(mtcp, cur_stream, 
+					cur_ts, opts, payload, seq, payloadlen);
+		} else {
+			merged = ProcessTCPPayload(mtcp, cur_stream, 
+					cur_ts, payload, seq, payloadlen);
+		}
+		if (merged) {
 			/* if return is TRUE, send ACK */
-				if (cur_stream->mptcp_cb != NULL)
-				{
-					dataSeq = GetDataSeq(cur_stream, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-					uint16_t dataLevelLength = GetDataLevelLength(cur_stream, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-					if(payloadlen == (int)dataLevelLength || cur_stream->mptcp_cb->isDataFINReceived == 1){CopyFromSubflowToMpcb(mtcp, cur_stream->mptcp_cb->mpcb_stream, cur_stream, seq, payloadlen, dataSeq);}
-				}
-				EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_AGGREGATE);				
+			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_AGGREGATE);
 		} else {
 			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_NOW);
 		}
-		/*END OF SECOND TRY*/
-		
-		
 	}
 
 	if (tcph->ack) {
-		// check if ACK is > 1 && should do only once
-		if(cur_stream->mptcp_cb != NULL  && cur_stream->mptcp_cb->isSentMPJoinSYN == 0){
-			// send MP_JOIN_SYN
-			tcp_stream* new_mpjoin_stream = CreateTCPStream(mtcp, NULL, SOCK_STREAM, inet_addr("192.168.61.12"), cur_stream->sport, cur_stream->daddr, cur_stream->dport);
-			
-			if (!new_mpjoin_stream) {
-				TRACE_ERROR("Failed to create mpjoin tcp_stream!\n");
-				errno = ENOMEM;
-				return;
-			}
-
-			new_mpjoin_stream->isMPJOINStream = 1;
-			new_mpjoin_stream->mptcp_cb = cur_stream->mptcp_cb;
-
-			/*Dont know if below will work or is correct*/
-			new_mpjoin_stream->socket = cur_stream->socket;
-
-			new_mpjoin_stream->sndvar->cwnd = 1;
-			new_mpjoin_stream->sndvar->ssthresh = new_mpjoin_stream->sndvar->mss * 10;
-			new_mpjoin_stream->state = TCP_ST_SYN_SENT;
-			TRACE_STATE("Stream %d: TCP_ST_SYN_SENT\n", new_mpjoin_stream->id);
-			SQ_LOCK(&mtcp->ctx->connect_lock);
-			int ret = StreamEnqueue(mtcp->connectq, new_mpjoin_stream);
-			SQ_UNLOCK(&mtcp->ctx->connect_lock);
-			mtcp->wakeup_flag = TRUE;
+		/* opens the subflows the path manager still owes */
+		if (cur_stream->mptcp_cb)
+			MPTCPPMCheck(mtcp, cur_stream->mptcp_cb, cur_ts);
 
-			if (ret < 0) {
-
-				TRACE_ERROR("mpjoin stream failed to enqueue to conenct queue!\n");
-				SQ_LOCK(&mtcp->ctx->destroyq_lock);
-				StreamEnqueue(mtcp->destroyq, new_mpjoin_stream);
-				SQ_UNLOCK(&mtcp->ctx->destroyq_lock);
-				errno = EAGAIN;
-				
-			}
-		
-			cur_stream->mptcp_cb->isSentMPJoinSYN = 1;
-		}
-
-		if (cur_stream->sndvar->sndbuf) {
+		if (cur_stream->sndvar->sndbuf || cur_stream->mptcp_cb) {
 			ProcessACK(mtcp, cur_stream, cur_ts, 
-					tcph, seq, ack_seq, window, payloadlen);
+					tcph, opts, seq, ack_seq, window, payloadlen);
 		}
 	}
 
@@ -1159,7 +1459,8 @@ Handle_TCP_ST_ESTABLISHED (mtcp_manager_t mtcp, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_CLOSE_WAIT (mtcp_manager_t mtcp, uint32_t cur_ts, 
-		tcp_stream* cur_stream, struct tcphdr* tcph, uint32_t seq, uint32_t ack_seq, 
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t seq, uint32_t ack_seq, 
 		int payloadlen, uint16_t window) 
 {
 	if (TCP_SEQ_LT(seq, cur_stream->rcv_nxt)) {
@@ -1170,15 +1471,16 @@ Handle_TCP_ST_CLOSE_WAIT (mtcp_manager_t mtcp, uint32_t cur_ts,
 		return;
 	}
 
-	if (cur_stream->sndvar->sndbuf) {
+	if (cur_stream->sndvar->sndbuf || cur_stream->mptcp_cb) {
 		ProcessACK(mtcp, cur_stream, cur_ts, 
-				tcph, seq, ack_seq, window, payloadlen);
+				tcph, opts, seq, ack_seq, window, payloadlen);
 	}
 }
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_LAST_ACK (mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr *iph,
 		int ip_len, tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, 
 		uint32_t seq, uint32_t ack_seq, int payloadlen, uint16_t window) 
 {
 
@@ -1190,9 +1492,9 @@ Handle_TCP_ST_LAST_ACK (mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr
 	}
 
 	if (tcph->ack) {
-		if (cur_stream->sndvar->sndbuf) {
+		if (cur_stream->sndvar->sndbuf || cur_stream->mptcp_cb) {
 			ProcessACK(mtcp, cur_stream, cur_ts, 
-					tcph, seq, ack_seq, window, payloadlen);
+					tcph, opts, seq, ack_seq, window, payloadlen);
 		}
 
 		if (!cur_stream->sndvar->is_fin_sent) {
@@ -1236,7 +1538,8 @@ Handle_TCP_ST_LAST_ACK (mtcp_manager_t mtcp, uint32_t cur_ts, const struct iphdr
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_FIN_WAIT_1 (mtcp_manager_t mtcp, uint32_t cur_ts,
-		tcp_stream* cur_stream, struct tcphdr* tcph, uint32_t seq, uint32_t ack_seq, 
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t seq, uint32_t ack_seq, 
 		uint8_t *payload, int payloadlen, uint16_t window) 
 {
 
@@ -1249,9 +1552,9 @@ Handle_TCP_ST_FIN_WAIT_1 (mtcp_manager_t mtcp, uint32_t cur_ts,
 	}
 
 	if (tcph->ack) {
-		if (cur_stream->sndvar->sndbuf) {
+		if (cur_stream->sndvar->sndbuf || cur_stream->mptcp_cb) {
 			ProcessACK(mtcp, cur_stream, cur_ts, 
-					tcph, seq, ack_seq, window, payloadlen);
+					tcph, opts, seq, ack_seq, window, payloadlen);
 		}
 
 		if (cur_stream->sndvar->is_fin_sent && 
@@ -1278,14 +1581,17 @@ Handle_TCP_ST_FIN_WAIT_1 (mtcp_manager_t mtcp, uint32_t cur_ts,
 	}
 
 	if (payloadlen > 0) {
-		if (ProcessTCPPayload(mtcp, cur_stream, 
-				cur_ts, payload, seq, payloadlen)) {
+		int merged;
+
+		if (cur_stream->mptcp_cb && cur_stream->mptcp_cb->mpcb_stream) {
+			merged = ProcessMPTCPPayload(mtcp, cur_stream, 
+					cur_ts, opts, payload, seq, payloadlen);
+		} else {
+			merged = ProcessTCPPayload(mtcp, cur_stream, 
+					cur_ts, payload, seq, payloadlen);
+		}
+		if (merged) {
 			/* if return is TRUE, send ACK */
-			if (cur_stream->mptcp_cb != NULL)
-			{
-				uint32_t dataSeq = GetDataSeq(cur_stream, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-				CopyFromSubflowToMpcb(mtcp, cur_stream->mptcp_cb->mpcb_stream, cur_stream, seq, payloadlen, dataSeq);
-			}
 			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_AGGREGATE);
 		} else {
 			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_NOW);
@@ -1314,13 +1620,14 @@ Handle_TCP_ST_FIN_WAIT_1 (mtcp_manager_t mtcp, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 static inline void 
 Handle_TCP_ST_FIN_WAIT_2 (mtcp_manager_t mtcp, uint32_t cur_ts,
-		tcp_stream* cur_stream, struct tcphdr* tcph, uint32_t seq, uint32_t ack_seq,
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t seq, uint32_t ack_seq,
 		uint8_t *payload, int payloadlen, uint16_t window)
 {
 	if (tcph->ack) {
-		if (cur_stream->sndvar->sndbuf) {
+		if (cur_stream->sndvar->sndbuf || cur_stream->mptcp_cb) {
 			ProcessACK(mtcp, cur_stream, cur_ts, 
-					tcph, seq, ack_seq, window, payloadlen);
+					tcph, opts, seq, ack_seq, window, payloadlen);
 		}
 	} else {
 		TRACE_DBG("Stream %d: does not contain an ack!\n", 
@@ -1329,16 +1636,17 @@ Handle_TCP_ST_FIN_WAIT_2 (mtcp_manager_t mtcp, uint32_t cur_ts,
 	}
 
 	if (payloadlen > 0) {
-		if (ProcessTCPPayload(mtcp, cur_stream, 
-				cur_ts, payload, seq, payloadlen)) {
-			/* if return is TRUE, send ACK */
-
-			if (cur_stream->mptcp_cb != NULL)
-			{
-				uint32_t dataSeq = GetDataSeq(cur_stream, (uint8_t *)tcph + TCP_HEADER_LEN, (tcph->doff << 2) - TCP_HEADER_LEN);
-				CopyFromSubflowToMpcb(mtcp, cur_stream->mptcp_cb->mpcb_stream, cur_stream, seq, payloadlen, dataSeq);
-			}
+		int merged;
 
+		if (cur_stream->mptcp_cb && cur_stream->mptcp_cb->mpcb_stream) {
+			merged = ProcessMPTCPPayload(mtcp, cur_stream, 
+					cur_ts, opts, payload, seq, payloadlen);
+		} else {
+			merged = ProcessTCPPayload(mtcp, cur_stream, 
+					cur_ts, payload, seq, payloadlen);
+		}
+		if (merged) {
+			/* if return is TRUE, send ACK */
 			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_AGGREGATE);
 		} else {
 			EnqueueACK(mtcp, cur_stream, cur_ts, ACK_OPT_NOW);
@@ -1372,13 +1680,14 @@ Handle_TCP_ST_FIN_WAIT_2 (mtcp_manager_t mtcp, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 static inline void
 Handle_TCP_ST_CLOSING (mtcp_manager_t mtcp, uint32_t cur_ts, 
-		tcp_stream* cur_stream, struct tcphdr* tcph, uint32_t seq, uint32_t ack_seq,
+		tcp_stream* cur_stream, struct tcphdr* tcph, 
+		const struct tcp_options *opts, uint32_t seq, uint32_t ack_seq,
 		int payloadlen, uint16_t window) {
 
 	if (tcph->ack) {
-		if (cur_stream->sndvar->sndbuf) {
+		if (cur_stream->sndvar->sndbuf || cur_stream->mptcp_cb) {
 			ProcessACK(mtcp, cur_stream, cur_ts, 
-					tcph, seq, ack_seq, window, payloadlen);
+					tcph, opts, seq, ack_seq, window, payloadlen);
 		}
 
 		if (!cur_stream->sndvar->is_fin_sent) {
@@ -1420,16 +1729,18 @@ Handle_TCP_ST_CLOSING (mtcp_manager_t mtcp, uint32_t cur_ts,
 /*----------------------------------------------------------------------------*/
 int
 ProcessTCPPacket(mtcp_manager_t mtcp, 
-		 uint32_t cur_ts, const int ifidx, const struct iphdr *iph, int ip_len)
+		 uint32_t cur_ts, const int ifidx, const struct iphdr *iph, int ip_len, 
+		 uint32_t rxhash)
 {
 	struct tcphdr* tcph = (struct tcphdr *) ((u_char *)iph + (iph->ihl << 2));
 	uint8_t *payload    = (uint8_t *)tcph + (tcph->doff << 2);
 	int payloadlen = ip_len - (payload - (u_char *)iph);
-	tcp_stream s_stream;
+	struct flow_key key;
 	tcp_stream *cur_stream = NULL;
 	uint32_t seq = ntohl(tcph->seq);
 	uint32_t ack_seq = ntohl(tcph->ack_seq);
 	uint16_t window = ntohs(tcph->window);
+	struct tcp_options opts;
 	uint16_t check;
 	int ret;
 	int rc = -1;
@@ -1440,7 +1751,7 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 
 #if VERIFY_RX_CHECKSUM
 #ifndef DISABLE_HWCSUM
-	if (mtcp->iom->dev_ioctl != NULL)
+	if (mtcp->iom->dev_ioctl != NULL && ifidx >= 0)
 		rc = mtcp->iom->dev_ioctl(mtcp->ctx, ifidx,
 					  PKT_RX_TCP_CSUM, NULL);
 #endif
@@ -1461,14 +1772,20 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 	mtcp->nstat.rx_gdptbytes += payloadlen;
 #endif /* NETSTAT */
 
-	s_stream.saddr = iph->daddr;
-	s_stream.sport = tcph->dest;
-	s_stream.daddr = iph->saddr;
-	s_stream.dport = tcph->source;
+	/* the only walk over the options, everything below reads opts */
+	ParseTCPOptions(&opts, (uint8_t *)tcph + TCP_HEADER_LEN, 
+			(tcph->doff << 2) - TCP_HEADER_LEN);
+
+	key.saddr = iph->daddr;
+	key.sport = tcph->dest;
+	key.daddr = iph->saddr;
+	key.dport = tcph->source;
 
-	if (!(cur_stream = StreamHTSearch(mtcp->tcp_flow_table, &s_stream))) {
+	if (!(cur_stream = FlowTableSearch(mtcp->tcp_flow_table, &key, rxhash))) {
 		/* not found in flow table */
-		cur_stream = CreateNewFlowHTEntry(mtcp, cur_ts, iph, ip_len, tcph, 
+		if (MPTCPHandoffCheck(mtcp, cur_ts, iph, ip_len, tcph, &opts))
+			return TRUE;
+		cur_stream = CreateNewFlowHTEntry(mtcp, cur_ts, iph, ip_len, tcph, &opts, 
 				seq, ack_seq, payloadlen, window);
 		if (!cur_stream)
 			return TRUE;
@@ -1477,7 +1794,7 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 	/* Validate sequence. if not valid, ignore the packet */
 	if (cur_stream->state > TCP_ST_SYN_RCVD) {
 		ret = ValidateSequence(mtcp, cur_stream, 
-				cur_ts, tcph, seq, ack_seq, payloadlen);
+				cur_ts, tcph, &opts, seq, ack_seq, payloadlen);
 		if (!ret) {
 			TRACE_DBG("Stream %d: Unexpected sequence: %u, expected: %u\n",
 					cur_stream->id, seq, cur_stream->rcv_nxt);
@@ -1500,7 +1817,6 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 	}
 				
 	cur_stream->last_active_ts = cur_ts;
-	UpdateTimeoutList(mtcp, cur_stream);
 
 	/* Process RST: process here only if state > TCP_ST_SYN_SENT */
 	if (tcph->rst) {
@@ -1514,22 +1830,22 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 
 	switch (cur_stream->state) {
 	case TCP_ST_LISTEN:
-		Handle_TCP_ST_LISTEN(mtcp, cur_ts, cur_stream, tcph);
+		Handle_TCP_ST_LISTEN(mtcp, cur_ts, cur_stream, tcph, &opts);
 		break;
 
 	case TCP_ST_SYN_SENT:
-		Handle_TCP_ST_SYN_SENT(mtcp, cur_ts, cur_stream, iph, tcph, 
+		Handle_TCP_ST_SYN_SENT(mtcp, cur_ts, cur_stream, iph, tcph, &opts, 
 				seq, ack_seq, payloadlen, window);
 		break;
 
 	case TCP_ST_SYN_RCVD:
 		/* SYN retransmit implies our SYN/ACK was lost. Resend */
 		if (tcph->syn && seq == cur_stream->rcvvar->irs)
-			Handle_TCP_ST_LISTEN(mtcp, cur_ts, cur_stream, tcph);
+			Handle_TCP_ST_LISTEN(mtcp, cur_ts, cur_stream, tcph, &opts);
 		else {
-			Handle_TCP_ST_SYN_RCVD(mtcp, cur_ts, cur_stream, tcph, ack_seq);
+			Handle_TCP_ST_SYN_RCVD(mtcp, cur_ts, cur_stream, tcph, &opts, ack_seq);
 			if (payloadlen > 0 && cur_stream->state == TCP_ST_ESTABLISHED) {
-				Handle_TCP_ST_ESTABLISHED(mtcp, cur_ts, cur_stream, tcph,
+				Handle_TCP_ST_ESTABLISHED(mtcp, cur_ts, cur_stream, tcph, &opts,
 							  seq, ack_seq, payload,
 							  payloadlen, window);
 			}
@@ -1537,32 +1853,32 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 		break;
 
 	case TCP_ST_ESTABLISHED:
-		Handle_TCP_ST_ESTABLISHED(mtcp, cur_ts, cur_stream, tcph, 
+		Handle_TCP_ST_ESTABLISHED(mtcp, cur_ts, cur_stream, tcph, &opts, 
 				seq, ack_seq, payload, payloadlen, window);
 		break;
 
 	case TCP_ST_CLOSE_WAIT:
-		Handle_TCP_ST_CLOSE_WAIT(mtcp, cur_ts, cur_stream, tcph, seq, ack_seq,
+		Handle_TCP_ST_CLOSE_WAIT(mtcp, cur_ts, cur_stream, tcph, &opts, seq, ack_seq,
 				payloadlen, window);
 		break;
 
 	case TCP_ST_LAST_ACK:
-		Handle_TCP_ST_LAST_ACK(mtcp, cur_ts, iph, ip_len, cur_stream, tcph, 
+		Handle_TCP_ST_LAST_ACK(mtcp, cur_ts, iph, ip_len, cur_stream, tcph, &opts, 
 				seq, ack_seq, payloadlen, window);
 		break;
 	
 	case TCP_ST_FIN_WAIT_1:
-		Handle_TCP_ST_FIN_WAIT_1(mtcp, cur_ts, cur_stream, tcph, seq, ack_seq,
+		Handle_TCP_ST_FIN_WAIT_1(mtcp, cur_ts, cur_stream, tcph, &opts, seq, ack_seq,
 				payload, payloadlen, window);
 		break;
 
 	case TCP_ST_FIN_WAIT_2:
-		Handle_TCP_ST_FIN_WAIT_2(mtcp, cur_ts, cur_stream, tcph, seq, ack_seq, 
+		Handle_TCP_ST_FIN_WAIT_2(mtcp, cur_ts, cur_stream, tcph, &opts, seq, ack_seq, 
 				payload, payloadlen, window);
 		break;
 
 	case TCP_ST_CLOSING:
-		Handle_TCP_ST_CLOSING(mtcp, cur_ts, cur_stream, tcph, seq, ack_seq,
+		Handle_TCP_ST_CLOSING(mtcp, cur_ts, cur_stream, tcph, &opts, seq, ack_seq,
 				payloadlen, window);
 		break;
 
@@ -1583,63 +1899,3 @@ ProcessTCPPacket(mtcp_manager_t mtcp,
 
 	return TRUE;
 }
-
-static inline
-int CopyFromSubflowToMpcb(mtcp_manager_t mtcp, tcp_stream *mpcb_stream, tcp_stream *subflow_stream, uint32_t subflow_seq, int payloadlen, uint32_t data_seq){
-
-	struct tcp_recv_vars *subflow_rcvvar = subflow_stream->rcvvar;
-
-	//copy into mpcb rcvbuf
-	struct tcp_recv_vars *mpcb_rcvvar = mpcb_stream->rcvvar;
-	int ret;
-
-	/* if seq and segment length is lower than rcv_nxt, ignore and send ack */
-	if (TCP_SEQ_LT(data_seq + payloadlen, mpcb_stream->rcv_nxt)) {
-		return FALSE;
-	}
-	/* if payload exceeds receiving buffer, drop and send ack */
-	if (TCP_SEQ_GT(data_seq + payloadlen, mpcb_stream->rcv_nxt + mpcb_rcvvar->rcv_wnd)) {
-		return FALSE;
-	}
-
-	/* allocate receive buffer if not exist */
-	if (!mpcb_rcvvar->rcvbuf) {
-		mpcb_rcvvar->rcvbuf = RBInit(mtcp->mptcp_rbm_rcv, mpcb_rcvvar->irs + 1);
-		if (!mpcb_rcvvar->rcvbuf) {
-			TRACE_ERROR("Stream %d: Failed to allocate receive buffer.\n", 
-					mpcb_stream->id);
-			mpcb_stream->state = TCP_ST_CLOSED;
-			mpcb_stream->close_reason = TCP_NO_MEM;
-			RaiseErrorEvent(mtcp, mpcb_stream);
-			// SBUF_UNLOCK(&subflow_rcvvar->read_lock);
-			return ERROR;
-		}
-	}
-
-	if (SBUF_LOCK(&mpcb_rcvvar->read_lock)) {
-		if (errno == EDEADLK)
-			perror("ProcessTCPPayload: read_lock blocked\n");
-		assert(0);
-	}
-
-	// find the location in the subflow buffer where the current seq packet is strored
-	int putx = subflow_seq - subflow_rcvvar->rcvbuf->head_seq;
-
-	ret = RBPut(mtcp->mptcp_rbm_rcv, 
-			mpcb_rcvvar->rcvbuf, subflow_rcvvar->rcvbuf->head + putx, (uint32_t)payloadlen, data_seq);
-	if (ret < 0) {
-		TRACE_ERROR("Cannot merge payload. reason: %d\n", ret);
-	}
-	
-	RBRemove(mtcp->rbm_rcv, subflow_rcvvar->rcvbuf, subflow_rcvvar->rcvbuf->merged_len, AT_APP);
-
-	subflow_rcvvar->rcv_wnd = subflow_rcvvar->rcvbuf->size - subflow_rcvvar->rcvbuf->merged_len;
-
-	mpcb_stream->rcv_nxt = mpcb_rcvvar->rcvbuf->head_seq + mpcb_rcvvar->rcvbuf->merged_len;
-	if(subflow_stream->mptcp_cb->isDataFINReceived == 1) {mpcb_stream->rcv_nxt++; }
-	mpcb_rcvvar->rcv_wnd = mpcb_rcvvar->rcvbuf->size - mpcb_rcvvar->rcvbuf->merged_len;
-	ret  = mpcb_rcvvar->rcvbuf->merged_len;
-	SBUF_UNLOCK(&mpcb_rcvvar->read_lock);
-	
-	return 1;
-}
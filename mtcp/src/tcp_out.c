@@ -9,6 +9,10 @@
 #include "timer.h"
 #include "debug.h"
 #include "mptcp.h"
+#include "mptcp_sched.h"
+#include "mptcp_map.h"
+#include "mptcp_token.h"
+#include "mptcp_pm.h"
 #include <endian.h>
 #if RATE_LIMIT_ENABLED || PACING_ENABLED
 #include "pacing.h"
@@ -49,12 +53,6 @@ CalculateOptionLength(uint8_t flags)
 #if TCP_OPT_TIMESTAMP_ENABLED
 		optlen += TCP_OPT_TIMESTAMP_LEN + 2;
 #endif
-
-#if TCP_OPT_SACK_ENABLED
-		if (flags & TCP_FLAG_SACK) {
-			optlen += TCP_OPT_SACK_LEN + 2;
-		}
-#endif
 	}
 
 	assert(optlen % 4 == 0);
@@ -62,8 +60,10 @@ CalculateOptionLength(uint8_t flags)
 	return optlen;
 }
 /*----------------------------------------------------------------------------*/
+/* dss: the MPTCP_DSS_* flags of the DSS sent with a data or plain ACK      */
+/* segment, see MPTCPDSSFlags()                                              */
 static inline uint16_t
-CalculateOptionLengthMPTCP(uint8_t flags, uint8_t mptcp_option, uint16_t payloadlen)
+CalculateOptionLengthMPTCP(uint8_t flags, uint8_t mptcp_option, uint8_t dss)
 {
 	uint16_t optlen = 0;
 
@@ -116,8 +116,6 @@ CalculateOptionLengthMPTCP(uint8_t flags, uint8_t mptcp_option, uint16_t payload
 
 		optlen += TCP_OPT_WSCALE_LEN + 1;
 
-		optlen += TCP_OPT_WSCALE_LEN + 1;
-
 		if(mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE){
 			optlen += MPTCP_OPT_CAPABLE_SYNACK_LEN;
 		}
@@ -129,18 +127,12 @@ CalculateOptionLengthMPTCP(uint8_t flags, uint8_t mptcp_option, uint16_t payload
 		}
 
 	}
-	else if (flags == TCP_FLAG_ACK && payloadlen == 0 && mptcp_option != 2)
+	else if (flags == TCP_FLAG_ACK && mptcp_option != TCP_MPTCP_SUBTYPE_DSS)
 	{
 #if TCP_OPT_TIMESTAMP_ENABLED
 		optlen += TCP_OPT_TIMESTAMP_LEN + 2;
 #endif
 
-#if TCP_OPT_SACK_ENABLED
-		if (flags & TCP_FLAG_SACK) {
-			optlen += TCP_OPT_SACK_LEN + 2;
-		}
-#endif
-
 		if (mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE) {
 			optlen += MPTCP_OPT_CAPABLE_ACK_LEN;
 
@@ -158,17 +150,12 @@ CalculateOptionLengthMPTCP(uint8_t flags, uint8_t mptcp_option, uint16_t payload
 #if TCP_OPT_TIMESTAMP_ENABLED
 		optlen += TCP_OPT_TIMESTAMP_LEN + 2;
 #endif
-
-#if TCP_OPT_SACK_ENABLED
-		if (flags & TCP_FLAG_SACK) {
-			optlen += TCP_OPT_SACK_LEN + 2;
+		if (dss & MPTCP_DSS_MAP) {
+			/* two NOPs pad the mapping */
+			optlen += MPTCP_OPT_DSS_MAP_LEN + 2;
 		}
-#endif
-		if(payloadlen > 0 && mptcp_option == 2){ // DSN & Data ACK
-			optlen += 20;
-		}
-		else if(mptcp_option == 2){ // Data ACK onlu
-			optlen += 8;
+		else if (dss) {
+			optlen += MPTCP_OPT_DSS_ACK_LEN;
 		}
 	}
 	
@@ -179,20 +166,275 @@ CalculateOptionLengthMPTCP(uint8_t flags, uint8_t mptcp_option, uint16_t payload
 	return optlen;
 }
 /*----------------------------------------------------------------------------*/
+/* MP_JOIN MAC over our random number followed by the peer's */
+static inline void
+MPTCPJoinHmac(tcp_stream *cur_stream, uint8_t *hash)
+{
+	uint32_t nonces[2];
+
+	nonces[0] = htobe32(cur_stream->myRandomNumber);
+	nonces[1] = htobe32(cur_stream->peerRandomNumber);
+	MPTCPHmac(&cur_stream->mptcp_cb->join_hmac, nonces, sizeof(nonces), hash);
+}
+/*----------------------------------------------------------------------------*/
+/* DSS of an outgoing subflow segment, decided before its options are sized */
+struct mptcp_dss_out
+{
+	uint8_t flags;		/* MPTCP_DSS_*, 0 if the segment has no DSS */
+	uint32_t dsn;		/* of the mapping starting in this segment */
+	uint32_t len;
+	uint8_t prio;		/* an MP_PRIO goes along, there is no room next to 
+				   a mapping */
+	uint8_t sig;		/* MPTCP_SIG_*: an address option goes along, 
+				   neither with a mapping nor an MP_PRIO */
+	struct mptcp_addr sig_addr;
+};
+/*----------------------------------------------------------------------------*/
+/* B flag of our MP_JOIN SYN or SYN/ACK; it tells the peer what an MP_PRIO  */
+/* would, so none is sent on the subflow afterwards                          */
+static inline uint8_t
+MPTCPJoinBackupFlag(tcp_stream *cur_stream)
+{
+	struct mptcp_subflow *e;
+
+	if (cur_stream->sndvar->mptcp_sf_idx == 0)
+		return 0;
+
+	e = &cur_stream->mptcp_cb->subflows[cur_stream->sndvar->mptcp_sf_idx - 1];
+	e->send_prio = FALSE;
+
+	return (e->backup & MPTCP_BACKUP_LOCAL) ? MPTCP_FLAG_BACKUP : 0;
+}
+/*----------------------------------------------------------------------------*/
+/* the DATA_ACK goes with every segment; a mapping only with the first      */
+/* segment it covers, and the DATA_FIN with the subflow FIN once the meta    */
+/* stream has sent all its data                                              */
 static inline void
-GenerateTCPTimestamp(tcp_stream *cur_stream, uint8_t *tcpopt, uint32_t cur_ts)
+MPTCPGetDSS(tcp_stream *cur_stream, uint32_t cur_ts, uint8_t flags, 
+		uint16_t payloadlen, struct mptcp_dss_out *dss)
+{
+	tcp_stream *meta = cur_stream->mptcp_cb->mpcb_stream;
+	struct tcp_send_buffer *sndbuf;
+
+	dss->flags = 0;
+	dss->prio = FALSE;
+	dss->sig = MPTCP_SIG_NONE;
+	if (!meta)
+		return;
+	dss->flags = MPTCP_DSS_DATA_ACK | MPTCP_DSS_DATA_ACK_8;
+
+	if (payloadlen > 0) {
+		if (MPTCPMapGetDSS(cur_stream, &dss->dsn, &dss->len) == 1)
+			dss->flags |= MPTCP_DSS_MAP | MPTCP_DSS_DSN_8;
+	} else if (flags & TCP_FLAG_FIN) {
+		sndbuf = meta->sndvar->sndbuf;
+		if (!sndbuf || meta->snd_nxt == sndbuf->head_seq + sndbuf->len) {
+			dss->dsn = meta->snd_nxt;
+			dss->len = 1;
+			dss->flags |= MPTCP_DSS_MAP | MPTCP_DSS_DSN_8 | MPTCP_DSS_DATA_FIN;
+		}
+	}
+
+	if (dss->flags & MPTCP_DSS_MAP)
+		return;
+	if (cur_stream->sndvar->mptcp_sf_idx)
+		dss->prio = cur_stream->mptcp_cb->subflows
+				[cur_stream->sndvar->mptcp_sf_idx - 1].send_prio;
+	if (!dss->prio)
+		dss->sig = MPTCPPMGetSignal(cur_stream->mptcp_cb, cur_ts, &dss->sig_addr);
+}
+/*----------------------------------------------------------------------------*/
+static inline uint16_t
+MPTCPSignalLength(const struct mptcp_dss_out *dss)
+{
+	if (dss->prio)
+		return MPTCP_OPT_PRIO_LEN + 1;
+
+	switch (dss->sig) {
+	case MPTCP_SIG_ADD_ADDR:
+		return MPTCP_OPT_ADD_ADDR_LEN;
+	case MPTCP_SIG_ADD_ADDR_ECHO:
+		return MPTCP_OPT_ADD_ADDR_ECHO_LEN;
+	case MPTCP_SIG_REMOVE_ADDR:
+		return MPTCP_OPT_REMOVE_ADDR_LEN;
+	default:
+		return 0;
+	}
+}
+/*----------------------------------------------------------------------------*/
+static inline int
+GenerateDSSOption(tcp_stream *cur_stream, uint8_t *tcpopt, 
+		const struct mptcp_dss_out *dss)
+{
+	mptcp_cb *mpcb = cur_stream->mptcp_cb;
+	int i = 0;
+
+	tcpopt[i++] = TCP_OPT_MPTCP;
+	tcpopt[i++] = (dss->flags & MPTCP_DSS_MAP) ? 
+			MPTCP_OPT_DSS_MAP_LEN : MPTCP_OPT_DSS_ACK_LEN;
+	tcpopt[i++] = TCP_MPTCP_SUBTYPE_DSS << 4;
+	tcpopt[i++] = dss->flags;
+
+	/* the meta stream keeps 32 bits, the wire gets all 64 */
+	*((uint64_t *)(tcpopt + i)) = htobe64(MPTCPExpandDSN(mpcb->rcv_nxt_dsn, 
+			mpcb->mpcb_stream->rcv_nxt));
+	i += 8;
+
+	if (dss->flags & MPTCP_DSS_MAP) {
+		*((uint64_t *)(tcpopt + i)) = htobe64(MPTCPExpandDSN(mpcb->snd_una_dsn, 
+				dss->dsn));
+		i += 8;
+
+		/* relative to the ISS; 0 for a DATA_FIN without data */
+		*((uint32_t *)(tcpopt + i)) = (dss->flags & MPTCP_DSS_DATA_FIN) ? 0 : 
+				htobe32(cur_stream->snd_nxt - cur_stream->sndvar->iss);
+		i += 4;
+
+		*((uint16_t *)(tcpopt + i)) = htobe16(dss->len);
+		i += 2;
+
+		tcpopt[i++] = TCP_OPT_NOP;
+		tcpopt[i++] = TCP_OPT_NOP;
+	}
+
+	return i;
+}
+/*----------------------------------------------------------------------------*/
+/* MP_PRIO telling the peer this subflow is one of our backups; sent once,   */
+/* a lost one leaves the peer free to use the subflow as any other           */
+static inline int
+GeneratePrioOption(tcp_stream *cur_stream, uint8_t *tcpopt)
+{
+	struct mptcp_subflow *e;
+	int i = 0;
+
+	e = &cur_stream->mptcp_cb->subflows[cur_stream->sndvar->mptcp_sf_idx - 1];
+	e->send_prio = FALSE;
+
+	tcpopt[i++] = TCP_OPT_NOP;
+	tcpopt[i++] = TCP_OPT_MPTCP;
+	tcpopt[i++] = MPTCP_OPT_PRIO_LEN;
+	tcpopt[i++] = (TCP_MPTCP_SUBTYPE_PRIO << 4) | 
+			((e->backup & MPTCP_BACKUP_LOCAL) ? MPTCP_FLAG_BACKUP : 0);
+
+	return i;
+}
+/*----------------------------------------------------------------------------*/
+/* IPv4 ADD_ADDR, its echo (version 1 only) or a REMOVE_ADDR; no port, the  */
+/* peer joins on the connection's                                            */
+static inline int
+GenerateAddrOption(tcp_stream *cur_stream, uint8_t *tcpopt, 
+		const struct mptcp_dss_out *dss)
+{
+	const struct mptcp_addr *a = &dss->sig_addr;
+	int i = 0;
+
+	tcpopt[i++] = TCP_OPT_MPTCP;
+	if (dss->sig == MPTCP_SIG_REMOVE_ADDR) {
+		tcpopt[i++] = MPTCP_OPT_REMOVE_ADDR_LEN;
+		tcpopt[i++] = TCP_MPTCP_SUBTYPE_REMOVE_ADDR << 4;
+		tcpopt[i++] = a->id;
+		return i;
+	}
+
+	if (dss->sig == MPTCP_SIG_ADD_ADDR_ECHO) {
+		tcpopt[i++] = MPTCP_OPT_ADD_ADDR_ECHO_LEN;
+		tcpopt[i++] = (TCP_MPTCP_SUBTYPE_ADD_ADDR << 4) | MPTCP_FLAG_ECHO;
+	} else {
+		tcpopt[i++] = MPTCP_OPT_ADD_ADDR_LEN;
+#if TCP_MPTCP_VERSION == 0
+		tcpopt[i++] = (TCP_MPTCP_SUBTYPE_ADD_ADDR << 4) | MPTCP_ADD_ADDR_IPVER;
+#else
+		tcpopt[i++] = TCP_MPTCP_SUBTYPE_ADD_ADDR << 4;
+#endif
+	}
+	tcpopt[i++] = a->id;
+	memcpy(tcpopt + i, &a->addr, 4);
+	i += 4;
+
+#if TCP_MPTCP_VERSION != 0
+	if (dss->sig == MPTCP_SIG_ADD_ADDR) {
+		*((uint64_t *)(tcpopt + i)) = htobe64(MPTCPAddAddrHmac(
+				&cur_stream->mptcp_cb->join_hmac, a->id, a->addr, 0));
+		i += 8;
+	}
+#endif
+
+	return i;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+GenerateTCPTimestamp(tcp_stream *cur_stream, uint8_t *tcpopt, uint32_t tsval)
 {
 	uint32_t *ts = (uint32_t *)(tcpopt + 2);
 
 	tcpopt[0] = TCP_OPT_TIMESTAMP;
 	tcpopt[1] = TCP_OPT_TIMESTAMP_LEN;
-	ts[0] = htonl(cur_ts);
+	ts[0] = htonl(tsval);
 	ts[1] = htonl(cur_stream->rcvvar->ts_recent);
 }
 /*----------------------------------------------------------------------------*/
 static inline void
-GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts, 
-		uint8_t flags, uint8_t *tcpopt, uint16_t optlen, uint8_t isControlMsg, uint8_t mptcp_option, uint16_t payloadlen)
+GenerateTCPOptions(tcp_stream *cur_stream, uint32_t tsval, 
+		uint8_t flags, uint8_t *tcpopt, uint16_t optlen)
+{
+	int i = 0;
+
+	if (flags & TCP_FLAG_SYN) {
+		uint16_t mss;
+
+		/* MSS option */
+		mss = cur_stream->sndvar->mss;
+		tcpopt[i++] = TCP_OPT_MSS;
+		tcpopt[i++] = TCP_OPT_MSS_LEN;
+		tcpopt[i++] = mss >> 8;
+		tcpopt[i++] = mss % 256;
+
+		/* SACK permit */
+#if TCP_OPT_SACK_ENABLED
+#if !TCP_OPT_TIMESTAMP_ENABLED
+		tcpopt[i++] = TCP_OPT_NOP;
+		tcpopt[i++] = TCP_OPT_NOP;
+#endif /* TCP_OPT_TIMESTAMP_ENABLED */
+		tcpopt[i++] = TCP_OPT_SACK_PERMIT;
+		tcpopt[i++] = TCP_OPT_SACK_PERMIT_LEN;
+		TRACE_SACK("Local SACK permited.\n");
+#endif /* TCP_OPT_SACK_ENABLED */
+
+		/* Timestamp */
+#if TCP_OPT_TIMESTAMP_ENABLED
+#if !TCP_OPT_SACK_ENABLED
+		tcpopt[i++] = TCP_OPT_NOP;
+		tcpopt[i++] = TCP_OPT_NOP;
+#endif /* TCP_OPT_SACK_ENABLED */
+		GenerateTCPTimestamp(cur_stream, tcpopt + i, tsval);
+		i += TCP_OPT_TIMESTAMP_LEN;
+#endif /* TCP_OPT_TIMESTAMP_ENABLED */
+
+		/* Window scale */
+		tcpopt[i++] = TCP_OPT_NOP;
+		tcpopt[i++] = TCP_OPT_WSCALE;
+		tcpopt[i++] = TCP_OPT_WSCALE_LEN;
+		tcpopt[i++] = cur_stream->sndvar->wscale_mine;
+
+	} else {
+
+#if TCP_OPT_TIMESTAMP_ENABLED
+		tcpopt[i++] = TCP_OPT_NOP;
+		tcpopt[i++] = TCP_OPT_NOP;
+		GenerateTCPTimestamp(cur_stream, tcpopt + i, tsval);
+		i += TCP_OPT_TIMESTAMP_LEN;
+#endif
+	}
+
+	assert (i == optlen);
+}
+/*----------------------------------------------------------------------------*/
+/* options of a subflow of an MPTCP connection, or of a SYN offering one     */
+static inline void
+GenerateTCPOptionsMPTCP(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t tsval, 
+		uint8_t flags, uint8_t *tcpopt, uint16_t optlen, uint8_t isControlMsg, uint8_t mptcp_option, uint16_t payloadlen, 
+		const struct mptcp_dss_out *dss)
 {
 	int i = 0;
 
@@ -206,8 +448,21 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 		tcpopt[i++] = mss >> 8;
 		tcpopt[i++] = mss % 256;
 
+		/* the key is kept across SYN retransmissions */
+		if (mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE && !cur_stream->mptcp_cb) {
+			mptcp_cb *mpcb = MPTCPCreateCB(mtcp, cur_stream->socket ? 
+					cur_stream->socket->mptcp_sched : MPTCP_SCHED_MINRTT);
+			if (mpcb && MPTCPAttachSubflow(cur_stream, mpcb) < 0)
+				MPTCPDestroyCB(mtcp, mpcb);
+		}
+
 		// MPTCP
-		if(mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE){
+		if(mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE && !cur_stream->mptcp_cb){
+			/* no token left: a plain SYN, the option space is padded */
+			memset(tcpopt + i, TCP_OPT_NOP, MPTCP_OPT_CAPABLE_SYN_LEN);
+			i += MPTCP_OPT_CAPABLE_SYN_LEN;
+		}
+		else if(mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE){
 
 			/* MPTCP Option Kind */
 			tcpopt[i++] = TCP_OPT_MPTCP;
@@ -223,13 +478,6 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 			// Haathim_TODO: (above)
 			tcpopt[i++] = 0x01;
 			
-			cur_stream->mptcp_cb = (mptcp_cb *)calloc(1, sizeof(mptcp_cb));
-			uint64_t random_number = 0;
-			for (int i = 0; i < 8; ++i) {
-				random_number = (random_number << 8) | (rand() & 0xFF);
-			}
-			cur_stream->mptcp_cb->myKey = random_number;
-
 			tcpopt[i++] = cur_stream->mptcp_cb->myKey >> 56;
 			tcpopt[i++] = cur_stream->mptcp_cb->myKey >> 48;
 			tcpopt[i++] = cur_stream->mptcp_cb->myKey >> 40;
@@ -248,15 +496,17 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 			// Length
 			tcpopt[i++] = 12;
 
-			// MPTCP MP_JOIN Subtype
-			tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_JOIN << 4) | TCP_MPTCP_VERSION);
+			// MPTCP MP_JOIN Subtype and B flag
+			tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_JOIN << 4) | 
+					MPTCPJoinBackupFlag(cur_stream));
 		
 			//Address ID
-			tcpopt[i++] = 0x02;
+			tcpopt[i++] = MPTCPPMLocalAddrId(cur_stream->mptcp_cb, 
+					cur_stream->saddr);
 
 			// Reciver's Token (32 bits)
 			
-			uint32_t token = GetToken(cur_stream->mptcp_cb->peerKey);
+			uint32_t token = cur_stream->mptcp_cb->peer_token;
 			
 			tcpopt[i++] = token >> 24;
 			tcpopt[i++] = token >> 16;
@@ -264,12 +514,10 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 			tcpopt[i++] = token;
 
 			// Sender's Random Number (32 bits)
-			tcpopt[i++] = 0x00;
-			tcpopt[i++] = 0x00;
-			tcpopt[i++] = 0x00;
-			tcpopt[i++] = 0x20;
-
-			cur_stream->myRandomNumber = 32;
+			tcpopt[i++] = cur_stream->myRandomNumber >> 24;
+			tcpopt[i++] = cur_stream->myRandomNumber >> 16;
+			tcpopt[i++] = cur_stream->myRandomNumber >> 8;
+			tcpopt[i++] = cur_stream->myRandomNumber;
 		}
 		else{
 
@@ -292,7 +540,7 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 		tcpopt[i++] = TCP_OPT_NOP;
 		tcpopt[i++] = TCP_OPT_NOP;
 #endif /* TCP_OPT_SACK_ENABLED */
-		GenerateTCPTimestamp(cur_stream, tcpopt + i, cur_ts);
+		GenerateTCPTimestamp(cur_stream, tcpopt + i, tsval);
 		i += TCP_OPT_TIMESTAMP_LEN;
 #endif /* TCP_OPT_TIMESTAMP_ENABLED */
 
@@ -304,6 +552,14 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 		
 	}
 	else if(flags == (TCP_FLAG_SYN | TCP_FLAG_ACK) && (cur_stream->isReceivedMPCapableSYN || cur_stream->isReceivedMPJoinSYN)){
+		uint16_t mss;
+
+		/* MSS option */
+		mss = cur_stream->sndvar->mss;
+		tcpopt[i++] = TCP_OPT_MSS;
+		tcpopt[i++] = TCP_OPT_MSS_LEN;
+		tcpopt[i++] = mss >> 8;
+		tcpopt[i++] = mss % 256;
 
 		// MPTCP
 		if(mptcp_option == TCP_MPTCP_SUBTYPE_CAPABLE){
@@ -339,15 +595,17 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 			// Length
 			tcpopt[i++] = MPTCP_OPT_JOIN_SYNACK_LEN;
 
-			// MPTCP MP_JOIN Subtype
-			tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_JOIN << 4) | TCP_MPTCP_VERSION);
+			// MPTCP MP_JOIN Subtype and B flag
+			tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_JOIN << 4) | 
+					MPTCPJoinBackupFlag(cur_stream));
 
 			// Address ID
-			tcpopt[i++] = 0x00;
+			tcpopt[i++] = MPTCPPMLocalAddrId(cur_stream->mptcp_cb, 
+					cur_stream->saddr);
 		
 			// Truncated HMAC 64 bits
-			unsigned char hash[20];
-			mp_join_hmac_generator(htobe64((uint64_t)(cur_stream->mptcp_cb->myKey)), htobe64(cur_stream->mptcp_cb->peerKey), htobe32(cur_stream->myRandomNumber), htobe32(cur_stream->peerRandomNumber), hash);
+			uint8_t hash[MPTCP_SHA256_LEN];
+			MPTCPJoinHmac(cur_stream, hash);
 			for(int j = 0; j < 8; j++){
 				tcpopt[i++] = hash[j];
 			}
@@ -381,7 +639,7 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 		tcpopt[i++] = TCP_OPT_NOP;
 		tcpopt[i++] = TCP_OPT_NOP;
 #endif /* TCP_OPT_SACK_ENABLED */
-		GenerateTCPTimestamp(cur_stream, tcpopt + i, cur_ts);
+		GenerateTCPTimestamp(cur_stream, tcpopt + i, tsval);
 		i += TCP_OPT_TIMESTAMP_LEN;
 #endif /* TCP_OPT_TIMESTAMP_ENABLED */
 
@@ -434,8 +692,8 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 			// MPTCP DSS Subtype
 			tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0);
 
-			// Flags (Data ACK present)
-			tcpopt[i++] = 0x01;
+			// Flags (4 byte Data ACK present, there is no room for 8)
+			tcpopt[i++] = MPTCP_DSS_DATA_ACK;
 
 			// Data ACK
 			*((uint32_t*)(tcpopt + (i))) = htobe32(cur_stream->mptcp_cb->mpcb_stream->rcv_nxt);
@@ -458,9 +716,9 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 			tcpopt[i++] = 0x00;
 
 			// Sender's HMAC 160 bits
-			unsigned char hash[20];
+			uint8_t hash[MPTCP_SHA256_LEN];
 			
-			mp_join_hmac_generator(htobe64((uint64_t)(cur_stream->mptcp_cb->myKey)), htobe64(cur_stream->mptcp_cb->peerKey), htobe32(cur_stream->myRandomNumber), htobe32(cur_stream->peerRandomNumber), hash);
+			MPTCPJoinHmac(cur_stream, hash);
 
 			for(int j = 0; j < 20; j++){
 				tcpopt[i++] = hash[j];
@@ -474,15 +732,9 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 #if TCP_OPT_TIMESTAMP_ENABLED
 		tcpopt[i++] = TCP_OPT_NOP;
 		tcpopt[i++] = TCP_OPT_NOP;
-		GenerateTCPTimestamp(cur_stream, tcpopt + i, cur_ts);
+		GenerateTCPTimestamp(cur_stream, tcpopt + i, tsval);
 		i += TCP_OPT_TIMESTAMP_LEN;
 #endif
-
-#if TCP_OPT_SACK_ENABLED
-		if (flags & TCP_OPT_SACK) {
-			// i += GenerateSACKOption(cur_stream, tcpopt + i);
-		}
-#endif
 		
 		
 	}
@@ -491,86 +743,19 @@ GenerateTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts,
 #if TCP_OPT_TIMESTAMP_ENABLED
 		tcpopt[i++] = TCP_OPT_NOP;
 		tcpopt[i++] = TCP_OPT_NOP;
-		GenerateTCPTimestamp(cur_stream, tcpopt + i, cur_ts);
+		GenerateTCPTimestamp(cur_stream, tcpopt + i, tsval);
 		i += TCP_OPT_TIMESTAMP_LEN;
 #endif
-
-#if TCP_OPT_SACK_ENABLED
-		if (flags & TCP_OPT_SACK) {
-			// i += GenerateSACKOption(cur_stream, tcpopt + i);
-		}
-#endif
 	}
 
 
 
-	// Check if no SYN, because no SYN means data right?
-	// or just check payload length?
-	// Haathim_TODO: Need to check here if belonging to a MPTCP connection, else for normal also will send DSN
-	if(payloadlen > 0){
-		
-		// Add DSS option
-
-		// Add MPTCP option Kind
-		tcpopt[i++] = TCP_OPT_MPTCP;
-
-		// Length = 18 (if using 4 octets for Data Sequence No) & No Checksum
-		tcpopt[i++] = 20;
-
-		// MPTCP DSS Subtype
-		tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0);
-
-		// Flags (Data sequence and ACK present)
-		tcpopt[i++] = 0x05;
-
-		// Data ACK
-		*((uint32_t*)(tcpopt + (i))) = htobe32(cur_stream->mptcp_cb->mpcb_stream->rcv_nxt);
-		// printf("Sending DATA-ACK: %u\n", cur_stream->mptcp_cb->mpcb_stream->rcv_nxt);
-		i += 4;
-
-		// Data Sequence Number
-		*((uint32_t*)(tcpopt + (i))) = htobe32(cur_stream->mptcp_cb->mpcb_stream->snd_nxt);
-
-		cur_stream->mptcp_cb->mpcb_stream->snd_nxt += payloadlen;
-		
-		i += 4;
-
-		// Subflow Sequence Number
-		*((uint32_t*)(tcpopt + (i))) = htobe32(cur_stream->snd_nxt - cur_stream->sndvar->iss);
-		// *((uint32_t*)(tcpopt + (i))) = htobe32(1);
-
-		i += 4;
-
-		// Data Level Length
-		*((uint16_t*)(tcpopt + (i))) = htobe16(payloadlen);
-
-		i += 2;
-
-	}
-	else if (!isControlMsg || flags & TCP_FLAG_FIN){
-		// if(flags & TCP_FLAG_FIN) printf("Generating DATA ACK for packet with FIN\n");
-		// Add DSS option
-
-		// Add MPTCP option Kind
-		tcpopt[i++] = TCP_OPT_MPTCP;
-
-		// Length = 18 (if using 4 octets for Data Sequence No) & No Checksum
-		tcpopt[i++] = 8;
-
-		// MPTCP DSS Subtype
-		tcpopt[i++] = ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0);
-
-		// Flags (Data sequence and ACK present)
-		tcpopt[i++] = 0x01;
-
-		// Data ACK
-		*((uint32_t*)(tcpopt + (i))) = htobe32(cur_stream->mptcp_cb->mpcb_stream->rcv_nxt);
-		// printf("Sending DATA-ACK: %u\n", cur_stream->mptcp_cb->mpcb_stream->rcv_nxt);
-
-		i += 4;
-
-
-	}
+	if (dss->flags)
+		i += GenerateDSSOption(cur_stream, tcpopt + i, dss);
+	if (dss->prio)
+		i += GeneratePrioOption(cur_stream, tcpopt + i);
+	else if (dss->sig)
+		i += GenerateAddrOption(cur_stream, tcpopt + i, dss);
 
 	assert (i == optlen);
 }
@@ -629,7 +814,7 @@ SendTCPPacketStandalone(struct mtcp_manager *mtcp,
 	tcpopt[1] = TCP_OPT_NOP;
 	tcpopt[2] = TCP_OPT_TIMESTAMP;
 	tcpopt[3] = TCP_OPT_TIMESTAMP_LEN;
-	ts[0] = htonl(cur_ts);
+	ts[0] = htonl(mtcp->cur_tsval);
 	ts[1] = htonl(echo_ts);
 
 	tcph->doff = (TCP_HEADER_LEN + optlen) >> 2;
@@ -667,40 +852,38 @@ SendTCPPacket(struct mtcp_manager *mtcp, tcp_stream *cur_stream,
 		uint32_t cur_ts, uint8_t flags, uint8_t *payload, uint16_t payloadlen, uint8_t isControlMsg)
 {
 	struct tcphdr *tcph;
-	uint16_t optlen;
+	mptcp_cb *mpcb;
+	struct mptcp_dss_out dss;
+	uint16_t optlen, sacklen = 0;
 	uint8_t wscale = 0;
 	uint32_t window32 = 0;
 	int rc = -1;
 
-	uint8_t mptcp_option = TCP_MPTCP_SUBTYPE_CAPABLE;
+	uint8_t mptcp_option = TCP_MPTCP_SUBTYPE_NONE;
 
-	if (cur_stream->isMPJOINStream || cur_stream->isReceivedMPJoinSYN)
-	{
+	/* a SYN offers MP_CAPABLE; without an mptcp_cb afterwards (peer did */
+	/* not echo it, or no token was left) the stream is plain TCP        */
+	mpcb = cur_stream->mptcp_cb;
+	if ((cur_stream->isMPJOINStream || cur_stream->isReceivedMPJoinSYN) && mpcb)
 		mptcp_option = TCP_MPTCP_SUBTYPE_JOIN;
-	}
+	else if (mpcb || flags == TCP_FLAG_SYN)
+		mptcp_option = TCP_MPTCP_SUBTYPE_CAPABLE;
 
-	// If sending a SYN/ACK have to check if first SYN was with MP_CAPABLE OR NOT
-	// Can we use isControlMsg for that also? as in set isControlMsg to 0 if its is a normal SYN/ACK
-	// Haathim_TODO: Cleanup
-	if(flags == (TCP_FLAG_SYN | TCP_FLAG_ACK)){
-		if(cur_stream->isReceivedMPCapableSYN){
-			optlen = CalculateOptionLengthMPTCP(flags, mptcp_option, 0);
-		}
-		
-		else{
-			optlen = CalculateOptionLength(flags);
-		}
+	dss.flags = 0;
+	dss.prio = FALSE;
+	dss.sig = MPTCP_SIG_NONE;
+	if (mptcp_option == TCP_MPTCP_SUBTYPE_NONE) {
+		optlen = CalculateOptionLength(flags);
 	}
-	else if(isControlMsg && !(flags & TCP_FLAG_FIN)){
-		// Haathim_TODO: As the server, when sending SYN/ACK (ctrl msg) have to check if recevied syn before calling below fn (optionlength)
+	else if(flags == (TCP_FLAG_SYN | TCP_FLAG_ACK) || 
+			(isControlMsg && !(flags & TCP_FLAG_FIN))){
 		optlen = CalculateOptionLengthMPTCP(flags, mptcp_option, 0);
 	}
-	else if(cur_stream->mptcp_cb != NULL){
-		// Here it should be not a control message but a data packet. Thats why im passing 2 without 0 or 1
-		optlen = CalculateOptionLengthMPTCP(flags, 2, payloadlen);
-	}
 	else{
-		optlen = CalculateOptionLength(flags);
+		/* data, plain ACKs and FINs carry a DSS */
+		MPTCPGetDSS(cur_stream, cur_ts, flags, payloadlen, &dss);
+		optlen = CalculateOptionLengthMPTCP(flags, TCP_MPTCP_SUBTYPE_DSS, dss.flags) + 
+				MPTCPSignalLength(&dss);
 	}
 	
 
@@ -709,12 +892,20 @@ SendTCPPacket(struct mtcp_manager *mtcp, tcp_stream *cur_stream,
 		return ERROR;
 	}
 
+#if TCP_OPT_SACK_ENABLED
+	/* ACKs report what we hold out of order in the option space left */
+	if ((flags & TCP_FLAG_ACK) && !(flags & TCP_FLAG_SYN) && 
+			cur_stream->sack_permit)
+		sacklen = SACKOptionLength(cur_stream, 
+				MIN(TCP_MAX_OPT_LEN, cur_stream->sndvar->mss - payloadlen) - optlen);
+#endif
+
 	tcph = (struct tcphdr *)IPOutput(mtcp, cur_stream, 
-			TCP_HEADER_LEN + optlen + payloadlen);
+			TCP_HEADER_LEN + optlen + sacklen + payloadlen);
 	if (tcph == NULL) {
 		return -2;
 	}
-	memset(tcph, 0, TCP_HEADER_LEN + optlen);
+	memset(tcph, 0, TCP_HEADER_LEN + optlen + sacklen);
 
 	tcph->source = cur_stream->sport;
 	tcph->dest = cur_stream->dport;
@@ -765,7 +956,6 @@ SendTCPPacket(struct mtcp_manager *mtcp, tcp_stream *cur_stream,
 		tcph->ack_seq = htonl(cur_stream->rcv_nxt);
 		cur_stream->sndvar->ts_lastack_sent = cur_ts;
 		cur_stream->last_active_ts = cur_ts;
-		UpdateTimeoutList(mtcp, cur_stream);
 	}
 
 	if (flags & TCP_FLAG_SYN) {
@@ -774,18 +964,33 @@ SendTCPPacket(struct mtcp_manager *mtcp, tcp_stream *cur_stream,
 		wscale = cur_stream->sndvar->wscale_mine;
 	}
 
-	//Haathim_TODO: This is where window value is set, need to set window of mpcb?
-	// if(cur_stream->mptcp_cb != NULL) window32 = cur_stream->mptcp_cb->mpcb_stream->rcvvar->rcv_wnd >> wscale;
-	// else window32 = cur_stream->rcvvar->rcv_wnd >> wscale;
+	/* MPTCP subflows advertise the connection-level window, relative to */
+	/* the DATA_ACK carried in the same segment                          */
+	if (mpcb && mpcb->mpcb_stream && !IS_MPCB_STREAM(cur_stream))
+		cur_stream->rcvvar->rcv_wnd = MPTCPRcvWindow(mpcb);
 	window32 = cur_stream->rcvvar->rcv_wnd >> wscale;
 	tcph->window = htons((uint16_t)MIN(window32, TCP_MAX_WINDOW));
 	/* if the advertised window is 0, we need to advertise again later */
 	if (window32 == 0) {
-		cur_stream->need_wnd_adv = TRUE;
+		/* reads of the meta buffer send the update on the master */
+		if (mpcb && mpcb->mpcb_stream && mpcb->master)
+			mpcb->master->need_wnd_adv = TRUE;
+		else
+			cur_stream->need_wnd_adv = TRUE;
 	}
 
-	GenerateTCPOptions(cur_stream, cur_ts, flags, 
-			(uint8_t *)tcph + TCP_HEADER_LEN, optlen, isControlMsg, mptcp_option, payloadlen);
+	if (mptcp_option == TCP_MPTCP_SUBTYPE_NONE)
+		GenerateTCPOptions(cur_stream, mtcp->cur_tsval, flags, 
+				(uint8_t *)tcph + TCP_HEADER_LEN, optlen);
+	else
+		GenerateTCPOptionsMPTCP(mtcp, cur_stream, mtcp->cur_tsval, flags, 
+				(uint8_t *)tcph + TCP_HEADER_LEN, optlen, isControlMsg, mptcp_option, payloadlen, 
+				&dss);
+#if TCP_OPT_SACK_ENABLED
+	if (sacklen)
+		optlen += GenerateSACKOption(cur_stream, 
+				(uint8_t *)tcph + TCP_HEADER_LEN + optlen, sacklen);
+#endif
 	
 	tcph->doff = (TCP_HEADER_LEN + optlen) >> 2;
 	// copy payload if exist
@@ -810,6 +1015,15 @@ SendTCPPacket(struct mtcp_manager *mtcp, tcp_stream *cur_stream,
 	
 	cur_stream->snd_nxt += payloadlen;
 
+	/* time one new segment per RTT, see CancelRTTSample() */
+	if (payloadlen > 0 && !cur_stream->sndvar->rtt_timing && 
+			TCP_SEQ_GEQ(cur_stream->snd_nxt - payloadlen, 
+			cur_stream->sndvar->rtt_end)) {
+		cur_stream->sndvar->rtt_timing = TRUE;
+		cur_stream->sndvar->rtt_ts = cur_ts;
+		cur_stream->sndvar->rtt_end = cur_stream->snd_nxt;
+	}
+
 	if (tcph->syn || tcph->fin) {
 		cur_stream->snd_nxt++;
 		payloadlen++;
@@ -832,6 +1046,341 @@ SendTCPPacket(struct mtcp_manager *mtcp, tcp_stream *cur_stream,
 	return payloadlen;
 }
 /*----------------------------------------------------------------------------*/
+/* room the windows leave for new data at seq: in SACK recovery cwnd limits  */
+/* pipe, what RFC 6675 counts in flight, rather than snd_nxt - snd_una       */
+static inline int
+SendWindowLeft(tcp_stream *cur_stream, uint32_t seq)
+{
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+
+#if TCP_OPT_SACK_ENABLED
+	if (sndvar->sack_recovery)
+		return MIN((int)sndvar->cwnd - (int)SACKPipe(cur_stream), 
+				(int)sndvar->peer_wnd - (int)(seq - sndvar->snd_una));
+#endif
+	return MIN(sndvar->cwnd, sndvar->peer_wnd) - (seq - sndvar->snd_una);
+}
+#if TCP_OPT_SACK_ENABLED
+/*----------------------------------------------------------------------------*/
+/* SendSACKRetransmits: resends snd_una as recovery starts, then the holes   */
+/* the SACK scoreboard marks lost, lowest first, while pipe leaves a segment */
+/* of room in cwnd. snd_nxt stays at the highest byte sent. The caller holds */
+/* the write_lock of the buffer the payload comes from. Returns the packets  */
+/* sent, -2 if out of tx buffers, -3 if cwnd is full                         */
+/*----------------------------------------------------------------------------*/
+static int
+SendSACKRetransmits(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts)
+{
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+	struct tcp_send_buffer *buf;
+	uint32_t seq, len, dsn, maplen, maxlen, snd_nxt;
+	uint8_t *data;
+	int packets = 0;
+	int ret;
+
+	if (sndvar->sndbuf) {
+		buf = sndvar->sndbuf;
+		maxlen = sndvar->mss - CalculateOptionLength(TCP_FLAG_ACK);
+	} else {
+		/* MPTCP subflow: the payload lives in the meta send buffer */
+		buf = cur_stream->mptcp_cb->mpcb_stream->sndvar->sndbuf;
+		maxlen = sndvar->mss - CalculateOptionLengthMPTCP(TCP_FLAG_ACK, 
+				TCP_MPTCP_SUBTYPE_DSS, MPTCP_DSS_MAP);
+	}
+
+	for (;;) {
+		if (sndvar->sack_rxt_una) {
+			/* the first segment of the recovery, up to the first SACKed */
+			/* block; it does not wait for room in pipe                   */
+			seq = sndvar->snd_una;
+			len = (cur_stream->rcvvar->sacks ? 
+					cur_stream->rcvvar->sack_table[0].left_edge : 
+					cur_stream->snd_nxt) - seq;
+			if ((int32_t)len <= 0) {
+				sndvar->sack_rxt_una = FALSE;
+				continue;
+			}
+		} else if (!SACKNextSeg(cur_stream, &seq, &len)) {
+			break;
+		} else if (SACKPipe(cur_stream) + sndvar->mss > sndvar->cwnd) {
+			return -3;
+		}
+
+		if (sndvar->sndbuf) {
+			data = buf->head + (seq - buf->head_seq);
+		} else {
+			if (MPTCPMapLookup(sndvar->dss_maps, seq, &dsn, &maplen) < 0 || 
+					TCP_SEQ_LT(dsn, buf->head_seq)) {
+				TRACE_ERROR("Stream %d: no data mapped at seq %u\n", 
+						cur_stream->id, seq);
+				sndvar->sack_rxt_una = FALSE;
+				break;
+			}
+			len = MIN(len, maplen);
+			data = buf->head + (dsn - buf->head_seq);
+		}
+		len = MIN(len, maxlen);
+
+		TRACE_LOSS("Stream %d: SACK retransmission. seq: %u, len: %u\n", 
+				cur_stream->id, seq, len);
+		CancelRTTSample(cur_stream);
+		snd_nxt = cur_stream->snd_nxt;
+		cur_stream->snd_nxt = seq;
+		ret = SendTCPPacket(mtcp, cur_stream, cur_ts, TCP_FLAG_ACK, data, len, 0);
+		cur_stream->snd_nxt = snd_nxt;
+		if (ret < 0)
+			return -2;
+
+		sndvar->sack_rxt_una = FALSE;
+		if (TCP_SEQ_LT(sndvar->high_rxt, seq + len))
+			sndvar->high_rxt = seq + len;
+		packets++;
+	}
+
+	return packets;
+}
+#endif /* TCP_OPT_SACK_ENABLED */
+/*----------------------------------------------------------------------------*/
+/* SendMPTCPMapped: sends mapped subflow data from snd_nxt, one mapping after */
+/* the other; a segment never crosses the end of a mapping. The payload comes */
+/* from the meta send buffer, whose write_lock the caller holds. Returns the  */
+/* packets sent, -2 if out of tx buffers, -3 if the window is full            */
+/*----------------------------------------------------------------------------*/
+static int
+SendMPTCPMapped(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts)
+{
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+	struct mptcp_map_queue *mq = sndvar->dss_maps;
+	struct tcp_send_buffer *metabuf = 
+			cur_stream->mptcp_cb->mpcb_stream->sndvar->sndbuf;
+	uint32_t seq, dsn, len, maxlen;
+	int remaining_window;
+	int packets = 0;
+
+#if TCP_OPT_SACK_ENABLED
+	if (sndvar->sack_recovery && 
+			(packets = SendSACKRetransmits(mtcp, cur_stream, cur_ts)) < 0)
+		return packets;
+#endif
+
+	/* sized for the segments that carry a mapping */
+	maxlen = sndvar->mss - CalculateOptionLengthMPTCP(TCP_FLAG_ACK, 
+			TCP_MPTCP_SUBTYPE_DSS, MPTCP_DSS_MAP);
+
+	while (TCP_SEQ_LT(cur_stream->snd_nxt, MPTCP_MAP_END(mq))) {
+		seq = cur_stream->snd_nxt;
+		if (MPTCPMapLookup(mq, seq, &dsn, &len) < 0 || 
+				TCP_SEQ_LT(dsn, metabuf->head_seq)) {
+			TRACE_ERROR("Stream %d: no data mapped at seq %u\n", 
+					cur_stream->id, seq);
+			break;
+		}
+		len = MIN(len, maxlen);
+
+		remaining_window = SendWindowLeft(cur_stream, seq);
+		if (remaining_window <= 0 ||
+		    (remaining_window < (int)len && seq - sndvar->snd_una > 0))
+			return -3;
+		len = MIN(len, (uint32_t)remaining_window);
+
+		if (SendTCPPacket(mtcp, cur_stream, cur_ts, TCP_FLAG_ACK, 
+					metabuf->head + (dsn - metabuf->head_seq), len, 0) < 0)
+			return -2;
+		packets++;
+	}
+
+	return packets;
+}
+/*----------------------------------------------------------------------------*/
+/* bytes of the next mapping on sf, at most len: whole segments, as many as  */
+/* its window takes up to MPTCP_MAP_MAX_SEGS, so one DSS covers them all      */
+/*----------------------------------------------------------------------------*/
+static inline uint32_t
+MPTCPMappingLength(tcp_stream *sf, uint32_t len)
+{
+	uint32_t maxlen, space;
+
+	maxlen = sf->sndvar->mss - CalculateOptionLengthMPTCP(TCP_FLAG_ACK, 
+			TCP_MPTCP_SUBTYPE_DSS, MPTCP_DSS_MAP);
+	space = MIN(MPTCPSubflowSendSpace(sf), maxlen * MPTCP_MAP_MAX_SEGS);
+	if (space > maxlen)
+		space -= space % maxlen;
+
+	return MIN(len, MIN(space, UINT16_MAX));
+}
+/*----------------------------------------------------------------------------*/
+/* SendMPTCPMapping: maps len bytes of the meta send buffer from dsn onto a   */
+/* subflow and sends them; the payload is not copied to the subflow. What    */
+/* can not go out now stays mapped and the subflow sends it with its next    */
+/* flush. Returns len, -1 if nothing was mapped, -2 if out of tx buffers      */
+/*----------------------------------------------------------------------------*/
+static int
+SendMPTCPMapping(mtcp_manager_t mtcp, tcp_stream *sf, uint32_t cur_ts, 
+		uint32_t len, uint32_t dsn)
+{
+	struct tcp_send_vars *sndvar = sf->sndvar;
+	int ret;
+
+	if (!sndvar->dss_maps) {
+		sndvar->dss_maps = MPTCPMapQueueCreate(sndvar->iss + 1);
+		if (!sndvar->dss_maps)
+			return -1;
+	}
+
+	/* MPTCPSubflowSendSpace() made sure snd_nxt is the end of the queue */
+	if (MPTCPMapAdd(sndvar->dss_maps, sf->snd_nxt, dsn, len) < 0)
+		return -1;
+	sf->mptcp_cb->subflows[sndvar->mptcp_sf_idx - 1].bytes_sched += len;
+	sf->mptcp_cb->bytes_sched += len;
+
+	ret = SendMPTCPMapped(mtcp, sf, cur_ts);
+	if (ret < 0)
+		AddtoSendList(mtcp, sf);
+	MPTCPSubflowRefresh(sf);
+
+	return (ret == -2) ? -2 : (int)len;
+}
+/*----------------------------------------------------------------------------*/
+/* FlushMPTCPReinject: sends the queued reinjection ranges again, each on the */
+/* fastest subflow with room other than the one it was stuck on. Called with  */
+/* the meta write_lock held; returns packets sent, -3 if out of tx buffers    */
+/*----------------------------------------------------------------------------*/
+static int
+FlushMPTCPReinject(mtcp_manager_t mtcp, tcp_stream *meta, uint32_t cur_ts)
+{
+	mptcp_cb *mpcb = meta->mptcp_cb;
+	tcp_stream *sf;
+	uint32_t dsn, len;
+	uint8_t from;
+	int ret;
+	int packets = 0;
+
+	while (MPTCPReinjectPeek(mpcb, &dsn, &len, &from) == 0) {
+		sf = MPTCPReinjectGetSubflow(mpcb, from);
+		if (!sf)
+			break;
+
+		len = MPTCPMappingLength(sf, len);
+		if (len == 0)
+			break;
+
+		ret = SendMPTCPMapping(mtcp, sf, cur_ts, len, dsn);
+		if (ret == -1)
+			break;
+		MPTCPReinjectConsume(mpcb, len);
+		mpcb->subflows[sf->sndvar->mptcp_sf_idx - 1].bytes_reinjected += len;
+		mpcb->bytes_reinjected += len;
+		mpcb->reinjections++;
+		packets++;
+
+		if (ret == -2)
+			return -3;
+	}
+
+	return packets;
+}
+/*----------------------------------------------------------------------------*/
+/* FlushMPTCPMetaBuffer: hands the unsent part of the connection-level buffer */
+/* to the subflows one mapping at a time, as picked by the scheduler. The     */
+/* data stays in the buffer until it is DATA_ACKed (MPTCPReleaseMetaBuffer).  */
+/* Reinjected data goes first. Returns 0 when the scheduler or the peer's    */
+/* connection-level window has no room; ProcessACK re-queues the meta stream  */
+/* once a subflow opens its window again, MPTCPProcessDataAck once the        */
+/* connection-level window opens.                                             */
+/*----------------------------------------------------------------------------*/
+static int
+FlushMPTCPMetaBuffer(mtcp_manager_t mtcp, tcp_stream *meta, uint32_t cur_ts)
+{
+	mptcp_cb *mpcb = meta->mptcp_cb;
+	struct tcp_send_buffer *sndbuf = meta->sndvar->sndbuf;
+	tcp_stream *subflows[MPTCP_MAX_SUBFLOWS];
+	uint32_t len, dsn, wnd_end;
+	int nsf, i, sent, ret;
+	int packets = 0;
+
+	if (!sndbuf)
+		return 0;
+
+	/* a scheduler or weights the application set since the last flush */
+	if (mpcb->master && mpcb->master->socket)
+		MPTCPSchedSync(mpcb, mpcb->master->socket);
+
+	/* the peer's connection-level window, on top of each subflow's own */
+	wnd_end = meta->sndvar->snd_una + meta->sndvar->peer_wnd;
+
+	SBUF_LOCK(&meta->sndvar->write_lock);
+
+	packets = FlushMPTCPReinject(mtcp, meta, cur_ts);
+	if (packets < 0) {
+		SBUF_UNLOCK(&meta->sndvar->write_lock);
+		return packets;
+	}
+
+	while (TCP_SEQ_LT(meta->snd_nxt, sndbuf->head_seq + sndbuf->len)) {
+		nsf = mpcb->sched->get_subflows(mpcb, subflows, MPTCP_MAX_SUBFLOWS);
+		if (nsf <= 0)
+			break;
+
+		dsn = meta->snd_nxt;
+		if (!TCP_SEQ_LT(dsn, wnd_end)) {
+			/* a subflow has room but the window is full: its head may */
+			/* be stuck on a slower subflow, send it again on this one */
+			if (MPTCPOpportunisticReinject(mpcb, cur_ts)) {
+				ret = FlushMPTCPReinject(mtcp, meta, cur_ts);
+				packets = (ret < 0) ? ret : packets + ret;
+			}
+			break;
+		}
+		len = MIN(sndbuf->head_seq + sndbuf->len - dsn, wnd_end - dsn);
+		for (i = 0; i < nsf; i++)
+			len = MPTCPMappingLength(subflows[i], len);
+		if (len == 0)
+			break;
+
+		sent = 0;
+		ret = 0;
+		for (i = 0; i < nsf; i++) {
+			ret = SendMPTCPMapping(mtcp, subflows[i], cur_ts, len, dsn);
+			if (ret > 0 || ret == -2)
+				sent++;
+			if (ret == -2)
+				break;
+		}
+		if (!sent)
+			break;
+
+		meta->snd_nxt = dsn + len;
+		packets++;
+
+		if (ret == -2) {
+			/* out of tx buffers, continue in the next round */
+			packets = -3;
+			break;
+		}
+	}
+
+	SBUF_UNLOCK(&meta->sndvar->write_lock);
+
+	return packets;
+}
+/*----------------------------------------------------------------------------*/
+/* FlushMPTCPSubflow: (re)sends mapped subflow data from snd_nxt, e.g. after  */
+/* an RTO or fast retransmit; the payload comes from the meta send buffer     */
+/* and a segment starting a mapping carries that mapping again               */
+/*----------------------------------------------------------------------------*/
+static int
+FlushMPTCPSubflow(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts)
+{
+	tcp_stream *meta = cur_stream->mptcp_cb->mpcb_stream;
+	int packets;
+
+	SBUF_LOCK(&meta->sndvar->write_lock);
+	packets = SendMPTCPMapped(mtcp, cur_stream, cur_ts);
+	SBUF_UNLOCK(&meta->sndvar->write_lock);
+
+	return (packets < 0) ? -3 : packets;
+}
+/*----------------------------------------------------------------------------*/
 static int
 FlushTCPSendingBuffer(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts)
 {
@@ -957,6 +1506,12 @@ FlushTCPSendingBuffer(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_
 		packets = 0;
 		goto out;
 	}
+
+#if TCP_OPT_SACK_ENABLED
+	if (sndvar->sack_recovery && 
+			(packets = SendSACKRetransmits(mtcp, cur_stream, cur_ts)) < 0)
+		goto out;
+#endif
 	
 	while (1) {
 #if USE_CCP
@@ -1006,16 +1561,7 @@ FlushTCPSendingBuffer(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_
 		if (len == 0)
 			break;
 
-#if TCP_OPT_SACK_ENABLED
-		if (SeqIsSacked(cur_stream, seq)) {
-			TRACE_DBG("!! SKIPPING %u\n", seq - sndvar->iss);
-			cur_stream->snd_nxt += len;
-			continue;
-		}
-#endif
-
-		remaining_window = MIN(sndvar->cwnd, sndvar->peer_wnd)
-			               - (seq - sndvar->snd_una);
+		remaining_window = SendWindowLeft(cur_stream, seq);
 		/* if there is no space in the window */
 		if (remaining_window <= 0 ||
 		    (remaining_window < sndvar->mss && seq - sndvar->snd_una > 0)) {
@@ -1038,7 +1584,7 @@ FlushTCPSendingBuffer(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_
 		/* payload size limited by remaining window space */
 		len = MIN(len, remaining_window);
 		/* payload size limited by TCP MSS */
-		pkt_len = MIN(len, sndvar->mss - CalculateOptionLengthMPTCP(TCP_FLAG_ACK, TCP_MPTCP_SUBTYPE_CAPABLE, len));
+		pkt_len = MIN(len, sndvar->mss - CalculateOptionLength(TCP_FLAG_ACK));
 
 #if RATE_LIMIT_ENABLED
 		// update rate
@@ -1257,13 +1803,21 @@ WriteTCPDataList(mtcp_manager_t mtcp,
 					/* delay sending data after until on_control_list becomes off */
 					//TRACE_DBG("Stream %u: delay sending data.\n", cur_stream->id);
 					ret = -1;
+				} else if (IS_MPCB_STREAM(cur_stream)) {
+					ret = FlushMPTCPMetaBuffer(mtcp, cur_stream, cur_ts);
+				} else if (cur_stream->sndvar->dss_maps) {
+					ret = FlushMPTCPSubflow(mtcp, cur_stream, cur_ts);
 				} else {
 					ret = FlushTCPSendingBuffer(mtcp, cur_stream, cur_ts);
 				}
 			} else if (cur_stream->state == TCP_ST_CLOSE_WAIT || 
 					cur_stream->state == TCP_ST_FIN_WAIT_1 || 
 					cur_stream->state == TCP_ST_LAST_ACK) {
-				ret = FlushTCPSendingBuffer(mtcp, cur_stream, cur_ts);
+				if (cur_stream->sndvar->dss_maps) {
+					ret = FlushMPTCPSubflow(mtcp, cur_stream, cur_ts);
+				} else {
+					ret = FlushTCPSendingBuffer(mtcp, cur_stream, cur_ts);
+				}
 			} else {
 				TRACE_DBG("Stream %d: on_send_list at state %s\n", 
 						cur_stream->id, TCPStateToString(cur_stream));
@@ -1353,6 +1907,9 @@ WriteTCPACKList(mtcp_manager_t mtcp,
 								cur_stream->rcvvar->rcvbuf->merged_len)) {
 						to_ack = TRUE;
 					}
+				} else if (cur_stream->mptcp_cb) {
+					/* MPTCP subflows keep no payload, only rcv_nxt */
+					to_ack = TRUE;
 				}
 			} else {
 				TRACE_DBG("Stream %u (%s): "
@@ -1481,7 +2038,7 @@ AddtoSendList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 	struct mtcp_sender *sender = GetSender(mtcp, cur_stream);
 	assert(sender != NULL);
 
-	if(!cur_stream->sndvar->sndbuf) {
+	if(!cur_stream->sndvar->sndbuf && !cur_stream->sndvar->dss_maps) {
 		TRACE_ERROR("[%d] Stream %d: No send buffer available.\n", 
 				mtcp->ctx->cpu,
 				cur_stream->id);
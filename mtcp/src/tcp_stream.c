@@ -1,3 +1,5 @@
+#include <stddef.h>
+
 #include "tcp_stream.h"
 #include "fhash.h"
 #include "tcp_in.h"
@@ -8,6 +10,8 @@
 #include "ip_out.h"
 #include "timer.h"
 #include "debug.h"
+#include "mptcp_map.h"
+#include "mptcp_token.h"
 #if RATE_LIMIT_ENABLED || PACING_ENABLED
 #include "pacing.h"
 #endif
@@ -17,6 +21,35 @@
 
 #define TCP_MAX_SEQ 4294967295
 
+/*---------------------------------------------------------------------------*/
+/* layout checks: a hot field pushed out of its cache line (see the comment */
+/* above struct tcp_recv_vars) breaks the build here                         */
+/*---------------------------------------------------------------------------*/
+#define CACHE_LINE 64
+#define FIELD_END(type, field) (offsetof(type, field) + sizeof(((type *)0)->field))
+#define HOT_FIELD(type, field, lines) \
+	_Static_assert(FIELD_END(type, field) <= (lines) * CACHE_LINE, \
+			#type "." #field " left its hot cache lines")
+
+/* the hot part of tcp_stream is its last line and the send variables follow */
+_Static_assert(offsetof(tcp_stream, sndvar) % CACHE_LINE == 0 && 
+		sizeof(tcp_stream) - offsetof(tcp_stream, sndvar) == CACHE_LINE, 
+		"tcp_stream: hot fields do not fit its last cache line");
+_Static_assert(offsetof(struct tcp_stream_chunk, sndvar) == sizeof(tcp_stream), 
+		"tcp_stream_chunk: send variables do not follow the stream");
+
+HOT_FIELD(struct tcp_send_vars, wscale_peer, 1);
+HOT_FIELD(struct tcp_send_vars, on_resetq, 2);
+#if USE_CCP
+HOT_FIELD(struct tcp_send_vars, missing_seq, 2);
+#endif
+HOT_FIELD(struct tcp_send_vars, timer, 2);
+HOT_FIELD(struct tcp_send_vars, rtt_end, 2);
+#if USE_SPIN_LOCK
+HOT_FIELD(struct tcp_send_vars, write_lock, 2);
+#endif
+HOT_FIELD(struct tcp_recv_vars, dup_acks, 1);
+
 /*---------------------------------------------------------------------------*/
 char *state_str[] = {"TCP_ST_CLOSED", 
 	"TCP_ST_LISTEN", 
@@ -224,6 +257,7 @@ tcp_stream *
 CreateTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type, 
 		uint32_t saddr, uint16_t sport, uint32_t daddr, uint16_t dport)
 {
+	struct tcp_stream_chunk *chunk;
 	tcp_stream *stream = NULL;
 	int ret;
 
@@ -233,31 +267,18 @@ CreateTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type,
 	
 	pthread_mutex_lock(&mtcp->ctx->flow_pool_lock);
 
-	stream = (tcp_stream *)MPAllocateChunk(mtcp->flow_pool);
-	if (!stream) {
+	chunk = (struct tcp_stream_chunk *)MPAllocateChunk(mtcp->flow_pool);
+	if (!chunk) {
 		TRACE_ERROR("Cannot allocate memory for the stream. "
 				"CONFIG.max_concurrency: %d, concurrent: %u\n", 
 				CONFIG.max_concurrency, mtcp->flow_cnt);
 		pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
 		return NULL;
 	}
-	memset(stream, 0, sizeof(tcp_stream));
-
-	stream->rcvvar = (struct tcp_recv_vars *)MPAllocateChunk(mtcp->rv_pool);
-	if (!stream->rcvvar) {
-		MPFreeChunk(mtcp->flow_pool, stream);
-		pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
-		return NULL;
-	}
-	stream->sndvar = (struct tcp_send_vars *)MPAllocateChunk(mtcp->sv_pool);
-	if (!stream->sndvar) {
-		MPFreeChunk(mtcp->rv_pool, stream->rcvvar);
-		MPFreeChunk(mtcp->flow_pool, stream);
-		pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
-		return NULL;
-	}
-	memset(stream->rcvvar, 0, sizeof(struct tcp_recv_vars));
-	memset(stream->sndvar, 0, sizeof(struct tcp_send_vars));
+	memset(chunk, 0, sizeof(struct tcp_stream_chunk));
+	stream = &chunk->stream;
+	stream->sndvar = &chunk->sndvar;
+	stream->rcvvar = &chunk->rcvvar;
 
 	stream->id = mtcp->g_id++;
 	stream->saddr = saddr;
@@ -265,7 +286,7 @@ CreateTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type,
 	stream->daddr = daddr;
 	stream->dport = dport;
 
-	ret = StreamHTInsert(mtcp->tcp_flow_table, stream);
+	ret = FlowTableInsert(mtcp->tcp_flow_table, stream);
 	if (ret < 0) {
 		TRACE_ERROR("Stream %d: "
 				"Failed to insert the stream into hash table.\n", stream->id);
@@ -308,6 +329,13 @@ CreateTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type,
 
 	stream->sndvar->iss = rand_r(&next_seed) % TCP_MAX_SEQ;
 	//stream->sndvar->iss = 0;
+	stream->sndvar->rtt_end = stream->sndvar->iss + 1;
+#if TCP_OPT_SACK_ENABLED
+	stream->sndvar->recovery_point = stream->sndvar->iss;
+#endif
+	/* MP_JOIN nonce; rand_r() only gives 31 bits */
+	stream->myRandomNumber = ((uint32_t)rand_r(&next_seed) << 16) ^ 
+			rand_r(&next_seed);
 	stream->rcvvar->irs = 0;
 
 	stream->snd_nxt = stream->sndvar->iss;
@@ -389,6 +417,7 @@ tcp_stream *
 CreateMpcbTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type, 
 		uint32_t saddr, uint16_t sport, uint32_t daddr, uint16_t dport)
 {
+	struct tcp_stream_chunk *chunk;
 	tcp_stream *stream = NULL;
 	// int ret;
 
@@ -397,32 +426,19 @@ CreateMpcbTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type,
 	uint8_t *da;
 	pthread_mutex_lock(&mtcp->ctx->flow_pool_lock);
 
-	stream = (tcp_stream *)MPAllocateChunk(mtcp->flow_pool);
-	if (!stream) {
+	chunk = (struct tcp_stream_chunk *)MPAllocateChunk(mtcp->flow_pool);
+	if (!chunk) {
 		TRACE_ERROR("Cannot allocate memory for the stream. "
 				"CONFIG.max_concurrency: %d, concurrent: %u\n", 
 				CONFIG.max_concurrency, mtcp->flow_cnt);
 		pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
 		return NULL;
 	}
-	memset(stream, 0, sizeof(tcp_stream));
+	memset(chunk, 0, sizeof(struct tcp_stream_chunk));
+	stream = &chunk->stream;
+	stream->sndvar = &chunk->sndvar;
+	stream->rcvvar = &chunk->rcvvar;
 	
-	stream->rcvvar = (struct tcp_recv_vars *)MPAllocateChunk(mtcp->rv_pool);
-	if (!stream->rcvvar) {
-		MPFreeChunk(mtcp->flow_pool, stream);
-		pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
-		return NULL;
-	}
-	stream->sndvar = (struct tcp_send_vars *)MPAllocateChunk(mtcp->sv_pool);
-	if (!stream->sndvar) {
-		MPFreeChunk(mtcp->rv_pool, stream->rcvvar);
-		MPFreeChunk(mtcp->flow_pool, stream);
-		pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
-		return NULL;
-	}
-	memset(stream->rcvvar, 0, sizeof(struct tcp_recv_vars));
-	memset(stream->sndvar, 0, sizeof(struct tcp_send_vars));
-
 	stream->id = mtcp->g_id++;
 	stream->saddr = saddr;
 	stream->sport = sport;
@@ -473,6 +489,10 @@ CreateMpcbTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type,
 
 	stream->sndvar->iss = rand_r(&next_seed) % TCP_MAX_SEQ;
 	//stream->sndvar->iss = 0;
+	stream->sndvar->rtt_end = stream->sndvar->iss + 1;
+#if TCP_OPT_SACK_ENABLED
+	stream->sndvar->recovery_point = stream->sndvar->iss;
+#endif
 	stream->rcvvar->irs = 0;
 
 	stream->snd_nxt = stream->sndvar->iss;
@@ -551,6 +571,37 @@ CreateMpcbTCPStream(mtcp_manager_t mtcp, socket_map_t socket, int type,
 }
 /*---------------------------------------------------------------------------*/
 void
+DestroyMpcbTCPStream(mtcp_manager_t mtcp, tcp_stream *stream)
+{
+	TRACE_STREAM("DESTROY MPCB TCP STREAM %d\n", stream->id);
+
+	/* the meta stream only ever sits on the send and ack lists */
+	RemoveFromControlList(mtcp, stream);
+	RemoveFromSendList(mtcp, stream);
+	RemoveFromACKList(mtcp, stream);
+
+#if BLOCKING_SUPPORT
+	pthread_cond_destroy(&stream->rcvvar->read_cond);
+	pthread_cond_destroy(&stream->sndvar->write_cond);
+#endif
+	SBUF_LOCK_DESTROY(&stream->rcvvar->read_lock);
+	SBUF_LOCK_DESTROY(&stream->sndvar->write_lock);
+
+	if (stream->sndvar->sndbuf) {
+		SBFree(mtcp->rbm_snd, stream->sndvar->sndbuf);
+		stream->sndvar->sndbuf = NULL;
+	}
+	if (stream->rcvvar->rcvbuf) {
+		RBFree(mtcp->mptcp_rbm_rcv, stream->rcvvar->rcvbuf);
+		stream->rcvvar->rcvbuf = NULL;
+	}
+
+	pthread_mutex_lock(&mtcp->ctx->flow_pool_lock);
+	MPFreeChunk(mtcp->flow_pool, stream);
+	pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
+}
+/*---------------------------------------------------------------------------*/
+void
 DestroyTCPStream(mtcp_manager_t mtcp, tcp_stream *stream)
 {
 	struct sockaddr_in addr;
@@ -684,26 +735,39 @@ DestroyTCPStream(mtcp_manager_t mtcp, tcp_stream *stream)
 
 	assert(stream->on_hash_table == TRUE);
 	
+	/* MPTCP reinjects from the subflow's mappings, so detach it first */
+	MPTCPDetachSubflow(mtcp, stream);
+
 	/* free ring buffers */
 	if (stream->sndvar->sndbuf) {
 		SBFree(mtcp->rbm_snd, stream->sndvar->sndbuf);
 		stream->sndvar->sndbuf = NULL;
 	}
+	if (stream->sndvar->dss_maps) {
+		MPTCPMapQueueDestroy(stream->sndvar->dss_maps);
+		stream->sndvar->dss_maps = NULL;
+	}
 	if (stream->rcvvar->rcvbuf) {
 		RBFree(mtcp->rbm_rcv, stream->rcvvar->rcvbuf);
 		stream->rcvvar->rcvbuf = NULL;
 	}
+	if (stream->rcvvar->mptcp_ooo) {
+		free(stream->rcvvar->mptcp_ooo);
+		stream->rcvvar->mptcp_ooo = NULL;
+	}
+	if (stream->rcvvar->mptcp_maps) {
+		free(stream->rcvvar->mptcp_maps);
+		stream->rcvvar->mptcp_maps = NULL;
+	}
 
 	pthread_mutex_lock(&mtcp->ctx->flow_pool_lock);
 
 	/* remove from flow hash table */
-	StreamHTRemove(mtcp->tcp_flow_table, stream);
+	FlowTableRemove(mtcp->tcp_flow_table, stream);
 	stream->on_hash_table = FALSE;
 	
 	mtcp->flow_cnt--;
 
-	MPFreeChunk(mtcp->rv_pool, stream->rcvvar);
-	MPFreeChunk(mtcp->sv_pool, stream->sndvar);
 	MPFreeChunk(mtcp->flow_pool, stream);
 	pthread_mutex_unlock(&mtcp->ctx->flow_pool_lock);
 
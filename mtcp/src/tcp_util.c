@@ -7,452 +7,552 @@
 #include "timer.h"
 #include "ip_in.h"
 #include <endian.h>
-#include <openssl/sha.h>
-#include <openssl/hmac.h>
 
 #define MAX(a, b) ((a)>(b)?(a):(b))
 #define MIN(a, b) ((a)<(b)?(a):(b))
 
 /*---------------------------------------------------------------------------*/
-void 
-ParseTCPOptions(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len)
+/* opt points at the subtype byte, optlen counts the kind and length bytes  */
+static inline void 
+ParseMPTCPOption(struct tcp_options *opts, uint8_t *opt, unsigned int optlen)
 {
-	int i;
-	unsigned int opt, optlen;
-
-	for (i = 0; i < len; ) {
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
+	unsigned int avail = optlen - 2;
+	unsigned int j, width;
+	uint8_t dflags;
+
+	switch (opt[0] >> 4) {
+	case TCP_MPTCP_SUBTYPE_CAPABLE:
+		if (opt[0] != ((TCP_MPTCP_SUBTYPE_CAPABLE << 4) | TCP_MPTCP_VERSION) || 
+				optlen < MPTCP_OPT_CAPABLE_SYN_LEN) {
 			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
+		}
+		opts->flags |= TCP_OPT_FLAG_MP_CAPABLE;
+		opts->mptcp_subtype = TCP_MPTCP_SUBTYPE_CAPABLE;
+		opts->snd_key = be64toh(*(uint64_t *)(opt + 2));
+		opts->rcv_key = (optlen >= MPTCP_OPT_CAPABLE_ACK_LEN) ?
+				be64toh(*(uint64_t *)(opt + 10)) : 0;
+		break;
+
+	case TCP_MPTCP_SUBTYPE_JOIN:
+		if (avail < 2)
+			break;
+		opts->flags |= TCP_OPT_FLAG_MP_JOIN;
+		opts->mptcp_subtype = TCP_MPTCP_SUBTYPE_JOIN;
+		opts->join_len = optlen;
+		opts->join_backup = opt[0] & MPTCP_FLAG_BACKUP;
+		opts->join_addr_id = opt[1];
+		if (optlen == MPTCP_OPT_JOIN_SYN_LEN) {
+			opts->token = be32toh(*(uint32_t *)(opt + 2));
+			opts->nonce = be32toh(*(uint32_t *)(opt + 6));
+		} else if (optlen == MPTCP_OPT_JOIN_SYNACK_LEN) {
+			opts->join_hmac = be64toh(*(uint64_t *)(opt + 2));
+			opts->nonce = be32toh(*(uint32_t *)(opt + 10));
+		} else if (optlen == MPTCP_OPT_JOIN_ACK_LEN) {
+			opts->join_mac = opt + 2;
+		}
+		break;
 
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
+	case TCP_MPTCP_SUBTYPE_DSS:
+		if (avail < 2)
+			break;
+		dflags = opt[1];
+		j = 2;
+		/* 4 byte ACKs and DSNs are widened by MPTCPExpandDSN() */
+		if (dflags & MPTCP_DSS_DATA_ACK) {
+			if (dflags & MPTCP_DSS_DATA_ACK_8) {
+				width = 8;
+				if (j + width > avail)
+					break;
+				opts->data_ack = be64toh(*(uint64_t *)(opt + j));
+				opts->flags |= TCP_OPT_FLAG_DATA_ACK_8;
+			} else {
+				width = 4;
+				if (j + width > avail)
+					break;
+				opts->data_ack = be32toh(*(uint32_t *)(opt + j));
 			}
-
-			if (opt == TCP_OPT_MSS) {
-				cur_stream->sndvar->mss = *(tcpopt + i++) << 8;
-				cur_stream->sndvar->mss += *(tcpopt + i++);
-				cur_stream->sndvar->eff_mss = cur_stream->sndvar->mss;
-#if TCP_OPT_TIMESTAMP_ENABLED
-				cur_stream->sndvar->eff_mss -= (TCP_OPT_TIMESTAMP_LEN + 2);
-#endif
-			} else if (opt == TCP_OPT_WSCALE) {
-				cur_stream->sndvar->wscale_peer = *(tcpopt + i++);
-			} else if (opt == TCP_OPT_SACK_PERMIT) {
-				cur_stream->sack_permit = TRUE;
-				TRACE_SACK("Remote SACK permited.\n");
-			} else if (opt == TCP_OPT_TIMESTAMP) {
-				TRACE_TSTAMP("Saw peer timestamp!\n");
-				cur_stream->saw_timestamp = TRUE;
-				cur_stream->rcvvar->ts_recent = ntohl(*(uint32_t *)(tcpopt + i));
-				cur_stream->rcvvar->ts_last_ts_upd = cur_ts;
-				i += 8;
+			opts->flags |= TCP_OPT_FLAG_DATA_ACK;
+			j += width;
+		}
+		if (dflags & MPTCP_DSS_MAP) {
+			if (dflags & MPTCP_DSS_DSN_8) {
+				width = 8;
+				if (j + width + 6 > avail)
+					break;
+				opts->dsn = be64toh(*(uint64_t *)(opt + j));
+				opts->flags |= TCP_OPT_FLAG_DSN_8;
 			} else {
-				// not handle
-				i += optlen - 2;
+				width = 4;
+				if (j + width + 6 > avail)
+					break;
+				opts->dsn = be32toh(*(uint32_t *)(opt + j));
 			}
+			j += width;
+			opts->dss_ssn = be32toh(*(uint32_t *)(opt + j));
+			opts->dss_len = be16toh(*(uint16_t *)(opt + j + 4));
+			opts->flags |= TCP_OPT_FLAG_DSS_MAP;
 		}
-	}
-}
-/*---------------------------------------------------------------------------*/
-uint8_t 
-ParseMPTCPOptions(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len)
-{
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
+		if (dflags & MPTCP_DSS_DATA_FIN)
+			opts->flags |= TCP_OPT_FLAG_DATA_FIN;
+		break;
 
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
+	case TCP_MPTCP_SUBTYPE_ADD_ADDR:
+		/* IPv4 only: id and address, then an optional port and HMAC */
+		if (avail < 6)
 			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
+#if TCP_MPTCP_VERSION == 0
+		/* no echo and no HMAC; the low nibble is the IP version */
+		if ((opt[0] & 0x0f) != MPTCP_ADD_ADDR_IPVER)
+			break;
+		opts->add_addr_echo = 0;
+		opts->add_addr_id = opt[1];
+		opts->add_addr = *(uint32_t *)(opt + 2);
+		opts->add_port = (avail >= 8) ? *(uint16_t *)(opt + 6) : 0;
+#else
+		opts->add_addr_echo = opt[0] & MPTCP_FLAG_ECHO;
+		opts->add_addr_id = opt[1];
+		opts->add_addr = *(uint32_t *)(opt + 2);
+		j = (avail == 8 || avail == 16) ? 8 : 6;
+		opts->add_port = (j == 8) ? *(uint16_t *)(opt + 6) : 0;
+		if (!opts->add_addr_echo) {
+			if (j + 8 > avail)
 				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == 0x00){
-					return (uint8_t)0;
-				}
-				if(subtypeAndVersion & 0x10){
-					return (uint8_t)1;
-				}
-				return 5;
-
-			}else {
-				// Check No MPTCP option
-				i += optlen - 2;
-			}
+			opts->add_addr_hmac = be64toh(*(uint64_t *)(opt + j));
 		}
-	}
-	//  No MPTCP options
-	return 5;
-}
-/*---------------------------------------------------------------------------*/
-uint64_t 
-GetPeerKey(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len)
-{	
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	// uint32_t keyLow32,keyHigh32;
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
+#endif
+		opts->flags |= TCP_OPT_FLAG_ADD_ADDR;
+		break;
 
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
+	case TCP_MPTCP_SUBTYPE_REMOVE_ADDR:
+		if (avail < 2)
+			break;
+		opts->rm_addr_ids = opt + 1;
+		opts->rm_addr_cnt = avail - 1;
+		opts->flags |= TCP_OPT_FLAG_REMOVE_ADDR;
+		break;
+
+	case TCP_MPTCP_SUBTYPE_PRIO:
+		/* the address id form names another subflow, we do not track those */
+		if (optlen != MPTCP_OPT_PRIO_LEN)
+			break;
+		opts->prio_backup = opt[0] & MPTCP_FLAG_BACKUP;
+		opts->flags |= TCP_OPT_FLAG_MP_PRIO;
+		break;
 
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == 0x00){
-					return be64toh(*(uint64_t*)(tcpopt + (i + 2)));
-				}
-				return 0;
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
+	default:
+		break;
 	}
-	//  No MPTCP options
-	return 0;
 }
 /*---------------------------------------------------------------------------*/
-uint64_t 
-GetMyKeyFromMPCapbleACK(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len)
+void 
+ParseTCPOptions(struct tcp_options *opts, uint8_t *tcpopt, int len)
 {
 	int i;
 	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	// uint32_t keyLow32,keyHigh32;
+
+	opts->flags = 0;
+	opts->mptcp_subtype = TCP_MPTCP_SUBTYPE_NONE;
 
 	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
 		opt = *(tcpopt + i++);
 		
 		if (opt == TCP_OPT_END) {	// end of option field
 			break;
 		} else if (opt == TCP_OPT_NOP) {	// no option
 			continue;
-		} else {
-
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == 0x00){
-					return be64toh(*(uint64_t*)(tcpopt + (i + 10)));
-				}
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
 		}
-	}
-	//  No MPTCP options
-	return 0;
-}
-/*---------------------------------------------------------------------------*/
-/*---------------------------------------------------------------------------*/
-uint32_t 
-GetTokenFromMPJoinSYN(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len)
-{
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	// uint32_t keyLow32,keyHigh32;
 
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
+		if (i >= len)
 			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
+		optlen = *(tcpopt + i++);
+		if (optlen < 2 || i + optlen - 2 > len) {
+			break;
+		}
 
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
+		switch (opt) {
+		case TCP_OPT_MSS:
+			if (optlen == TCP_OPT_MSS_LEN) {
+				opts->mss = ntohs(*(uint16_t *)(tcpopt + i));
+				opts->flags |= TCP_OPT_FLAG_MSS;
 			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == 0x10){
-					return be32toh(*(uint32_t*)(tcpopt + (i + 2)));
-				}
+			break;
+		case TCP_OPT_WSCALE:
+			if (optlen == TCP_OPT_WSCALE_LEN) {
+				opts->wscale = *(tcpopt + i);
+				opts->flags |= TCP_OPT_FLAG_WSCALE;
 			}
-			else{
-				// Move to next option
-				i += optlen - 2;
+			break;
+		case TCP_OPT_SACK_PERMIT:
+			opts->flags |= TCP_OPT_FLAG_SACK_PERMIT;
+			break;
+		case TCP_OPT_TIMESTAMP:
+			if (optlen == TCP_OPT_TIMESTAMP_LEN) {
+				opts->ts.ts_val = ntohl(*(uint32_t *)(tcpopt + i));
+				opts->ts.ts_ref = ntohl(*(uint32_t *)(tcpopt + i + 4));
+				opts->flags |= TCP_OPT_FLAG_TIMESTAMP;
 			}
+			break;
+		case TCP_OPT_SACK:
+			opts->sack = tcpopt + i;
+			opts->sack_len = optlen - 2;
+			opts->flags |= TCP_OPT_FLAG_SACK;
+			break;
+		case TCP_OPT_MPTCP:
+			/* MP_PRIO without an address id is the shortest, 3 bytes */
+			if (optlen >= MPTCP_OPT_PRIO_LEN)
+				ParseMPTCPOption(opts, tcpopt + i, optlen);
+			break;
+		default:
+			// not handle
+			break;
 		}
+		i += optlen - 2;
 	}
-	//  No MPTCP options
-	return 0;
 }
 /*---------------------------------------------------------------------------*/
-uint32_t 
-GetPeerRandomNumberFromMPJoinSYN(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len)
+void 
+SetTCPOptions(tcp_stream *cur_stream, uint32_t cur_ts, 
+		const struct tcp_options *opts)
 {
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	// uint32_t keyLow32,keyHigh32;
+	if (opts->flags & TCP_OPT_FLAG_MSS) {
+		cur_stream->sndvar->mss = opts->mss;
+		cur_stream->sndvar->eff_mss = cur_stream->sndvar->mss;
+#if TCP_OPT_TIMESTAMP_ENABLED
+		cur_stream->sndvar->eff_mss -= (TCP_OPT_TIMESTAMP_LEN + 2);
+#endif
+	}
+	if (opts->flags & TCP_OPT_FLAG_WSCALE) {
+		cur_stream->sndvar->wscale_peer = opts->wscale;
+	}
+	if (opts->flags & TCP_OPT_FLAG_SACK_PERMIT) {
+		cur_stream->sack_permit = TRUE;
+		TRACE_SACK("Remote SACK permited.\n");
+	}
+	if (opts->flags & TCP_OPT_FLAG_TIMESTAMP) {
+		TRACE_TSTAMP("Saw peer timestamp!\n");
+		cur_stream->saw_timestamp = TRUE;
+		cur_stream->rcvvar->ts_recent = opts->ts.ts_val;
+		cur_stream->rcvvar->ts_last_ts_upd = cur_ts;
+	}
+}
+#if TCP_OPT_SACK_ENABLED
+/*----------------------------------------------------------------------------*/
+/* The SACK scoreboard (rcvvar->sack_table) holds what the peer SACKed of   */
+/* the data we sent, as disjoint blocks above snd_una sorted by sequence.   */
+/* The peer reports a few blocks per ACK and holes come from losses, so a   */
+/* small array searched by halves does; when it is full the highest blocks */
+/* are forgotten, which at worst resends data the peer already has.        */
+/*----------------------------------------------------------------------------*/
+/* index of the first block that ends after seq, rcvvar->sacks if none      */
+static inline int
+SACKFind(const struct tcp_recv_vars *rcvvar, uint32_t seq)
+{
+	int lo = 0, hi = rcvvar->sacks, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (TCP_SEQ_GT(rcvvar->sack_table[mid].right_edge, seq))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
 
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
+	return lo;
+}
+/*----------------------------------------------------------------------------*/
+int
+SeqIsSacked(tcp_stream *cur_stream, uint32_t seq)
+{
+	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
+	int i = SACKFind(rcvvar, seq);
 
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
+	return i < rcvvar->sacks && 
+			TCP_SEQ_GEQ(seq, rcvvar->sack_table[i].left_edge);
+}
+/*----------------------------------------------------------------------------*/
+/* RFC 6675 IsLost(): more than DupThresh - 1 segments SACKed above seq     */
+int
+SACKIsLost(tcp_stream *cur_stream, uint32_t seq)
+{
+	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
+	uint32_t above = 0;
+	int i;
 
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == 0x10){
-					return be32toh(*(uint32_t*)(tcpopt + (i + 6)));
-				}
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
+	for (i = SACKFind(rcvvar, seq); i < rcvvar->sacks; i++) {
+		if (TCP_SEQ_GT(rcvvar->sack_table[i].left_edge, seq))
+			above += rcvvar->sack_table[i].right_edge - 
+					rcvvar->sack_table[i].left_edge;
+		else
+			above += rcvvar->sack_table[i].right_edge - seq - 1;
 	}
-	//  No MPTCP options
-	return 0;
+
+	return above > (TCP_DUPTHRESH - 1) * cur_stream->sndvar->mss;
 }
-/*---------------------------------------------------------------------------*/
-inline int  
-ParseTCPTimestamp(tcp_stream *cur_stream, 
-		struct tcp_timestamp *ts, uint8_t *tcpopt, int len)
+/*----------------------------------------------------------------------------*/
+/* RFC 6675 SetPipe(): bytes in flight. A hole counts unless it is lost,    */
+/* and what was resent of it during recovery counts once more               */
+uint32_t
+SACKPipe(tcp_stream *cur_stream)
 {
+	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+	uint32_t lost = (TCP_DUPTHRESH - 1) * sndvar->mss;
+	uint32_t above = rcvvar->sacked_bytes;
+	uint32_t seq = sndvar->snd_una;
+	uint32_t end, pipe = 0;
 	int i;
-	unsigned int opt, optlen;
-
-	for (i = 0; i < len; ) {
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
 
-			if (opt == TCP_OPT_TIMESTAMP) {
-				ts->ts_val = ntohl(*(uint32_t *)(tcpopt + i));
-				ts->ts_ref = ntohl(*(uint32_t *)(tcpopt + i + 4));
-				return TRUE;
-			} else {
-				// not handle
-				i += optlen - 2;
-			}
+	for (i = 0; ; i++) {
+		end = (i < rcvvar->sacks) ? 
+				rcvvar->sack_table[i].left_edge : cur_stream->snd_nxt;
+		if (TCP_SEQ_GT(end, seq)) {
+			if (above <= lost)
+				pipe += end - seq;
+			if (sndvar->sack_recovery && TCP_SEQ_GT(sndvar->high_rxt, seq))
+				pipe += (TCP_SEQ_LT(sndvar->high_rxt, end) ? 
+						sndvar->high_rxt : end) - seq;
 		}
+		if (i == rcvvar->sacks)
+			break;
+		above -= rcvvar->sack_table[i].right_edge - 
+				rcvvar->sack_table[i].left_edge;
+		seq = rcvvar->sack_table[i].right_edge;
 	}
-	return FALSE;
+
+	return pipe;
 }
-#if TCP_OPT_SACK_ENABLED
 /*----------------------------------------------------------------------------*/
+/* RFC 6675 NextSeg() rule 1: the lowest lost byte not resent yet in this   */
+/* recovery, and the length of its hole from there. Rules 2 and 3 (new data */
+/* and holes not deemed lost) are left to the normal send path              */
 int
-SeqIsSacked(tcp_stream *cur_stream, uint32_t seq)
+SACKNextSeg(tcp_stream *cur_stream, uint32_t *seq, uint32_t *len)
 {
-	uint8_t i;
-	uint32_t left, right;
-	for (i = 0; i < MAX_SACK_ENTRY; i++) {
-		left = cur_stream->rcvvar->sack_table[i].left_edge;
-		right = cur_stream->rcvvar->sack_table[i].right_edge;
-		if (seq >= left && seq < right) {
-			//fprintf(stderr, "Found seq=%u in (%u,%u)\n", seq - cur_stream->sndvar->iss, left - cur_stream->sndvar->iss, right - cur_stream->sndvar->iss);
+	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
+	struct tcp_send_vars *sndvar = cur_stream->sndvar;
+	uint32_t lost = (TCP_DUPTHRESH - 1) * sndvar->mss;
+	uint32_t above = rcvvar->sacked_bytes;
+	uint32_t start = sndvar->snd_una;
+	uint32_t end;
+	int i;
+
+	for (i = 0; i < rcvvar->sacks && above > lost; i++) {
+		end = rcvvar->sack_table[i].left_edge;
+		if (TCP_SEQ_GT(sndvar->high_rxt, start))
+			start = sndvar->high_rxt;
+		if (TCP_SEQ_LT(start, end)) {
+			*seq = start;
+			*len = end - start;
 			return TRUE;
 		}
+		above -= rcvvar->sack_table[i].right_edge - 
+				rcvvar->sack_table[i].left_edge;
+		start = rcvvar->sack_table[i].right_edge;
 	}
+
 	return FALSE;
 }
 /*----------------------------------------------------------------------------*/
+/* forgets the scoreboard, e.g. on an RTO: the peer may have reneged        */
 void
-_update_sack_table(tcp_stream *cur_stream, uint32_t left_edge, uint32_t right_edge)
+SACKReset(tcp_stream *cur_stream)
 {
-	uint8_t i, j;
-	uint32_t newly_sacked = 0;
-	long int ld, rd, lrd, rld;
-	for (i = 0; i < MAX_SACK_ENTRY; i++) {
-		ld = (long int) left_edge - cur_stream->rcvvar->sack_table[i].left_edge;
-		rd = (long int) right_edge - cur_stream->rcvvar->sack_table[i].right_edge;
-		// if block already in table, don't need to do anything
-		if (ld == 0 && rd == 0) {
-			return;
-		}
-
-		lrd = (long int) left_edge - cur_stream->rcvvar->sack_table[i].right_edge;
-		rld = (long int) right_edge - cur_stream->rcvvar->sack_table[i].left_edge;
-
-		// if block does not overlap i at all, skip
-		if (lrd > 0 || rld < 0) {
-			continue;
-		}
+	cur_stream->rcvvar->sacks = 0;
+	cur_stream->rcvvar->sacked_bytes = 0;
+	cur_stream->rcvvar->sacked_pkts = 0;
+	cur_stream->sndvar->sack_recovery = FALSE;
+	cur_stream->sndvar->sack_rxt_una = FALSE;
+}
+/*----------------------------------------------------------------------------*/
+/* drops what the cumulative ACK covers now                                 */
+static inline void
+SACKTrim(struct tcp_recv_vars *rcvvar, uint32_t ack_seq)
+{
+	struct sack_entry *t = rcvvar->sack_table;
+	int n = SACKFind(rcvvar, ack_seq);
+	int i;
 
-		// left_edge is further left than i.left_edge
-		if (ld < 0) {
-			newly_sacked += (-ld);
-			// expand i to account for this extra space, and merge with any
-			// blocks whose right_edge = i.left (i.e. blocks are touching)
-			cur_stream->rcvvar->sack_table[i].left_edge = left_edge;
-			for (j=0; j < MAX_SACK_ENTRY; j++) {
-				if (cur_stream->rcvvar->sack_table[j].right_edge == left_edge) {
-					cur_stream->rcvvar->sack_table[i].left_edge = cur_stream->rcvvar->sack_table[j].right_edge;
-					cur_stream->rcvvar->sack_table[j].left_edge = 0;
-					cur_stream->rcvvar->sack_table[j].right_edge = 0;
-					break;
-				}
-			}
-		}
-		// right edge is further right than i.right_edge
-		if (rd > 0) {
-			newly_sacked += rd;
-			// expand i to account for this extra space, and merge with any
-			// blocks whose left_edge = i.right (i.e. blocks are touching)
-			cur_stream->rcvvar->sack_table[i].right_edge = right_edge;
-			for (j=0; j < MAX_SACK_ENTRY; j++) {
-				if (cur_stream->rcvvar->sack_table[j].left_edge == right_edge) {
-					cur_stream->rcvvar->sack_table[i].right_edge = cur_stream->rcvvar->sack_table[j].left_edge;
-					cur_stream->rcvvar->sack_table[j].left_edge = 0;
-					cur_stream->rcvvar->sack_table[j].right_edge = 0;
-					break;
-				}
-			}
-		}
+	if (n > 0) {
+		for (i = 0; i < n; i++)
+			rcvvar->sacked_bytes -= t[i].right_edge - t[i].left_edge;
+		memmove(t, t + n, (rcvvar->sacks - n) * sizeof(*t));
+		rcvvar->sacks -= n;
 	}
-	if (newly_sacked == 0) {
-		cur_stream->rcvvar->sack_table
-			[cur_stream->rcvvar->sacks].left_edge = left_edge;
-		cur_stream->rcvvar->sack_table
-			[cur_stream->rcvvar->sacks].right_edge = right_edge;
-		cur_stream->rcvvar->sacks++;
-		newly_sacked = (right_edge - left_edge);
+	if (rcvvar->sacks > 0 && TCP_SEQ_LT(t[0].left_edge, ack_seq)) {
+		rcvvar->sacked_bytes -= ack_seq - t[0].left_edge;
+		t[0].left_edge = ack_seq;
 	}
-
-	//fprintf(stderr, "SACK (%u,%u)->%u/%u\n", left_edge, right_edge, newly_sacked, newly_sacked / 1448);
-	cur_stream->rcvvar->sacked_pkts += (newly_sacked / cur_stream->sndvar->mss);
-
-	return;
 }
 /*----------------------------------------------------------------------------*/
-int
-GenerateSACKOption(tcp_stream *cur_stream, uint8_t *tcpopt)
+/* merges [left_edge, right_edge) in, returns the bytes newly SACKed        */
+static uint32_t
+SACKInsert(struct tcp_recv_vars *rcvvar, uint32_t left_edge, uint32_t right_edge)
 {
-	// TODO
-	return 0;
+	struct sack_entry *t = rcvvar->sack_table;
+	uint32_t before = rcvvar->sacked_bytes;
+	int i, j;
+
+	/* blocks i .. j - 1 overlap or touch the new one */
+	i = SACKFind(rcvvar, left_edge - 1);
+	for (j = i; j < rcvvar->sacks && 
+			TCP_SEQ_LEQ(t[j].left_edge, right_edge); j++) {
+		if (TCP_SEQ_LT(t[j].left_edge, left_edge))
+			left_edge = t[j].left_edge;
+		if (TCP_SEQ_GT(t[j].right_edge, right_edge))
+			right_edge = t[j].right_edge;
+		rcvvar->sacked_bytes -= t[j].right_edge - t[j].left_edge;
+	}
+
+	if (i == j && rcvvar->sacks == MAX_SACK_ENTRY) {
+		if (i == MAX_SACK_ENTRY)
+			return 0;
+		rcvvar->sacks--;
+		rcvvar->sacked_bytes -= t[rcvvar->sacks].right_edge - 
+				t[rcvvar->sacks].left_edge;
+	}
+
+	memmove(t + i + 1, t + j, (rcvvar->sacks - j) * sizeof(*t));
+	rcvvar->sacks += 1 - (j - i);
+	t[i].left_edge = left_edge;
+	t[i].right_edge = right_edge;
+	rcvvar->sacked_bytes += right_edge - left_edge;
+
+	return rcvvar->sacked_bytes - before;
 }
 /*----------------------------------------------------------------------------*/
-void
+/* updates the scoreboard with an ACK, returns the bytes newly SACKed. A    */
+/* block at or below ack_seq is a D-SACK and one past snd_nxt is bogus;     */
+/* both are ignored                                                          */
+uint32_t
 ParseSACKOption(tcp_stream *cur_stream, 
-		uint32_t ack_seq, uint8_t *tcpopt, int len)
+		uint32_t ack_seq, const struct tcp_options *opts)
 {
-	int i, j;
-	unsigned int opt, optlen;
+	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
 	uint32_t left_edge, right_edge;
+	uint32_t newly_sacked = 0;
+	int j;
 
-	for (i = 0; i < len; ) {
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
+	SACKTrim(rcvvar, ack_seq);
 
-            if (opt == TCP_OPT_SACK) {
-                j = 0;
-                while (j < optlen - 2) {
-                    left_edge = ntohl(*(uint32_t *)(tcpopt + i + j));
-                    right_edge = ntohl(*(uint32_t *)(tcpopt + i + j + 4));
+	if (opts->flags & TCP_OPT_FLAG_SACK) {
+		for (j = 0; j + 8 <= opts->sack_len; j += 8) {
+			left_edge = ntohl(*(uint32_t *)(opts->sack + j));
+			right_edge = ntohl(*(uint32_t *)(opts->sack + j + 4));
 
-                    _update_sack_table(cur_stream, left_edge, right_edge);
+			TRACE_SACK("Found SACK entry. "
+					"left_edge: %u, right_edge: %u\n", 
+					left_edge, right_edge);
+			if (!TCP_SEQ_LT(left_edge, right_edge) || 
+					!TCP_SEQ_GT(right_edge, ack_seq) || 
+					TCP_SEQ_GT(right_edge, cur_stream->snd_nxt))
+				continue;
+			if (TCP_SEQ_LT(left_edge, ack_seq))
+				left_edge = ack_seq;
+
+			newly_sacked += SACKInsert(rcvvar, left_edge, right_edge);
 
-                    j += 8;
-#if RTM_STAT
-                    cur_stream->rstat->sack_cnt++;
-                    cur_stream->rstat->sack_bytes += (right_edge - left_edge);
-#endif
-                    if (cur_stream->rcvvar->dup_acks == 3) {
 #if RTM_STAT
-                        cur_stream->rstat->tdp_sack_cnt++;
-                        cur_stream->rstat->tdp_sack_bytes += (right_edge - left_edge);
+			cur_stream->sndvar->rstat.sack_cnt++;
+			cur_stream->sndvar->rstat.sack_bytes += (right_edge - left_edge);
+			if (rcvvar->dup_acks == 3) {
+				cur_stream->sndvar->rstat.tdp_sack_cnt++;
+				cur_stream->sndvar->rstat.tdp_sack_bytes += 
+						(right_edge - left_edge);
+			}
 #endif
-                        TRACE_LOSS("SACK entry. "
-                                    "left_edge: %u, right_edge: %u (ack_seq: %u)\n",
-                                    left_edge, right_edge, ack_seq);
-
-                    }
-                    TRACE_SACK("Found SACK entry. "
-                                "left_edge: %u, right_edge: %u\n", 
-                                left_edge, right_edge);
-                }
-                i += j;
-            } else {
-                // not handle
-                i += optlen - 2;
-            }
-        }
+		}
+	}
+
+	rcvvar->sacked_pkts = rcvvar->sacked_bytes / cur_stream->sndvar->mss;
+
+	return newly_sacked;
+}
+/*----------------------------------------------------------------------------*/
+/* the out-of-order blocks we hold, ascending, MAX_SACK_ENTRY at most      */
+static inline int
+SACKReceivedBlocks(tcp_stream *cur_stream, struct sack_entry *blocks)
+{
+	struct tcp_recv_vars *rcvvar = cur_stream->rcvvar;
+	struct mptcp_ooo_ranges *ooo = rcvvar->mptcp_ooo;
+	struct fragment_ctx *frag;
+	int i, j, n = 0;
+
+	if (ooo) {
+		/* MPTCP subflow: the payload went to the meta buffer by DSN */
+		for (i = 0; i < ooo->cnt && n < MAX_SACK_ENTRY; i++) {
+			for (j = n; j > 0 && 
+					TCP_SEQ_GT(blocks[j - 1].left_edge, ooo->seq[i]); j--)
+				blocks[j] = blocks[j - 1];
+			blocks[j].left_edge = ooo->seq[i];
+			blocks[j].right_edge = ooo->end[i];
+			n++;
+		}
+		return n;
+	}
+
+	if (!rcvvar->rcvbuf)
+		return 0;
+	for (frag = rcvvar->rcvbuf->fctx; frag && n < MAX_SACK_ENTRY; 
+			frag = frag->next) {
+		if (TCP_SEQ_LEQ(frag->seq, cur_stream->rcv_nxt))
+			continue;
+		blocks[n].left_edge = frag->seq;
+		blocks[n].right_edge = frag->seq + frag->len;
+		n++;
+	}
+
+	return n;
+}
+/*----------------------------------------------------------------------------*/
+/* length of the SACK option an ACK to the peer carries, given room bytes   */
+/* of option space: two NOPs, kind, length and the blocks that fit          */
+uint16_t
+SACKOptionLength(tcp_stream *cur_stream, int room)
+{
+	struct sack_entry blocks[MAX_SACK_ENTRY];
+	int n;
+
+	if (room < 4 + TCP_OPT_SACK_BLOCK_LEN)
+		return 0;
+	n = SACKReceivedBlocks(cur_stream, blocks);
+	n = MIN(n, MIN(TCP_MAX_SACK_BLOCKS, (room - 4) / TCP_OPT_SACK_BLOCK_LEN));
+
+	return n ? 4 + n * TCP_OPT_SACK_BLOCK_LEN : 0;
+}
+/*----------------------------------------------------------------------------*/
+/* writes the SACK option of SACKOptionLength(); the block holding the      */
+/* segment that arrived last goes first (RFC 2018)                          */
+int
+GenerateSACKOption(tcp_stream *cur_stream, uint8_t *tcpopt, uint16_t optlen)
+{
+	struct sack_entry blocks[MAX_SACK_ENTRY];
+	uint32_t recent = cur_stream->rcvvar->sack_recent;
+	int want = (optlen - 4) / TCP_OPT_SACK_BLOCK_LEN;
+	int n, i, first, k;
+	int j = 0;
+
+	n = SACKReceivedBlocks(cur_stream, blocks);
+	for (first = 0; first < n; first++) {
+		if (TCP_SEQ_GEQ(recent, blocks[first].left_edge) && 
+				TCP_SEQ_LT(recent, blocks[first].right_edge))
+			break;
 	}
+	if (first == n)
+		first = 0;
+
+	tcpopt[j++] = TCP_OPT_NOP;
+	tcpopt[j++] = TCP_OPT_NOP;
+	tcpopt[j++] = TCP_OPT_SACK;
+	tcpopt[j++] = 2 + want * TCP_OPT_SACK_BLOCK_LEN;
+	for (k = 0; k < want; k++) {
+		/* the recent block, then the others from the lowest */
+		i = (k == 0) ? first : (k <= first ? k - 1 : k);
+		*(uint32_t *)(tcpopt + j) = htonl(blocks[i].left_edge);
+		*(uint32_t *)(tcpopt + j + 4) = htonl(blocks[i].right_edge);
+		j += TCP_OPT_SACK_BLOCK_LEN;
+	}
+
+	return j;
 }
 #endif /* TCP_OPT_SACK_ENABLED */
 /*---------------------------------------------------------------------------*/
@@ -542,337 +642,3 @@ PrintTCPOptions(uint8_t *tcpopt, int len)
 		}
 	}
 }
-
-/*---------------------------------------------------------------------------*/
-uint32_t sha1_hash_number(uint64_t number, unsigned char hash[SHA_DIGEST_LENGTH]) {
-    SHA_CTX sha_ctx;
-    SHA1_Init(&sha_ctx);
-    SHA1_Update(&sha_ctx, &number, sizeof(number));
-    SHA1_Final(hash, &sha_ctx);
-
-	// Extract the last 32 bits
-    uint32_t last32Bits = (uint32_t)(hash[19]) | (uint32_t)(hash[18]) << 8 | (uint32_t)(hash[17]) << 16 | (uint32_t)(hash[16]) << 24;
-
-    return last32Bits;
-}
-
-uint32_t sha1hashToken(uint64_t number, unsigned char hash[SHA_DIGEST_LENGTH]) {
-    SHA_CTX sha_ctx;
-    SHA1_Init(&sha_ctx);
-    SHA1_Update(&sha_ctx, &number, sizeof(number));
-    SHA1_Final(hash, &sha_ctx);
-
-	// Extract the first 32 bits
-    uint32_t first32Bits = (uint32_t)(hash[0]) << 24 | (uint32_t)(hash[1]) << 16 | (uint32_t)(hash[2]) << 8 | (uint32_t)(hash[3]);
-
-    return first32Bits;
-}
-
-uint32_t
-GetToken(uint64_t key)
-{
-	uint32_t token;
-
-	unsigned char hash[SHA_DIGEST_LENGTH];
-	token = sha1hashToken(htobe64(key), hash);
-	return token;
-}
-
-uint32_t
-GetPeerIdsnFromKey(uint64_t key)
-{
-	uint32_t peer_idsn;
-
-	unsigned char hash[SHA_DIGEST_LENGTH];
-	peer_idsn = sha1_hash_number(htobe64(key), hash);
-	return peer_idsn;
-}
-
-// Function to check if a DATA ACK is present in the Data Sequence Signal option type from among the options
-// present in the TCP header
-uint32_t
-GetDataAck(tcp_stream *cur_stream, uint8_t *tcpopt, int len)
-{
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	uint32_t dataAck;
-	uint8_t dataAckPresent = 0;
-
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0)){
-					
-					dataAckPresent = *(tcpopt + i + 1) & 0x01;
-					if (dataAckPresent)
-					{
-						dataAck = be32toh(*((uint32_t*)(tcpopt + i + 2)));
-						return dataAck;
-					}
-					else{
-						return 0;
-					}
-					
-				}
-
-				// Move to next option
-				i += optlen - 2;
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
-	}
-	//  No DATA_ACK
-	return 0;
-}
-
-// Get DATA SEQ no
-uint32_t
-GetDataSeq(tcp_stream *cur_stream, uint8_t *tcpopt, int len)
-{
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	uint32_t dataSeq;
-	uint8_t dataSeqPresent = 0;
-
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0)){
-					dataSeqPresent = *(tcpopt + i + 1) & 0x04;
-					if (dataSeqPresent)
-					{
-						dataSeq = be32toh(*((uint32_t*)(tcpopt + i + 6)));
-						return dataSeq;
-					}
-					else{
-						return 0;
-					}
-					
-				}
-
-				// Move to next option
-				i += optlen - 2;
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
-	}
-	//  No DSS
-	return 0;
-}
-
-// Get DATA Level length
-uint16_t
-GetDataLevelLength(tcp_stream *cur_stream, uint8_t *tcpopt, int len)
-{
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	uint16_t dataLevelLength;
-	uint8_t dataSeqPresent = 0;
-
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0)){
-					dataSeqPresent = *(tcpopt + i + 1) & 0x04;
-					if (dataSeqPresent)
-					{
-						dataLevelLength = be16toh(*((uint16_t*)(tcpopt + i + 14)));
-						return dataLevelLength;
-					}
-					else{
-						return 0;
-					}
-					
-				}
-
-				// Move to next option
-				i += optlen - 2;
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
-	}
-	//  No DSS
-	return 0;
-}
-
-
-uint32_t
-isDataFINPresent(tcp_stream *cur_stream, uint8_t *tcpopt, int len)
-{
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	uint8_t dataFINPresent = 0;
-
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_CAPABLE and return Peer Key
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == ((TCP_MPTCP_SUBTYPE_DSS << 4) | 0)){
-					dataFINPresent = *(tcpopt + i + 1) & 0x10;
-					return dataFINPresent > 0;
-					
-				}
-
-				// Move to next option
-				i += optlen - 2;
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
-	}
-	//  No DSS
-	return 0;
-}
-
-
-
-
-void hmac_sha1(const unsigned char *key, int key_len, const unsigned char *message, int message_len, unsigned char *digest) {
-    
-	HMAC_CTX *ctx;
-
-    // Allocate and initialize the context
-    ctx = HMAC_CTX_new();
-
-    // Using HMAC with SHA-1
-    HMAC_Init_ex(ctx, key, key_len, EVP_sha1(), NULL);
-    HMAC_Update(ctx, message, message_len);
-    HMAC_Final(ctx, digest, NULL);
-
-    // Clean up the context
-    HMAC_CTX_free(ctx);
-}
-
-void mp_join_hmac_generator(uint64_t key1, uint64_t key2, uint32_t num1, uint32_t num2, unsigned char* hash){
-
-	unsigned char key[16];
-    unsigned char message[8];
-
-	memcpy(key, &key1, sizeof(key1));
-    memcpy(key + sizeof(key1), &key2, sizeof(key2));
-
-	memcpy(message, &num1, sizeof(num1));
-    memcpy(message + sizeof(num1), &num2, sizeof(num2));
-
-    hmac_sha1(key, sizeof(key), message, sizeof(message), hash);
-
-}
-
-uint64_t checkMP_JOIN_SYN_ACK(tcp_stream *cur_stream, 
-		uint32_t cur_ts, uint8_t *tcpopt, int len){
-	int i;
-	unsigned int opt, optlen;
-	uint8_t subtypeAndVersion;
-	// uint32_t keyLow32,keyHigh32;
-
-	for (i = 0; i < len; ) {
-		// why i++ here? Because after using the value only it will increment, so initially it will be,
-		// opt = *(tcpopt + 0) = *tcpopt
-		opt = *(tcpopt + i++);
-		
-		if (opt == TCP_OPT_END) {	// end of option field
-			break;
-		} else if (opt == TCP_OPT_NOP) {	// no option
-			continue;
-		} else {
-
-			optlen = *(tcpopt + i++);
-			if (i + optlen - 2 > len) {
-				break;
-			}
-
-			if (opt == TCP_OPT_MPTCP) {
-				// Check MP_JOIN
-				subtypeAndVersion = (uint8_t)(*(tcpopt + i));
-				if(subtypeAndVersion == 0x10){
-					cur_stream->peerRandomNumber = be32toh(*(uint32_t*)(tcpopt + i + 10));
-					return be64toh(*(uint64_t*)(tcpopt + (i + 2)));
-				}
-			}
-			else{
-				// Move to next option
-				i += optlen - 2;
-			}
-		}
-	}
-	//  No MPTCP options
-	return 0;
-}
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include "tcp_out.h"
 #include "stat.h"
 #include "debug.h"
+#include "mptcp_cc.h"
+#include "mptcp_map.h"
+#include "mptcp_sched.h"
+#include "mptcp_info.h"
 #if USE_CCP
 #include "ccp.h"
 #endif
@@ -15,32 +19,108 @@
 #endif
 
 /*----------------------------------------------------------------------------*/
-struct rto_hashstore*
-InitRTOHashstore()
+struct timer_wheel *
+CreateTimerWheel()
 {
-	int i;
-	struct rto_hashstore* hs = calloc(1, sizeof(struct rto_hashstore));
-	if (!hs) {
-		TRACE_ERROR("calloc: InitHashStore");
-		return 0;
+	struct timer_wheel *tw;
+	int l, i;
+
+	tw = (struct timer_wheel *)calloc(1, sizeof(struct timer_wheel));
+	if (!tw) {
+		TRACE_ERROR("calloc: CreateTimerWheel");
+		return NULL;
 	}
 
-	for (i = 0; i < RTO_HASH; i++)
-		TAILQ_INIT(&hs->rto_list[i]);
-		
-	TAILQ_INIT(&hs->rto_list[RTO_HASH]);
+	for (l = 0; l < TW_LEVELS; l++)
+		for (i = 0; i < TW_SLOTS; i++)
+			TAILQ_INIT(&tw->slots[l][i]);
+	TAILQ_INIT(&tw->expiring);
 
-	return hs;
+	return tw;
 }
 /*----------------------------------------------------------------------------*/
-inline void 
-AddtoRTOList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
+void
+DestroyTimerWheel(struct timer_wheel *tw)
 {
-	if (!mtcp->rto_list_cnt) {
-		mtcp->rto_store->rto_now_idx = 0;
-		mtcp->rto_store->rto_now_ts = cur_stream->sndvar->ts_rto;
+	free(tw);
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+TimerWheelAdd(struct timer_wheel *tw, struct tcp_timer *t)
+{
+	uint32_t expire = t->expire;
+	uint32_t delta = expire - tw->now;
+	int level, slot;
+
+	if ((int32_t)delta < 0) {
+		/* overdue, the next tick fires it */
+		expire = tw->now;
+		delta = 0;
+	} else if (delta > TW_MAX_DELTA) {
+		/* filed at the horizon and filed again from there */
+		expire = tw->now + TW_MAX_DELTA;
+		delta = TW_MAX_DELTA;
+	}
+
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1U << (TW_BITS * (level + 1))))
+			break;
 	}
+	slot = (expire >> (TW_BITS * level)) & TW_MASK;
+
+	TAILQ_INSERT_TAIL(&tw->slots[level][slot], t, link);
+	if (level == 0)
+		tw->occupied |= 1ULL << slot;
+	t->idx = level * TW_SLOTS + slot;
+	t->armed = TRUE;
+	tw->cnt++;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+TimerWheelDel(struct timer_wheel *tw, struct tcp_timer *t)
+{
+	int level = t->idx / TW_SLOTS;
+	int slot = t->idx & TW_MASK;
 
+	if (t->idx == TW_EXPIRING) {
+		TAILQ_REMOVE(&tw->expiring, t, link);
+	} else {
+		TAILQ_REMOVE(&tw->slots[level][slot], t, link);
+		if (level == 0 && TAILQ_EMPTY(&tw->slots[0][slot]))
+			tw->occupied &= ~(1ULL << slot);
+	}
+	t->armed = FALSE;
+	tw->cnt--;
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+ArmTimer(mtcp_manager_t mtcp, struct tcp_timer *t, tcp_stream *cur_stream, 
+		int type, uint32_t expire)
+{
+	struct timer_wheel *tw = mtcp->timer_wheel;
+
+	if (t->armed)
+		TimerWheelDel(tw, t);
+	/* an empty wheel may have stood still, restart it from now */
+	if (!tw->cnt)
+		tw->now = mtcp->cur_ts;
+
+	t->stream = cur_stream;
+	t->type = type;
+	t->expire = expire;
+	TimerWheelAdd(tw, t);
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+DisarmTimer(mtcp_manager_t mtcp, struct tcp_timer *t)
+{
+	if (t->armed)
+		TimerWheelDel(mtcp->timer_wheel, t);
+}
+/*----------------------------------------------------------------------------*/
+inline void 
+AddtoRTOList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
+{
 	if (cur_stream->on_rto_idx < 0 ) {
 		if (cur_stream->on_timewait_list) {
 			TRACE_ERROR("Stream %u: cannot be in both "
@@ -51,17 +131,9 @@ AddtoRTOList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 			return;
 		}
 
-		int diff = (int32_t)(cur_stream->sndvar->ts_rto - mtcp->rto_store->rto_now_ts);
-		if (diff < RTO_HASH) {
-			int offset= (diff + mtcp->rto_store->rto_now_idx) % RTO_HASH;
-			cur_stream->on_rto_idx = offset;
-			TAILQ_INSERT_TAIL(&(mtcp->rto_store->rto_list[offset]), 
-					cur_stream, sndvar->timer_link);
-		} else {
-			cur_stream->on_rto_idx = RTO_HASH;
-			TAILQ_INSERT_TAIL(&(mtcp->rto_store->rto_list[RTO_HASH]), 
-					cur_stream, sndvar->timer_link);
-		}
+		ArmTimer(mtcp, &cur_stream->sndvar->timer, cur_stream, 
+				TCP_TIMER_RTO, cur_stream->sndvar->ts_rto);
+		cur_stream->on_rto_idx = cur_stream->sndvar->timer.idx;
 		mtcp->rto_list_cnt++;
 	}
 }
@@ -74,8 +146,7 @@ RemoveFromRTOList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 		return;
 	}
 	
-	TAILQ_REMOVE(&mtcp->rto_store->rto_list[cur_stream->on_rto_idx], 
-			cur_stream, sndvar->timer_link);
+	DisarmTimer(mtcp, &cur_stream->sndvar->timer);
 	cur_stream->on_rto_idx = -1;
 
 	mtcp->rto_list_cnt--;
@@ -86,11 +157,7 @@ AddtoTimewaitList(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts)
 {
 	cur_stream->rcvvar->ts_tw_expire = cur_ts + CONFIG.tcp_timewait;
 
-	if (cur_stream->on_timewait_list) {
-		// Update list in sorted way by ts_tw_expire
-		TAILQ_REMOVE(&mtcp->timewait_list, cur_stream, sndvar->timer_link);
-		TAILQ_INSERT_TAIL(&mtcp->timewait_list, cur_stream, sndvar->timer_link);	
-	} else {
+	if (!cur_stream->on_timewait_list) {
 		if (cur_stream->on_rto_idx >= 0) {
 			TRACE_DBG("Stream %u: cannot be in both "
 					"timewait and rto list.\n", cur_stream->id);
@@ -102,9 +169,11 @@ AddtoTimewaitList(mtcp_manager_t mtcp, tcp_stream *cur_stream, uint32_t cur_ts)
 		}
 
 		cur_stream->on_timewait_list = TRUE;
-		TAILQ_INSERT_TAIL(&mtcp->timewait_list, cur_stream, sndvar->timer_link);
 		mtcp->timewait_list_cnt++;
 	}
+
+	ArmTimer(mtcp, &cur_stream->sndvar->timer, cur_stream, 
+			TCP_TIMER_TIMEWAIT, cur_stream->rcvvar->ts_tw_expire);
 }
 /*----------------------------------------------------------------------------*/
 inline void 
@@ -115,11 +184,15 @@ RemoveFromTimewaitList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 		return;
 	}
 	
-	TAILQ_REMOVE(&mtcp->timewait_list, cur_stream, sndvar->timer_link);
+	DisarmTimer(mtcp, &cur_stream->sndvar->timer);
 	cur_stream->on_timewait_list = FALSE;
 	mtcp->timewait_list_cnt--;
 }
 /*----------------------------------------------------------------------------*/
+/* the idle timer is not moved on every packet: it fires tcp_timeout after */
+/* the activity it was armed for and is armed again if last_active_ts has  */
+/* moved since                                                              */
+/*----------------------------------------------------------------------------*/
 inline void 
 AddtoTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 {
@@ -129,7 +202,8 @@ AddtoTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 	}
 
 	cur_stream->on_timeout_list = TRUE;
-	TAILQ_INSERT_TAIL(&mtcp->timeout_list, cur_stream, sndvar->timeout_link);
+	ArmTimer(mtcp, &cur_stream->sndvar->idle_timer, cur_stream, 
+			TCP_TIMER_IDLE, cur_stream->last_active_ts + CONFIG.tcp_timeout);
 	mtcp->timeout_list_cnt++;
 }
 /*----------------------------------------------------------------------------*/
@@ -138,20 +212,11 @@ RemoveFromTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
 {
 	if (cur_stream->on_timeout_list) {
 		cur_stream->on_timeout_list = FALSE;
-		TAILQ_REMOVE(&mtcp->timeout_list, cur_stream, sndvar->timeout_link);
+		DisarmTimer(mtcp, &cur_stream->sndvar->idle_timer);
 		mtcp->timeout_list_cnt--;
 	}
 }
 /*----------------------------------------------------------------------------*/
-inline void 
-UpdateTimeoutList(mtcp_manager_t mtcp, tcp_stream *cur_stream)
-{
-	if (cur_stream->on_timeout_list) {
-		TAILQ_REMOVE(&mtcp->timeout_list, cur_stream, sndvar->timeout_link);
-		TAILQ_INSERT_TAIL(&mtcp->timeout_list, cur_stream, sndvar->timeout_link);
-	}
-}
-/*----------------------------------------------------------------------------*/
 inline void
 UpdateRetransmissionTimer(mtcp_manager_t mtcp, 
 		tcp_stream *cur_stream, uint32_t cur_ts)
@@ -246,7 +311,12 @@ HandleRTO(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream)
 	//cur_stream->sndvar->ts_rto = cur_ts + cur_stream->sndvar->rto;
 
 	/* reduce congestion window and ssthresh */
-	cur_stream->sndvar->ssthresh = MIN(cur_stream->sndvar->cwnd, cur_stream->sndvar->peer_wnd) / 2;
+	if (MPTCP_CC_COUPLED(cur_stream)) {
+		cur_stream->sndvar->ssthresh = MPTCPCCSsthresh(cur_stream);
+	} else {
+		cur_stream->sndvar->ssthresh = 
+				MIN(cur_stream->sndvar->cwnd, cur_stream->sndvar->peer_wnd) / 2;
+	}
 	if (cur_stream->sndvar->ssthresh < (2 * cur_stream->sndvar->mss)) {
 		cur_stream->sndvar->ssthresh = cur_stream->sndvar->mss * 2;
 	}
@@ -288,6 +358,12 @@ HandleRTO(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream)
 		/* Data lost */
 		TRACE_RTO("Stream %d: Retransmit data. snd_nxt: %u, snd_una: %u\n", 
 				cur_stream->id, cur_stream->snd_nxt, cur_stream->sndvar->snd_una);
+		/* MPTCP: do not leave the data waiting on a path that stalled; */
+		/* the scheduler skips it, or fails over, until it is acked again */
+		if (cur_stream->sndvar->dss_maps && MPTCPSubflowStall(cur_stream)) {
+			MPTCPReinjectSubflow(mtcp, cur_stream);
+			MPTCPInfoPublish(mtcp, cur_stream->mptcp_cb, TRUE);
+		}
 
 	} else if (cur_stream->state == TCP_ST_CLOSE_WAIT) {
 		/* Data lost */
@@ -323,6 +399,10 @@ HandleRTO(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream)
 		return 0;
 	}
 
+	CancelRTTSample(cur_stream);
+#if TCP_OPT_SACK_ENABLED
+	SACKReset(cur_stream);
+#endif
 	cur_stream->snd_nxt = cur_stream->sndvar->snd_una;
 	if (cur_stream->state == TCP_ST_ESTABLISHED || 
 			cur_stream->state == TCP_ST_CLOSE_WAIT) {
@@ -357,167 +437,154 @@ HandleRTO(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream)
 	return 0;
 }
 /*----------------------------------------------------------------------------*/
-static inline void 
-RearrangeRTOStore(mtcp_manager_t mtcp) {
-	tcp_stream *walk, *next;
-	struct rto_head* rto_list = &mtcp->rto_store->rto_list[RTO_HASH];
-	int cnt = 0;
-
-	for (walk = TAILQ_FIRST(rto_list);
-			walk != NULL; walk = next) {
-		next = TAILQ_NEXT(walk, sndvar->timer_link);
-
-		int diff = (int32_t)(mtcp->rto_store->rto_now_ts - walk->sndvar->ts_rto);
-		if (diff < RTO_HASH) {
-			int offset = (diff + mtcp->rto_store->rto_now_idx) % RTO_HASH;
-			TAILQ_REMOVE(&mtcp->rto_store->rto_list[RTO_HASH],
-					            walk, sndvar->timer_link);
-			walk->on_rto_idx = offset;
-			TAILQ_INSERT_TAIL(&(mtcp->rto_store->rto_list[offset]),
-					walk, sndvar->timer_link);
-		}
-		cnt++;
-	}	
+static inline void
+HandleTimewaitExpire(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream)
+{
+	if (cur_stream->sndvar->on_control_list) {
+		/* the last ACK is still to go out, look again on the next tick */
+		ArmTimer(mtcp, &cur_stream->sndvar->timer, cur_stream, 
+				TCP_TIMER_TIMEWAIT, cur_ts + 1);
+		return;
+	}
+
+	cur_stream->on_timewait_list = FALSE;
+	mtcp->timewait_list_cnt--;
+
+	cur_stream->state = TCP_ST_CLOSED;
+	cur_stream->close_reason = TCP_ACTIVE_CLOSE;
+	TRACE_STATE("Stream %d: TCP_ST_CLOSED\n", cur_stream->id);
+	DestroyTCPStream(mtcp, cur_stream);
 }
 /*----------------------------------------------------------------------------*/
-void
-CheckRtmTimeout(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh)
+static inline void
+HandleConnectionTimeout(mtcp_manager_t mtcp, uint32_t cur_ts, tcp_stream *cur_stream)
 {
-	tcp_stream *walk, *next;
-	struct rto_head* rto_list;
-	int cnt;
-	
-	if (!mtcp->rto_list_cnt) {
+	if ((int32_t)(cur_ts - cur_stream->last_active_ts) < CONFIG.tcp_timeout) {
+		ArmTimer(mtcp, &cur_stream->sndvar->idle_timer, cur_stream, 
+				TCP_TIMER_IDLE, cur_stream->last_active_ts + CONFIG.tcp_timeout);
 		return;
 	}
 
+	cur_stream->on_timeout_list = FALSE;
+	mtcp->timeout_list_cnt--;
+	cur_stream->state = TCP_ST_CLOSED;
+	cur_stream->close_reason = TCP_TIMEDOUT;
+	if (cur_stream->socket) {
+		RaiseErrorEvent(mtcp, cur_stream);
+	} else {
+		DestroyTCPStream(mtcp, cur_stream);
+	}
+}
+/*----------------------------------------------------------------------------*/
+static inline void
+FireTimer(mtcp_manager_t mtcp, uint32_t cur_ts, struct tcp_timer *t)
+{
+	tcp_stream *cur_stream = t->stream;
+
+	switch (t->type) {
+	case TCP_TIMER_RTO:
+		cur_stream->on_rto_idx = -1;
+		mtcp->rto_list_cnt--;
+		HandleRTO(mtcp, cur_ts, cur_stream);
+		break;
+	case TCP_TIMER_TIMEWAIT:
+		HandleTimewaitExpire(mtcp, cur_ts, cur_stream);
+		break;
+	case TCP_TIMER_IDLE:
+		HandleConnectionTimeout(mtcp, cur_ts, cur_stream);
+		break;
+	}
+}
+/*----------------------------------------------------------------------------*/
+/* moves the timers of a slot above level 0 down to where they belong now */
+static inline void
+CascadeTimers(struct timer_wheel *tw, int level, int slot)
+{
+	struct tw_head list;
+	struct tcp_timer *t;
+
+	TAILQ_INIT(&list);
+	TAILQ_CONCAT(&list, &tw->slots[level][slot], link);
+
+	while ((t = TAILQ_FIRST(&list))) {
+		TAILQ_REMOVE(&list, t, link);
+		tw->cnt--;
+		TimerWheelAdd(tw, t);
+	}
+}
+/*----------------------------------------------------------------------------*/
+/* handlers may disarm any timer, also one that is due with them, so the    */
+/* due timers wait in tw->expiring, where TimerWheelDel finds them too      */
+/*----------------------------------------------------------------------------*/
+void
+CheckTimers(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh)
+{
+	struct timer_wheel *tw = mtcp->timer_wheel;
+	struct tcp_timer *t;
+	uint64_t pending;
+	uint32_t idx, step;
+	int l, cnt;
+
+	if (!tw->cnt)
+		return;
+
 	STAT_COUNT(mtcp->runstat.rounds_rtocheck);
 
 	cnt = 0;
-			
 	while (1) {
-		
-		rto_list = &mtcp->rto_store->rto_list[mtcp->rto_store->rto_now_idx];
-		if ((int32_t)(cur_ts - mtcp->rto_store->rto_now_ts) < 0) {
-			break;
-		}
-		
-		for (walk = TAILQ_FIRST(rto_list);
-				walk != NULL; walk = next) {
+		while ((t = TAILQ_FIRST(&tw->expiring))) {
 			if (++cnt > thresh) {
-				break;
+				/* the rest goes first in the next round */
+				TRACE_ROUND("Checking timers. cnt: %d\n", cnt);
+				return;
 			}
-			next = TAILQ_NEXT(walk, sndvar->timer_link);
+			TimerWheelDel(tw, t);
 
-			TRACE_LOOP("Inside rto list. cnt: %u, stream: %d\n", 
-					cnt, walk->s_id);
+			TRACE_LOOP("Timer expired. type: %u, stream: %d\n", 
+					t->type, t->stream->id);
 
-			if (walk->on_rto_idx >= 0) {
-				TAILQ_REMOVE(rto_list, walk, sndvar->timer_link);
-				mtcp->rto_list_cnt--;
-				walk->on_rto_idx = -1;
-				HandleRTO(mtcp, cur_ts, walk);
-			} else {
-				TRACE_ERROR("Stream %d: not on rto list.\n", walk->id);
-#ifdef DUMP_STREAM
-				DumpStream(mtcp, walk);
-#endif
+			if ((int32_t)(t->expire - cur_ts) > 0) {
+				/* was filed at the horizon */
+				TimerWheelAdd(tw, t);
+				continue;
 			}
+			FireTimer(mtcp, cur_ts, t);
 		}
 
-		if (cnt > thresh) {
+		if (!tw->cnt || (int32_t)(cur_ts - tw->now) < 0)
 			break;
-		} else {
-			mtcp->rto_store->rto_now_idx = (mtcp->rto_store->rto_now_idx + 1) % RTO_HASH;
-			mtcp->rto_store->rto_now_ts++;
-			if (!(mtcp->rto_store->rto_now_idx % 1000)) {
-				RearrangeRTOStore(mtcp);
-			}
-		}
 
-	}
-
-	TRACE_ROUND("Checking retransmission timeout. cnt: %d\n", cnt);
-}
-/*----------------------------------------------------------------------------*/
-void 
-CheckTimewaitExpire(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh)
-{
-	tcp_stream *walk, *next;
-	int cnt;
-
-	STAT_COUNT(mtcp->runstat.rounds_twcheck);
-
-	cnt = 0;
+		idx = tw->now & TW_MASK;
 
-	for (walk = TAILQ_FIRST(&mtcp->timewait_list); 
-				walk != NULL; walk = next) {
-		if (++cnt > thresh)
-			break;
-		next = TAILQ_NEXT(walk, sndvar->timer_link);
-		
-		TRACE_LOOP("Inside timewait list. cnt: %u, stream: %d\n", 
-				cnt, walk->s_id);
-		
-		if (walk->on_timewait_list) {
-			if ((int32_t)(cur_ts - walk->rcvvar->ts_tw_expire) >= 0) {
-				if (!walk->sndvar->on_control_list) {
-					
-					TAILQ_REMOVE(&mtcp->timewait_list, walk, sndvar->timer_link);
-					walk->on_timewait_list = FALSE;
-					mtcp->timewait_list_cnt--;
-
-					walk->state = TCP_ST_CLOSED;
-					walk->close_reason = TCP_ACTIVE_CLOSE;
-					TRACE_STATE("Stream %d: TCP_ST_CLOSED\n", walk->id);
-					DestroyTCPStream(mtcp, walk);
-				}
-			} else {
-				break;
+		/* level 0 turned over: bring down the next slot of each level */
+		/* above, as far as that one turned over as well                */
+		if (idx == 0) {
+			for (l = 1; l < TW_LEVELS; l++) {
+				uint32_t slot = (tw->now >> (TW_BITS * l)) & TW_MASK;
+				CascadeTimers(tw, l, slot);
+				if (slot)
+					break;
 			}
-		} else {
-			TRACE_ERROR("Stream %d: not on timewait list.\n", walk->id);
-#ifdef DUMP_STREAM
-			DumpStream(mtcp, walk);
-#endif
 		}
-	}
-
-	TRACE_ROUND("Checking timewait timeout. cnt: %d\n", cnt);
-}
-/*----------------------------------------------------------------------------*/
-void 
-CheckConnectionTimeout(mtcp_manager_t mtcp, uint32_t cur_ts, int thresh)
-{
-	tcp_stream *walk, *next;
-	int cnt;
-
-	STAT_COUNT(mtcp->runstat.rounds_tocheck);
 
-	cnt = 0;
-	for (walk = TAILQ_FIRST(&mtcp->timeout_list);
-			walk != NULL; walk = next) {
-		if (++cnt > thresh)
-			break;
-		next = TAILQ_NEXT(walk, sndvar->timeout_link);
-
-		if ((int32_t)(cur_ts - walk->last_active_ts) >= 
-				CONFIG.tcp_timeout) {
-
-			walk->on_timeout_list = FALSE;
-			TAILQ_REMOVE(&mtcp->timeout_list, walk, sndvar->timeout_link);
-			mtcp->timeout_list_cnt--;
-			walk->state = TCP_ST_CLOSED;
-			walk->close_reason = TCP_TIMEDOUT;
-			if (walk->socket) {
-				RaiseErrorEvent(mtcp, walk);
-			} else {
-				DestroyTCPStream(mtcp, walk);
-			}
-		} else {
-			break;
+		if (!(tw->occupied & (1ULL << idx))) {
+			/* jump to the next busy slot, or to the next turn */
+			pending = tw->occupied & (~0ULL << idx);
+			step = pending ? (uint32_t)__builtin_ctzll(pending) - idx : 
+					TW_SLOTS - idx;
+			if (step > cur_ts - tw->now + 1)
+				step = cur_ts - tw->now + 1;
+			tw->now += step;
+			continue;
 		}
 
+		TAILQ_FOREACH(t, &tw->slots[0][idx], link)
+			t->idx = TW_EXPIRING;
+		TAILQ_CONCAT(&tw->expiring, &tw->slots[0][idx], link);
+		tw->occupied &= ~(1ULL << idx);
+		tw->now++;
 	}
+
+	TRACE_ROUND("Checking timers. cnt: %d\n", cnt);
 }
 /*----------------------------------------------------------------------------*/